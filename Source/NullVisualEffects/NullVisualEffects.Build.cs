@@ -53,6 +53,7 @@ public class NullVisualEffects : ModuleRules
                 "RenderCore",
                 "Renderer",
                 "RHI",
+                "Json",
             }
         );
 
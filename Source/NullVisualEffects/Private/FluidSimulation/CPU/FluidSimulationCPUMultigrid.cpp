@@ -0,0 +1,296 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/CPU/FluidSimulationCPUMultigrid.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "Async/ParallelFor.h"
+
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUMultigrid Project"), STAT_FluidSimulationCPUMultigrid_Project, STATGROUP_NullVisualEffects);
+
+namespace FluidSimulationCPUMultigrid
+{
+    /** Coarsening stops once a level is this small, must match FFluidSimulationProjection */
+    static constexpr int32 MinLevelSize = 8;
+
+    /** Sweeps on the coarsest level, must match FFluidSimulationProjection */
+    static constexpr int32 CoarsestIterations = 16;
+
+    /** Rows below which a level is not worth spreading across threads */
+    static constexpr int32 MinParallelRows = 32;
+
+    /** Returns the plane value at (X, Y), zero outside the grid */
+    FORCEINLINE float Load(const FFluidSimulationPlane& InPlane, const int32 InSize, const int32 X, const int32 Y)
+    {
+        return (X >= 0 && X < InSize && Y >= 0 && Y < InSize) ? InPlane[X * InSize + Y] : 0.0f;
+    }
+
+    /** Returns the sum of the 4 neighbours of (X, Y) */
+    FORCEINLINE float NeighbourSum(const FFluidSimulationPlane& InPlane, const int32 InSize, const int32 X, const int32 Y)
+    {
+        return Load(InPlane, InSize, X + 1, Y) + Load(InPlane, InSize, X - 1, Y) + Load(InPlane, InSize, X, Y + 1) + Load(InPlane, InSize, X, Y - 1);
+    }
+}
+
+FFluidSimulationCPUMultigrid::FFluidSimulationCPUMultigrid()
+    : bMultithreaded(true)
+{
+}
+
+FFluidSimulationCPUMultigrid::~FFluidSimulationCPUMultigrid()
+{
+}
+
+void FFluidSimulationCPUMultigrid::Init(const int32 InSimulationGridSize, const bool bInMultithreaded)
+{
+    Levels.Reset();
+    bMultithreaded = bInMultithreaded;
+
+    int32 Size = InSimulationGridSize;
+    float CellSize = 1.0f;
+
+    while (Size > 0)
+    {
+        FLevel& Level = Levels.AddDefaulted_GetRef();
+        Level.Size = Size;
+        Level.CellSizeSquared = CellSize * CellSize;
+        Level.Pressure.SetNumZeroed(Size * Size);
+        Level.RightHandSide.SetNumZeroed(Size * Size);
+        Level.Residual.SetNumZeroed(Size * Size);
+
+        if (Size <= FluidSimulationCPUMultigrid::MinLevelSize)
+        {
+            break;
+        }
+
+        Size = (Size + 1) / 2;
+        CellSize *= 2.0f;
+    }
+}
+
+void FFluidSimulationCPUMultigrid::Release()
+{
+    Levels.Empty();
+}
+
+SIZE_T FFluidSimulationCPUMultigrid::GetAllocatedSize() const
+{
+    SIZE_T Size = Levels.GetAllocatedSize();
+
+    for (const FLevel& Level : Levels)
+    {
+        Size += Level.Pressure.GetAllocatedSize() + Level.RightHandSide.GetAllocatedSize() + Level.Residual.GetAllocatedSize();
+    }
+
+    return Size;
+}
+
+int32 FFluidSimulationCPUMultigrid::Project(const FFluidSimulationProjectionSettings& InSettings, FFluidSimulationPlane& InOutVelocityX, FFluidSimulationPlane& InOutVelocityY, float& OutResidual, TArrayView<const uint8> InTileListed, const int32 InTileSize)
+{
+    using namespace FluidSimulationCPUMultigrid;
+
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUMultigrid_Project);
+
+    OutResidual = 0.0f;
+
+    if (Levels.Num() == 0)
+    {
+        return 0;
+    }
+
+    FLevel& Finest = Levels[0];
+    const int32 N = Finest.Size;
+
+    // Skipped tiles are at rest and never measured, velocity written into them would stay there, matches FluidSimulationProjectionCS.usf
+    const bool bAllTiles = InTileListed.Num() == 0 || InTileSize <= 0;
+    const int32 NumTilesPerSide = bAllTiles ? 0 : FMath::DivideAndRoundUp(N, InTileSize);
+    auto IsListed = [&](const int32 X, const int32 Y)
+    {
+        return bAllTiles || InTileListed[(X / InTileSize) * NumTilesPerSide + Y / InTileSize] != 0;
+    };
+
+    // Divergence of the velocity is the right hand side of the pressure equation
+    ForEachRow(N, [&](const int32 X)
+    {
+        for (int32 Y = 0; Y < N; ++Y)
+        {
+            if (!IsListed(X, Y))
+            {
+                Finest.RightHandSide[X * N + Y] = 0.0f;
+                continue;
+            }
+
+            const float DivergenceX = Load(InOutVelocityX, N, X + 1, Y) - Load(InOutVelocityX, N, X - 1, Y);
+            const float DivergenceY = Load(InOutVelocityY, N, X, Y + 1) - Load(InOutVelocityY, N, X, Y - 1);
+            Finest.RightHandSide[X * N + Y] = 0.5f * (DivergenceX + DivergenceY);
+        }
+    });
+
+    const int32 MaxCycles = FMath::Max(InSettings.NumCycles, 1);
+    const int32 SmoothingIterations = FMath::Max(InSettings.NumSmoothingIterations, 1);
+
+    int32 Cycle = 0;
+    OutResidual = ComputeResidual(Finest);
+
+    while (Cycle < MaxCycles && OutResidual > InSettings.ResidualTolerance)
+    {
+        VCycle(0, SmoothingIterations);
+        OutResidual = ComputeResidual(Finest);
+        ++Cycle;
+    }
+
+    // Subtract the pressure gradient
+    ForEachRow(N, [&](const int32 X)
+    {
+        for (int32 Y = 0; Y < N; ++Y)
+        {
+            if (!IsListed(X, Y))
+            {
+                continue;
+            }
+
+            const int32 Index = X * N + Y;
+            InOutVelocityX[Index] -= 0.5f * (Load(Finest.Pressure, N, X + 1, Y) - Load(Finest.Pressure, N, X - 1, Y));
+            InOutVelocityY[Index] -= 0.5f * (Load(Finest.Pressure, N, X, Y + 1) - Load(Finest.Pressure, N, X, Y - 1));
+        }
+    });
+
+    return Cycle;
+}
+
+void FFluidSimulationCPUMultigrid::VCycle(const int32 InLevelIndex, const int32 InSmoothingIterations)
+{
+    FLevel& Level = Levels[InLevelIndex];
+
+    if (InLevelIndex == Levels.Num() - 1)
+    {
+        Smooth(Level, FluidSimulationCPUMultigrid::CoarsestIterations);
+        return;
+    }
+
+    FLevel& Coarse = Levels[InLevelIndex + 1];
+
+    Smooth(Level, InSmoothingIterations);
+    ComputeResidual(Level);
+    Restrict(Level, Coarse);
+    VCycle(InLevelIndex + 1, InSmoothingIterations);
+    Prolongate(Coarse, Level);
+    Smooth(Level, InSmoothingIterations);
+}
+
+void FFluidSimulationCPUMultigrid::Smooth(FLevel& InOutLevel, const int32 InIterations) const
+{
+    using namespace FluidSimulationCPUMultigrid;
+
+    const int32 Size = InOutLevel.Size;
+
+    for (int32 Iteration = 0; Iteration < InIterations; ++Iteration)
+    {
+        for (int32 Color = 0; Color < 2; ++Color)
+        {
+            // Cells of one color only have neighbours of the other, so a color can be updated in place and in parallel
+            ForEachRow(Size, [&](const int32 X)
+            {
+                for (int32 Y = (X + Color) & 1; Y < Size; Y += 2)
+                {
+                    const int32 Index = X * Size + Y;
+                    InOutLevel.Pressure[Index] = (NeighbourSum(InOutLevel.Pressure, Size, X, Y) - InOutLevel.CellSizeSquared * InOutLevel.RightHandSide[Index]) * 0.25f;
+                }
+            });
+        }
+    }
+}
+
+float FFluidSimulationCPUMultigrid::ComputeResidual(FLevel& InOutLevel) const
+{
+    using namespace FluidSimulationCPUMultigrid;
+
+    const int32 Size = InOutLevel.Size;
+    const float CellSizeSquaredRecip = 1.0f / InOutLevel.CellSizeSquared;
+
+    TArray<float> RowMaximum;
+    RowMaximum.SetNumZeroed(Size);
+
+    ForEachRow(Size, [&](const int32 X)
+    {
+        float Maximum = 0.0f;
+
+        for (int32 Y = 0; Y < Size; ++Y)
+        {
+            const int32 Index = X * Size + Y;
+            const float Laplacian = (NeighbourSum(InOutLevel.Pressure, Size, X, Y) - 4.0f * InOutLevel.Pressure[Index]) * CellSizeSquaredRecip;
+            const float Residual = InOutLevel.RightHandSide[Index] - Laplacian;
+
+            InOutLevel.Residual[Index] = Residual;
+            Maximum = FMath::Max(Maximum, FMath::Abs(Residual));
+        }
+
+        RowMaximum[X] = Maximum;
+    });
+
+    float Maximum = 0.0f;
+    for (const float Value : RowMaximum)
+    {
+        Maximum = FMath::Max(Maximum, Value);
+    }
+
+    return Maximum;
+}
+
+void FFluidSimulationCPUMultigrid::Restrict(const FLevel& InFine, FLevel& OutCoarse) const
+{
+    const int32 FineSize = InFine.Size;
+    const int32 CoarseSize = OutCoarse.Size;
+
+    ForEachRow(CoarseSize, [&](const int32 X)
+    {
+        for (int32 Y = 0; Y < CoarseSize; ++Y)
+        {
+            float Sum = 0.0f;
+            float Count = 0.0f;
+
+            for (int32 ChildX = X * 2; ChildX < FMath::Min(X * 2 + 2, FineSize); ++ChildX)
+            {
+                for (int32 ChildY = Y * 2; ChildY < FMath::Min(Y * 2 + 2, FineSize); ++ChildY)
+                {
+                    Sum += InFine.Residual[ChildX * FineSize + ChildY];
+                    Count += 1.0f;
+                }
+            }
+
+            const int32 Index = X * CoarseSize + Y;
+            OutCoarse.RightHandSide[Index] = Sum / FMath::Max(Count, 1.0f);
+            OutCoarse.Pressure[Index] = 0.0f;
+        }
+    });
+}
+
+void FFluidSimulationCPUMultigrid::Prolongate(const FLevel& InCoarse, FLevel& InOutFine) const
+{
+    using namespace FluidSimulationCPUMultigrid;
+
+    const int32 FineSize = InOutFine.Size;
+    const int32 CoarseSize = InCoarse.Size;
+
+    ForEachRow(FineSize, [&](const int32 X)
+    {
+        // Fine cell centers expressed in coarse cell coords
+        const float CoarseX = (X - 0.5f) * 0.5f;
+        const int32 X0 = FMath::FloorToInt(CoarseX);
+        const float FracX = CoarseX - X0;
+
+        for (int32 Y = 0; Y < FineSize; ++Y)
+        {
+            const float CoarseY = (Y - 0.5f) * 0.5f;
+            const int32 Y0 = FMath::FloorToInt(CoarseY);
+            const float FracY = CoarseY - Y0;
+
+            const float Bottom = FMath::Lerp(Load(InCoarse.Pressure, CoarseSize, X0, Y0), Load(InCoarse.Pressure, CoarseSize, X0 + 1, Y0), FracX);
+            const float Top = FMath::Lerp(Load(InCoarse.Pressure, CoarseSize, X0, Y0 + 1), Load(InCoarse.Pressure, CoarseSize, X0 + 1, Y0 + 1), FracX);
+            InOutFine.Pressure[X * FineSize + Y] += FMath::Lerp(Bottom, Top, FracY);
+        }
+    });
+}
+
+void FFluidSimulationCPUMultigrid::ForEachRow(const int32 InNumRows, TFunctionRef<void(int32)> InFunction) const
+{
+    ParallelFor(InNumRows, InFunction, !bMultithreaded || InNumRows < FluidSimulationCPUMultigrid::MinParallelRows);
+}
@@ -0,0 +1,1079 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/CPU/FluidSimulationCPUSolver.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "FluidSimulation/Render/FluidSimulationBrush.h"
+#include "NullVisualEffects.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Math/Float16.h"
+
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUSolver Step"), STAT_FluidSimulationCPUSolver_Step, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUSolver UpdateActiveTiles"), STAT_FluidSimulationCPUSolver_UpdateActiveTiles, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUSolver MeasureActivity"), STAT_FluidSimulationCPUSolver_MeasureActivity, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUSolver QuantizeState"), STAT_FluidSimulationCPUSolver_QuantizeState, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUSolver AddInputData"), STAT_FluidSimulationCPUSolver_AddInputData, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUSolver Advect"), STAT_FluidSimulationCPUSolver_Advect, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUSolver UpdateFluid"), STAT_FluidSimulationCPUSolver_UpdateFluid, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUSolver UpdateShallowWater"), STAT_FluidSimulationCPUSolver_UpdateShallowWater, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUSolver Project"), STAT_FluidSimulationCPUSolver_Project, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationCPUSolver DrawToColorBuffer"), STAT_FluidSimulationCPUSolver_DrawToColorBuffer, STATGROUP_NullVisualEffects);
+
+namespace FluidSimulationCPUSolver
+{
+    /** Diffusion scale, must match the constant in FluidSimulationCS.usf */
+    static constexpr float DiffusionScale = 100.0f;
+
+    /** Floats per vector register */
+    static constexpr int32 VectorWidth = 4;
+
+    /** Returns InValue as a 16 bit float would store it */
+    FORCEINLINE float RoundToHalf(const float InValue)
+    {
+        return FFloat16(InValue).GetFloat();
+    }
+
+    /** Returns InValue as an 8 bit unorm would store it */
+    FORCEINLINE float RoundToUNorm8(const float InValue)
+    {
+        return FMath::RoundToFloat(FMath::Clamp(InValue, 0.0f, 1.0f) * 255.0f) / 255.0f;
+    }
+
+    /**
+     * Bilinear footprints of VectorWidth positions in grid cells, cell centers sit at +0.5.
+     * The corner indices are computed once and the corners of any plane are gathered lane by lane into vector registers.
+     * Positions are clamped to the cell centers, same as GetCellsAccurate in FluidSimulationCommon.usf.
+     */
+    struct FBilinearGather
+    {
+        /** Plane index of the (X0, Y0), (X0, Y1), (X1, Y0) and (X1, Y1) corners of every lane */
+        int32 Corners[4][VectorWidth];
+
+        /** Cell coords of the corners */
+        VectorRegister MinX;
+        VectorRegister MinY;
+        VectorRegister MaxX;
+        VectorRegister MaxY;
+
+        /** Weight of the X1 corners */
+        VectorRegister FracX;
+
+        /** Weight of the Y1 corners */
+        VectorRegister FracY;
+
+        FBilinearGather(const VectorRegister& InX, const VectorRegister& InY, const int32 InSimulationGridSize)
+        {
+            const VectorRegister HalfCell = VectorSetFloat1(0.5f);
+            const VectorRegister MaxCell = VectorSetFloat1(InSimulationGridSize - 1.0f);
+            const VectorRegister X = VectorMin(VectorMax(VectorSubtract(InX, HalfCell), VectorZero()), MaxCell);
+            const VectorRegister Y = VectorMin(VectorMax(VectorSubtract(InY, HalfCell), VectorZero()), MaxCell);
+
+            // Positive, truncating is flooring
+            MinX = VectorTruncate(X);
+            MinY = VectorTruncate(Y);
+            MaxX = VectorMin(VectorAdd(MinX, VectorOne()), MaxCell);
+            MaxY = VectorMin(VectorAdd(MinY, VectorOne()), MaxCell);
+            FracX = VectorSubtract(X, MinX);
+            FracY = VectorSubtract(Y, MinY);
+
+            alignas(16) float CellX[2][VectorWidth];
+            alignas(16) float CellY[2][VectorWidth];
+            VectorStoreAligned(MinX, CellX[0]);
+            VectorStoreAligned(MaxX, CellX[1]);
+            VectorStoreAligned(MinY, CellY[0]);
+            VectorStoreAligned(MaxY, CellY[1]);
+
+            for (int32 Lane = 0; Lane < VectorWidth; ++Lane)
+            {
+                Corners[0][Lane] = static_cast<int32>(CellX[0][Lane]) * InSimulationGridSize + static_cast<int32>(CellY[0][Lane]);
+                Corners[1][Lane] = static_cast<int32>(CellX[0][Lane]) * InSimulationGridSize + static_cast<int32>(CellY[1][Lane]);
+                Corners[2][Lane] = static_cast<int32>(CellX[1][Lane]) * InSimulationGridSize + static_cast<int32>(CellY[0][Lane]);
+                Corners[3][Lane] = static_cast<int32>(CellX[1][Lane]) * InSimulationGridSize + static_cast<int32>(CellY[1][Lane]);
+            }
+        }
+
+        /** Returns the cell centers of the corners */
+        void GetCornerPositions(VectorRegister OutX[4], VectorRegister OutY[4]) const
+        {
+            const VectorRegister HalfCell = VectorSetFloat1(0.5f);
+            OutX[0] = OutX[1] = VectorAdd(MinX, HalfCell);
+            OutX[2] = OutX[3] = VectorAdd(MaxX, HalfCell);
+            OutY[0] = OutY[2] = VectorAdd(MinY, HalfCell);
+            OutY[1] = OutY[3] = VectorAdd(MaxY, HalfCell);
+        }
+
+        /** Gathers the 4 corners of every lane from InPlane */
+        void Gather(const float* InPlane, VectorRegister OutCorners[4]) const
+        {
+            alignas(16) float Values[4][VectorWidth];
+
+            for (int32 Corner = 0; Corner < 4; ++Corner)
+            {
+                for (int32 Lane = 0; Lane < VectorWidth; ++Lane)
+                {
+                    Values[Corner][Lane] = InPlane[Corners[Corner][Lane]];
+                }
+
+                OutCorners[Corner] = VectorLoadAligned(Values[Corner]);
+            }
+        }
+
+        /** Blends per corner values, along X then Y like FFluidSimulationCPUSolver::Sample */
+        VectorRegister Blend(const VectorRegister InValues[4]) const
+        {
+            const VectorRegister Bottom = VectorMultiplyAdd(VectorSubtract(InValues[2], InValues[0]), FracX, InValues[0]);
+            const VectorRegister Top = VectorMultiplyAdd(VectorSubtract(InValues[3], InValues[1]), FracX, InValues[1]);
+            return VectorMultiplyAdd(VectorSubtract(Top, Bottom), FracY, Bottom);
+        }
+
+        /** Bilinear sample of InPlane */
+        VectorRegister Sample(const float* InPlane) const
+        {
+            VectorRegister Values[4];
+            Gather(InPlane, Values);
+            return Blend(Values);
+        }
+
+        /** Clamps InValue between the smallest and the largest corner of InPlane */
+        VectorRegister Clamp(const float* InPlane, const VectorRegister& InValue) const
+        {
+            VectorRegister Values[4];
+            Gather(InPlane, Values);
+
+            const VectorRegister MinValue = VectorMin(VectorMin(Values[0], Values[1]), VectorMin(Values[2], Values[3]));
+            const VectorRegister MaxValue = VectorMax(VectorMax(Values[0], Values[1]), VectorMax(Values[2], Values[3]));
+            return VectorMin(VectorMax(InValue, MinValue), MaxValue);
+        }
+    };
+
+    /** Largest and root mean square difference between two planes */
+    static void MeasureError(const FFluidSimulationPlane& InReference, const FFluidSimulationPlane& InPlane, float& OutMaxError, float& OutRMSError)
+    {
+        double SumSquared = 0.0;
+        OutMaxError = 0.0f;
+
+        for (int32 Index = 0; Index < InReference.Num(); ++Index)
+        {
+            const float Error = FMath::Abs(InReference[Index] - InPlane[Index]);
+            OutMaxError = FMath::Max(OutMaxError, Error);
+            SumSquared += static_cast<double>(Error) * Error;
+        }
+
+        OutRMSError = InReference.Num() > 0 ? static_cast<float>(FMath::Sqrt(SumSquared / InReference.Num())) : 0.0f;
+    }
+
+    /** Moves the cells of a plane by -InDelta and zeroes the exposed ones, whole X rows are moved at once */
+    static void ShiftPlane(FFluidSimulationPlane& InOutPlane, const int32 InSimulationGridSize, const FIntPoint& InDelta)
+    {
+        const int32 N = InSimulationGridSize;
+        float* const Data = InOutPlane.GetData();
+
+        if (FMath::Abs(InDelta.X) >= N || FMath::Abs(InDelta.Y) >= N)
+        {
+            FMemory::Memzero(Data, N * N * sizeof(float));
+            return;
+        }
+
+        if (InDelta.X > 0)
+        {
+            FMemory::Memmove(Data, Data + InDelta.X * N, (N - InDelta.X) * N * sizeof(float));
+            FMemory::Memzero(Data + (N - InDelta.X) * N, InDelta.X * N * sizeof(float));
+        }
+        else if (InDelta.X < 0)
+        {
+            FMemory::Memmove(Data - InDelta.X * N, Data, (N + InDelta.X) * N * sizeof(float));
+            FMemory::Memzero(Data, -InDelta.X * N * sizeof(float));
+        }
+
+        if (InDelta.Y != 0)
+        {
+            const int32 Kept = N - FMath::Abs(InDelta.Y);
+
+            for (int32 X = 0; X < N; ++X)
+            {
+                float* const Row = Data + X * N;
+
+                if (InDelta.Y > 0)
+                {
+                    FMemory::Memmove(Row, Row + InDelta.Y, Kept * sizeof(float));
+                    FMemory::Memzero(Row + Kept, InDelta.Y * sizeof(float));
+                }
+                else
+                {
+                    FMemory::Memmove(Row - InDelta.Y, Row, Kept * sizeof(float));
+                    FMemory::Memzero(Row, -InDelta.Y * sizeof(float));
+                }
+            }
+        }
+    }
+}
+
+static FAutoConsoleCommand GFluidSimulationPrecisionReport
+(
+    TEXT("FluidSimulation.PrecisionReport"),
+    TEXT("Runs the CPU solver with every field precision on the same scripted input and logs the error against 32 bit storage. Args: [GridSize=256] [Steps=120]"),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& InArgs)
+    {
+        using namespace FluidSimulationCPUSolver;
+
+        const int32 GridSize = InArgs.Num() > 0 ? FMath::Max(FCString::Atoi(*InArgs[0]), 16) : 256;
+        const int32 NumSteps = InArgs.Num() > 1 ? FMath::Max(FCString::Atoi(*InArgs[1]), 1) : 120;
+        const EFluidSimulationFieldPrecision Precisions[] = { EFluidSimulationFieldPrecision::Full, EFluidSimulationFieldPrecision::Half, EFluidSimulationFieldPrecision::Packed };
+
+        TArray<FFluidSimulationCPUSolver> Solvers;
+        Solvers.SetNum(UE_ARRAY_COUNT(Precisions));
+
+        for (int32 SolverIndex = 0; SolverIndex < Solvers.Num(); ++SolverIndex)
+        {
+            Solvers[SolverIndex].Init(GridSize, FFluidSimulationCPUSettings(), FFluidSimulationProjectionSettings(), FFluidSimulationActivitySettings(), Precisions[SolverIndex]);
+        }
+
+        // A single brush circling the center of the grid
+        const float GridCenter = GridSize * 0.5f;
+        const float OrbitRadius = GridSize * 0.25f;
+        TArray<FFluidSimulationBrush> Brushes;
+        FFluidSimulationBrush& Brush = Brushes.AddDefaulted_GetRef();
+        Brush.Radius = GridSize * 0.05f;
+
+        for (int32 Step = 0; Step < NumSteps; ++Step)
+        {
+            const float Angle = Step * 0.1f;
+            const float PreviousAngle = FMath::Max(Step - 1, 0) * 0.1f;
+            Brush.Center = FVector2D(GridCenter + OrbitRadius * FMath::Cos(Angle), GridCenter + OrbitRadius * FMath::Sin(Angle));
+            Brush.PreviousCenter = FVector2D(GridCenter + OrbitRadius * FMath::Cos(PreviousAngle), GridCenter + OrbitRadius * FMath::Sin(PreviousAngle));
+            Brush.Velocity = FVector2D(-FMath::Sin(Angle), FMath::Cos(Angle));
+
+            for (FFluidSimulationCPUSolver& Solver : Solvers)
+            {
+                Solver.Step(Brushes, 0.0f, 0.0f, 1.0f / 60.0f);
+            }
+        }
+
+        const FFluidSimulationPlanes& Reference = Solvers[0].GetCurrentPlanes();
+
+        for (int32 SolverIndex = 1; SolverIndex < Solvers.Num(); ++SolverIndex)
+        {
+            const FFluidSimulationPlanes& Planes = Solvers[SolverIndex].GetCurrentPlanes();
+
+            float MaxVelocityXError = 0.0f, RMSVelocityXError = 0.0f;
+            float MaxVelocityYError = 0.0f, RMSVelocityYError = 0.0f;
+            float MaxDensityError = 0.0f, RMSDensityError = 0.0f;
+            MeasureError(Reference.VelocityX, Planes.VelocityX, MaxVelocityXError, RMSVelocityXError);
+            MeasureError(Reference.VelocityY, Planes.VelocityY, MaxVelocityYError, RMSVelocityYError);
+            MeasureError(Reference.Density, Planes.Density, MaxDensityError, RMSDensityError);
+
+            UE_LOG(LogNullVisualEffects, Log, TEXT("%s vs Full, %dx%d after %d steps: velocity max %g rms %g, density max %g rms %g"),
+                *StaticEnum<EFluidSimulationFieldPrecision>()->GetNameStringByValue(static_cast<int64>(Precisions[SolverIndex])), GridSize, GridSize, NumSteps,
+                FMath::Max(MaxVelocityXError, MaxVelocityYError), FMath::Max(RMSVelocityXError, RMSVelocityYError), MaxDensityError, RMSDensityError);
+        }
+    })
+);
+
+FFluidSimulationCPUSolver::FFluidSimulationCPUSolver()
+    : SimulationGridSize(0)
+    , Solver(EFluidSimulationSolver::NavierStokes)
+    , Precision(EFluidSimulationFieldPrecision::Full)
+    , NumTilesPerSide(0)
+{
+}
+
+FFluidSimulationCPUSolver::~FFluidSimulationCPUSolver()
+{
+}
+
+void FFluidSimulationCPUSolver::Init(const int32 InSimulationGridSize, const FFluidSimulationCPUSettings& InSettings, const FFluidSimulationProjectionSettings& InProjectionSettings, const FFluidSimulationActivitySettings& InActivitySettings, const EFluidSimulationFieldPrecision InPrecision, const EFluidSimulationSolver InSolver, const FFluidSimulationShallowWaterSettings& InShallowWaterSettings, const FFluidSimulationAdvectionSettings& InAdvectionSettings)
+{
+    SimulationGridSize = FMath::Max(InSimulationGridSize, 0);
+    Settings = InSettings;
+    Solver = InSolver;
+    ShallowWaterSettings = InShallowWaterSettings;
+    AdvectionSettings = InAdvectionSettings;
+    ProjectionSettings = InProjectionSettings;
+    ActivitySettings = InActivitySettings;
+    Precision = InPrecision;
+    Settings.TileSize = ActivitySettings.bEnabled ? ActivitySettings.GetTileSize() : FMath::Max(Settings.TileSize, 8);
+    Stats = FFluidSimulationSolverStats();
+
+    const int32 NumCells = SimulationGridSize * SimulationGridSize;
+    Current.Init(NumCells);
+    Previous.Init(NumCells);
+    Solved.Init(NumCells);
+    ZeroRow.SetNumZeroed(SimulationGridSize);
+    Multigrid.Init(SimulationGridSize, Settings.bMultithreaded);
+
+    Tiles.Reset();
+    for (int32 X = 0; X < SimulationGridSize; X += Settings.TileSize)
+    {
+        for (int32 Y = 0; Y < SimulationGridSize; Y += Settings.TileSize)
+        {
+            Tiles.Emplace(X, Y, FMath::Min(X + Settings.TileSize, SimulationGridSize), FMath::Min(Y + Settings.TileSize, SimulationGridSize));
+        }
+    }
+
+    NumTilesPerSide = FMath::DivideAndRoundUp(SimulationGridSize, Settings.TileSize);
+    TileActivity.SetNumZeroed(Tiles.Num());
+    TileListed.SetNumZeroed(Tiles.Num());
+
+    // Without activity tracking every tile stays in the list
+    ActiveTiles.Reset();
+    if (!ActivitySettings.bEnabled)
+    {
+        for (int32 TileIndex = 0; TileIndex < Tiles.Num(); ++TileIndex)
+        {
+            ActiveTiles.Add(TileIndex);
+        }
+    }
+}
+
+void FFluidSimulationCPUSolver::Release()
+{
+    SimulationGridSize = 0;
+    Current.Release();
+    Previous.Release();
+    Solved.Release();
+    ZeroRow.Empty();
+    Multigrid.Release();
+    Tiles.Empty();
+    NumTilesPerSide = 0;
+    TileActivity.Empty();
+    TileListed.Empty();
+    ActiveTiles.Empty();
+}
+
+SIZE_T FFluidSimulationCPUSolver::GetAllocatedSize() const
+{
+    return Current.GetAllocatedSize() + Previous.GetAllocatedSize() + Solved.GetAllocatedSize() + ZeroRow.GetAllocatedSize() + Multigrid.GetAllocatedSize()
+        + Tiles.GetAllocatedSize() + TileActivity.GetAllocatedSize() + TileListed.GetAllocatedSize() + ActiveTiles.GetAllocatedSize();
+}
+
+bool FFluidSimulationCPUSolver::SetState(const FFluidSimulationPlanes& InPlanes)
+{
+    const int32 NumCells = SimulationGridSize * SimulationGridSize;
+
+    if (!IsInit() || InPlanes.VelocityX.Num() != NumCells || InPlanes.VelocityY.Num() != NumCells || InPlanes.Density.Num() != NumCells)
+    {
+        return false;
+    }
+
+    Current = InPlanes;
+    Previous = InPlanes;
+    Solved = InPlanes;
+
+    // Listed tiles that turn out to be still are cleared by the next UpdateActiveTiles
+    FMemory::Memset(TileActivity.GetData(), 1, TileActivity.Num());
+    FMemory::Memset(TileListed.GetData(), 1, TileListed.Num());
+    return true;
+}
+
+void FFluidSimulationCPUSolver::Shift(const FIntPoint& InDelta)
+{
+    if (!IsInit() || InDelta == FIntPoint::ZeroValue)
+    {
+        return;
+    }
+
+    for (FFluidSimulationPlanes* const Planes : { &Current, &Previous, &Solved })
+    {
+        FluidSimulationCPUSolver::ShiftPlane(Planes->VelocityX, SimulationGridSize, InDelta);
+        FluidSimulationCPUSolver::ShiftPlane(Planes->VelocityY, SimulationGridSize, InDelta);
+        FluidSimulationCPUSolver::ShiftPlane(Planes->Density, SimulationGridSize, InDelta);
+    }
+
+    // The tile flags describe the old cells, everything is solved and measured again
+    FMemory::Memset(TileActivity.GetData(), 1, TileActivity.Num());
+    FMemory::Memset(TileListed.GetData(), 1, TileListed.Num());
+}
+
+void FFluidSimulationCPUSolver::Step(const TArray<FFluidSimulationBrush>& InBrushes, const float InFluidDifusion, const float InFluidViscosity, const float InDeltaTime)
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_Step);
+
+    if (IsInit())
+    {
+        const double StartTime = FPlatformTime::Seconds();
+
+        // Every cell of the current state is rewritten by UpdateFluid, so a swap replaces the GPU buffer copy
+        Swap(Current, Previous);
+
+        // The brushes wake their tiles up before the active list is built, and are splatted once the fluid moved, same as the tile load of the compute shader
+        WakeInputTiles(InBrushes);
+        UpdateActiveTiles();
+        KeepSolvedState();
+        const double ActiveTilesTime = FPlatformTime::Seconds();
+
+        if (Solver == EFluidSimulationSolver::NavierStokes && AdvectionSettings.IsEnabled())
+        {
+            Advect(InDeltaTime);
+        }
+        const double AdvectTime = FPlatformTime::Seconds();
+
+        AddInputData(InBrushes);
+        const double AddInputTime = FPlatformTime::Seconds();
+
+        if (Solver == EFluidSimulationSolver::ShallowWater)
+        {
+            UpdateShallowWater(InDeltaTime);
+        }
+        else
+        {
+            UpdateFluid(InFluidDifusion, InFluidViscosity, InDeltaTime);
+        }
+        const double UpdateFluidTime = FPlatformTime::Seconds();
+
+        Project();
+        QuantizeState();
+        MeasureActivity();
+        const double EndTime = FPlatformTime::Seconds();
+
+        const double StepSeconds = EndTime - StartTime;
+        Stats.AddInputMs = static_cast<float>(((ActiveTilesTime - StartTime) + (AddInputTime - AdvectTime)) * 1000.0);
+        Stats.UpdateFluidMs = static_cast<float>(((UpdateFluidTime - AddInputTime) + (AdvectTime - ActiveTilesTime)) * 1000.0);
+        Stats.ProjectMs = static_cast<float>((EndTime - UpdateFluidTime) * 1000.0);
+        Stats.StepMs = static_cast<float>(StepSeconds * 1000.0);
+        Stats.NumTiles = Tiles.Num();
+        Stats.NumThreads = Settings.bMultithreaded ? FTaskGraphInterface::Get().GetNumWorkerThreads() + 1 : 1;
+        Stats.NumActiveTiles = ActiveTiles.Num();
+        Stats.NumActiveCells = 0;
+
+        for (const int32 TileIndex : ActiveTiles)
+        {
+            Stats.NumActiveCells += Tiles[TileIndex].Area();
+        }
+
+        // Skipped tiles cost nothing, only the solved cells count towards the throughput
+        Stats.CellsPerSecond = StepSeconds > 0.0 ? static_cast<float>(Stats.NumActiveCells / StepSeconds) : 0.0f;
+    }
+}
+
+void FFluidSimulationCPUSolver::ForEachTile(TFunctionRef<void(const FIntRect&)> InFunction) const
+{
+    ParallelFor(Tiles.Num(), [&](const int32 InTileIndex)
+    {
+        InFunction(Tiles[InTileIndex]);
+    }, !Settings.bMultithreaded);
+}
+
+void FFluidSimulationCPUSolver::ForEachActiveTile(TFunctionRef<void(const FIntRect&)> InFunction) const
+{
+    ParallelFor(ActiveTiles.Num(), [&](const int32 InListIndex)
+    {
+        InFunction(Tiles[ActiveTiles[InListIndex]]);
+    }, !Settings.bMultithreaded);
+}
+
+void FFluidSimulationCPUSolver::UpdateActiveTiles()
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_UpdateActiveTiles);
+
+    if (!ActivitySettings.bEnabled)
+    {
+        return;
+    }
+
+    ActiveTiles.Reset();
+
+    for (int32 TileX = 0; TileX < NumTilesPerSide; ++TileX)
+    {
+        for (int32 TileY = 0; TileY < NumTilesPerSide; ++TileY)
+        {
+            // Fluid spreads one cell per iteration at most, so a tile next to an active one can wake up
+            bool bActive = false;
+            for (int32 NeighbourX = FMath::Max(TileX - 1, 0); NeighbourX <= FMath::Min(TileX + 1, NumTilesPerSide - 1) && !bActive; ++NeighbourX)
+            {
+                for (int32 NeighbourY = FMath::Max(TileY - 1, 0); NeighbourY <= FMath::Min(TileY + 1, NumTilesPerSide - 1) && !bActive; ++NeighbourY)
+                {
+                    bActive = TileActivity[NeighbourX * NumTilesPerSide + NeighbourY] != 0;
+                }
+            }
+
+            const int32 TileIndex = TileX * NumTilesPerSide + TileY;
+            if (bActive)
+            {
+                ActiveTiles.Add(TileIndex);
+            }
+            else if (TileListed[TileIndex] != 0)
+            {
+                // Below the threshold is at rest, the stale state of the skipped tile must not leak into the neighbours
+                ClearTile(Tiles[TileIndex]);
+            }
+
+            TileListed[TileIndex] = bActive ? 1 : 0;
+        }
+    }
+}
+
+void FFluidSimulationCPUSolver::MeasureActivity()
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_MeasureActivity);
+
+    if (!ActivitySettings.bEnabled)
+    {
+        return;
+    }
+
+    const float Threshold = ActivitySettings.Threshold;
+
+    ParallelFor(ActiveTiles.Num(), [&](const int32 InListIndex)
+    {
+        const int32 TileIndex = ActiveTiles[InListIndex];
+        const FIntRect& Tile = Tiles[TileIndex];
+
+        bool bActive = false;
+        for (int32 X = Tile.Min.X; X < Tile.Max.X && !bActive; ++X)
+        {
+            for (int32 Y = Tile.Min.Y; Y < Tile.Max.Y; ++Y)
+            {
+                const int32 Index = X * SimulationGridSize + Y;
+                if (FMath::Abs(Current.VelocityX[Index]) > Threshold || FMath::Abs(Current.VelocityY[Index]) > Threshold || FMath::Abs(Current.Density[Index]) > Threshold)
+                {
+                    bActive = true;
+                    break;
+                }
+            }
+        }
+
+        TileActivity[TileIndex] = bActive ? 1 : 0;
+    }, !Settings.bMultithreaded);
+}
+
+void FFluidSimulationCPUSolver::QuantizeState()
+{
+    using namespace FluidSimulationCPUSolver;
+
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_QuantizeState);
+
+    if (Precision == EFluidSimulationFieldPrecision::Full)
+    {
+        return;
+    }
+
+    // Same rounding the GPU applies when the solver writes its fp32 registers to the fields
+    ForEachActiveTile([&](const FIntRect& InTile)
+    {
+        for (int32 X = InTile.Min.X; X < InTile.Max.X; ++X)
+        {
+            for (int32 Y = InTile.Min.Y; Y < InTile.Max.Y; ++Y)
+            {
+                const int32 Index = X * SimulationGridSize + Y;
+                Current.VelocityX[Index] = RoundToHalf(Current.VelocityX[Index]);
+                Current.VelocityY[Index] = RoundToHalf(Current.VelocityY[Index]);
+                Current.Density[Index] = Precision == EFluidSimulationFieldPrecision::Packed ? RoundToUNorm8(Current.Density[Index]) : RoundToHalf(Current.Density[Index]);
+            }
+        }
+    });
+}
+
+void FFluidSimulationCPUSolver::ClearTile(const FIntRect& InTile)
+{
+    const int32 Count = InTile.Max.Y - InTile.Min.Y;
+
+    for (int32 Row = InTile.Min.X; Row < InTile.Max.X; ++Row)
+    {
+        const int32 Offset = Row * SimulationGridSize + InTile.Min.Y;
+        for (FFluidSimulationPlanes* Planes : { &Current, &Previous, &Solved })
+        {
+            FMemory::Memzero(Planes->VelocityX.GetData() + Offset, Count * sizeof(float));
+            FMemory::Memzero(Planes->VelocityY.GetData() + Offset, Count * sizeof(float));
+            FMemory::Memzero(Planes->Density.GetData() + Offset, Count * sizeof(float));
+        }
+    }
+}
+
+void FFluidSimulationCPUSolver::KeepSolvedState()
+{
+    // The other tiles are cleared in every state or untouched since, Solved already matches them
+    ForEachActiveTile([&](const FIntRect& InTile)
+    {
+        const int32 Count = InTile.Max.Y - InTile.Min.Y;
+
+        for (int32 Row = InTile.Min.X; Row < InTile.Max.X; ++Row)
+        {
+            const int32 Offset = Row * SimulationGridSize + InTile.Min.Y;
+            FMemory::Memcpy(Solved.VelocityX.GetData() + Offset, Previous.VelocityX.GetData() + Offset, Count * sizeof(float));
+            FMemory::Memcpy(Solved.VelocityY.GetData() + Offset, Previous.VelocityY.GetData() + Offset, Count * sizeof(float));
+            FMemory::Memcpy(Solved.Density.GetData() + Offset, Previous.Density.GetData() + Offset, Count * sizeof(float));
+        }
+    });
+}
+
+void FFluidSimulationCPUSolver::WakeInputTiles(const TArray<FFluidSimulationBrush>& InBrushes)
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_AddInputData);
+
+    if (!ActivitySettings.bEnabled)
+    {
+        return;
+    }
+
+    for (const FFluidSimulationBrush& Brush : InBrushes)
+    {
+        const FIntRect Bounds = Brush.GetCellBounds(SimulationGridSize);
+
+        // Wakes the touched tiles up, UpdateActiveTiles dilates them
+        if (Bounds.Area() > 0)
+        {
+            for (int32 TileX = Bounds.Min.X / Settings.TileSize; TileX <= (Bounds.Max.X - 1) / Settings.TileSize; ++TileX)
+            {
+                for (int32 TileY = Bounds.Min.Y / Settings.TileSize; TileY <= (Bounds.Max.Y - 1) / Settings.TileSize; ++TileY)
+                {
+                    TileActivity[TileX * NumTilesPerSide + TileY] = 1;
+                }
+            }
+        }
+    }
+}
+
+void FFluidSimulationCPUSolver::AddInputData(const TArray<FFluidSimulationBrush>& InBrushes)
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_AddInputData);
+
+    if (InBrushes.Num() == 0)
+    {
+        return;
+    }
+
+    TArray<FIntRect> BrushBounds;
+    BrushBounds.Reserve(InBrushes.Num());
+
+    for (const FFluidSimulationBrush& Brush : InBrushes)
+    {
+        BrushBounds.Add(Brush.GetCellBounds(SimulationGridSize));
+    }
+
+    const bool bShallowWater = Solver == EFluidSimulationSolver::ShallowWater;
+
+    // Same as the solver shader, brushes are culled per tile and blended by weight so their order does not matter
+    ForEachTile([&](const FIntRect& InTile)
+    {
+        TArray<int32, TInlineAllocator<16>> TileBrushes;
+        for (int32 BrushIndex = 0; BrushIndex < InBrushes.Num(); ++BrushIndex)
+        {
+            if (BrushBounds[BrushIndex].Intersect(InTile))
+            {
+                TileBrushes.Add(BrushIndex);
+            }
+        }
+
+        if (TileBrushes.Num() == 0)
+        {
+            return;
+        }
+
+        for (int32 X = InTile.Min.X; X < InTile.Max.X; ++X)
+        {
+            for (int32 Y = InTile.Min.Y; Y < InTile.Max.Y; ++Y)
+            {
+                const FVector2D CellCenter(X + 0.5f, Y + 0.5f);
+
+                FVector2D WeightedVelocity = FVector2D::ZeroVector;
+                float WeightSum = 0.0f;
+                float MaxWeight = 0.0f;
+
+                for (const int32 BrushIndex : TileBrushes)
+                {
+                    const FFluidSimulationBrush& Brush = InBrushes[BrushIndex];
+                    const float Weight = Brush.GetWeight(CellCenter);
+
+                    // Shallow water brushes press the height down and leave its vertical speed alone
+                    WeightedVelocity += bShallowWater ? FVector2D(-ShallowWaterSettings.BrushDepth * Brush.Strength * Weight, 0.0f) : Brush.Velocity * Brush.Strength * Weight;
+                    WeightSum += Weight;
+                    MaxWeight = FMath::Max(MaxWeight, Weight);
+                }
+
+                if (WeightSum > 0.0f && bShallowWater)
+                {
+                    const int32 Index = X * SimulationGridSize + Y;
+                    Previous.VelocityX[Index] = FMath::Lerp(Previous.VelocityX[Index], WeightedVelocity.X / WeightSum, MaxWeight);
+                }
+                else if (WeightSum > 0.0f)
+                {
+                    const int32 Index = X * SimulationGridSize + Y;
+                    const FVector2D Velocity = FMath::Lerp(FVector2D(Previous.VelocityX[Index], Previous.VelocityY[Index]), WeightedVelocity / WeightSum, MaxWeight);
+                    Previous.VelocityX[Index] = Velocity.X;
+                    Previous.VelocityY[Index] = Velocity.Y;
+                }
+            }
+        }
+    });
+}
+
+void FFluidSimulationCPUSolver::Advect(const float InDeltaTime)
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_Advect);
+
+    const float CellsPerVelocity = AdvectionSettings.GetCellsPerVelocity(InDeltaTime);
+    const float MaxDistance = AdvectionSettings.GetMaxDistance();
+
+    ForEachActiveTile([&](const FIntRect& InTile)
+    {
+        for (int32 Row = InTile.Min.X; Row < InTile.Max.X; ++Row)
+        {
+            AdvectRow(Row, InTile.Min.Y, InTile.Max.Y, CellsPerVelocity, MaxDistance);
+        }
+    });
+
+    // Listed tiles hold the advected state in the current one and the others are zero in both, a swap hands it to the brushes and the diffusion
+    Swap(Current, Previous);
+}
+
+void FFluidSimulationCPUSolver::AdvectRow(const int32 InRow, const int32 InBegin, const int32 InEnd, const float InCellsPerVelocity, const float InMaxDistance)
+{
+    using namespace FluidSimulationCPUSolver;
+
+    const int32 N = SimulationGridSize;
+    const int32 RowOffset = InRow * N;
+    const float* const VelocityX = Previous.VelocityX.GetData();
+    const float* const VelocityY = Previous.VelocityY.GetData();
+    const float* const Density = Previous.Density.GetData();
+    const bool bMacCormack = AdvectionSettings.Scheme == EFluidSimulationAdvection::MacCormack;
+
+    const VectorRegister CellsPerVelocityVector = VectorSetFloat1(InCellsPerVelocity);
+    const VectorRegister MaxDistanceVector = VectorSetFloat1(InMaxDistance);
+    const VectorRegister MinPositionVector = VectorSetFloat1(0.5f);
+    const VectorRegister MaxPositionVector = VectorSetFloat1(N - 0.5f);
+    const VectorRegister DistanceBiasVector = VectorSetFloat1(1e-12f);
+    const VectorRegister HalfVector = VectorSetFloat1(0.5f);
+
+    // Same as TraceBack in FluidSimulationCS.usf, the trace is scaled by min(1, MaxDistance / Distance) and the bias keeps still cells finite
+    auto TraceBack = [&](const VectorRegister& InX, const VectorRegister& InY, const VectorRegister& InVelocityX, const VectorRegister& InVelocityY, VectorRegister& OutX, VectorRegister& OutY)
+    {
+        const VectorRegister DisplacementX = VectorMultiply(InVelocityX, CellsPerVelocityVector);
+        const VectorRegister DisplacementY = VectorMultiply(InVelocityY, CellsPerVelocityVector);
+        const VectorRegister DistanceSquared = VectorMultiplyAdd(DisplacementX, DisplacementX, VectorMultiply(DisplacementY, DisplacementY));
+        const VectorRegister Scale = VectorMin(VectorOne(), VectorMultiply(MaxDistanceVector, VectorReciprocalSqrtAccurate(VectorAdd(DistanceSquared, DistanceBiasVector))));
+
+        OutX = VectorMin(VectorMax(VectorSubtract(InX, VectorMultiply(DisplacementX, Scale)), MinPositionVector), MaxPositionVector);
+        OutY = VectorMin(VectorMax(VectorSubtract(InY, VectorMultiply(DisplacementY, Scale)), MinPositionVector), MaxPositionVector);
+    };
+
+    // Lanes past the end of the span repeat its last cell and are not stored
+    int32 NumLanes = VectorWidth;
+
+    auto LoadLanes = [&](const float* InPlane, const int32 InY)
+    {
+        if (NumLanes == VectorWidth)
+        {
+            return VectorLoad(InPlane + RowOffset + InY);
+        }
+
+        alignas(16) float Values[VectorWidth];
+        for (int32 Lane = 0; Lane < VectorWidth; ++Lane)
+        {
+            Values[Lane] = InPlane[RowOffset + InY + FMath::Min(Lane, NumLanes - 1)];
+        }
+        return VectorLoadAligned(Values);
+    };
+
+    auto StoreLanes = [&](const VectorRegister& InValue, float* OutPlane, const int32 InY)
+    {
+        if (NumLanes == VectorWidth)
+        {
+            VectorStore(InValue, OutPlane + RowOffset + InY);
+            return;
+        }
+
+        alignas(16) float Values[VectorWidth];
+        VectorStoreAligned(InValue, Values);
+        FMemory::Memcpy(OutPlane + RowOffset + InY, Values, NumLanes * sizeof(float));
+    };
+
+    const VectorRegister PositionX = VectorSetFloat1(InRow + 0.5f);
+
+    for (int32 Y = InBegin; Y < InEnd; Y += VectorWidth)
+    {
+        NumLanes = FMath::Min(InEnd - Y, VectorWidth);
+
+        const VectorRegister PositionY = VectorSet(Y + 0.5f, Y + 1.5f, Y + 2.5f, Y + 3.5f);
+        const VectorRegister StateX = LoadLanes(VelocityX, Y);
+        const VectorRegister StateY = LoadLanes(VelocityY, Y);
+
+        VectorRegister SourceX, SourceY;
+        TraceBack(PositionX, PositionY, StateX, StateY, SourceX, SourceY);
+        const FBilinearGather Source(SourceX, SourceY, N);
+
+        VectorRegister AdvectedX = Source.Sample(VelocityX);
+        VectorRegister AdvectedY = Source.Sample(VelocityY);
+        VectorRegister AdvectedDensity = Source.Sample(Density);
+
+        if (bMacCormack)
+        {
+            // Same round trip as Advect in FluidSimulationCS.usf, the advected state at the forward trace is blended from the 4 cells around it
+            VectorRegister DestinationX, DestinationY;
+            TraceBack(PositionX, PositionY, VectorNegate(StateX), VectorNegate(StateY), DestinationX, DestinationY);
+            const FBilinearGather Destination(DestinationX, DestinationY, N);
+
+            VectorRegister CornerX[4], CornerY[4], CornerVelocityX[4], CornerVelocityY[4];
+            Destination.GetCornerPositions(CornerX, CornerY);
+            Destination.Gather(VelocityX, CornerVelocityX);
+            Destination.Gather(VelocityY, CornerVelocityY);
+
+            VectorRegister RoundTripX[4], RoundTripY[4], RoundTripDensity[4];
+            for (int32 Corner = 0; Corner < 4; ++Corner)
+            {
+                VectorRegister ReturnX, ReturnY;
+                TraceBack(CornerX[Corner], CornerY[Corner], CornerVelocityX[Corner], CornerVelocityY[Corner], ReturnX, ReturnY);
+                const FBilinearGather Return(ReturnX, ReturnY, N);
+
+                RoundTripX[Corner] = Return.Sample(VelocityX);
+                RoundTripY[Corner] = Return.Sample(VelocityY);
+                RoundTripDensity[Corner] = Return.Sample(Density);
+            }
+
+            // Half the round trip error corrects the first trace, clamped to the corners it blended
+            const VectorRegister StateDensity = LoadLanes(Density, Y);
+            AdvectedX = Source.Clamp(VelocityX, VectorMultiplyAdd(VectorSubtract(StateX, Destination.Blend(RoundTripX)), HalfVector, AdvectedX));
+            AdvectedY = Source.Clamp(VelocityY, VectorMultiplyAdd(VectorSubtract(StateY, Destination.Blend(RoundTripY)), HalfVector, AdvectedY));
+            AdvectedDensity = Source.Clamp(Density, VectorMultiplyAdd(VectorSubtract(StateDensity, Destination.Blend(RoundTripDensity)), HalfVector, AdvectedDensity));
+        }
+
+        StoreLanes(AdvectedX, Current.VelocityX.GetData(), Y);
+        StoreLanes(AdvectedY, Current.VelocityY.GetData(), Y);
+        StoreLanes(AdvectedDensity, Current.Density.GetData(), Y);
+    }
+}
+
+void FFluidSimulationCPUSolver::UpdateFluid(const float InFluidDifusion, const float InFluidViscosity, const float InDeltaTime)
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_UpdateFluid);
+
+    const float DiffusionRate = InDeltaTime * FluidSimulationCPUSolver::DiffusionScale * SimulationGridSize * SimulationGridSize;
+
+    ForEachActiveTile([&](const FIntRect& InTile)
+    {
+        const int32 Count = InTile.Max.Y - InTile.Min.Y;
+
+        for (int32 Row = InTile.Min.X; Row < InTile.Max.X; ++Row)
+        {
+            DiffuseRow(Row, InTile.Min.Y, InTile.Max.Y, DiffusionRate, Previous.VelocityX, Current.VelocityX);
+            DiffuseRow(Row, InTile.Min.Y, InTile.Max.Y, DiffusionRate, Previous.VelocityY, Current.VelocityY);
+
+            // Density is carried over untouched, same as the compute shader
+            const int32 Offset = Row * SimulationGridSize + InTile.Min.Y;
+            FMemory::Memcpy(Current.Density.GetData() + Offset, Previous.Density.GetData() + Offset, Count * sizeof(float));
+        }
+    });
+}
+
+void FFluidSimulationCPUSolver::UpdateShallowWater(const float InDeltaTime)
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_UpdateShallowWater);
+
+    // Same coefficients as UFluidSimulationRender::UpdateFluid_RenderThread
+    const float Stiffness = InDeltaTime > 0.0f ? FMath::Square(ShallowWaterSettings.GetCourantNumber(InDeltaTime)) / InDeltaTime : 0.0f;
+    const float DampingFactor = ShallowWaterSettings.GetDampingFactor(InDeltaTime);
+
+    ForEachActiveTile([&](const FIntRect& InTile)
+    {
+        const int32 Count = InTile.Max.Y - InTile.Min.Y;
+
+        for (int32 Row = InTile.Min.X; Row < InTile.Max.X; ++Row)
+        {
+            ShallowWaterRow(Row, InTile.Min.Y, InTile.Max.Y, Stiffness, DampingFactor, InDeltaTime);
+
+            // Density is carried over untouched, same as the compute shader
+            const int32 Offset = Row * SimulationGridSize + InTile.Min.Y;
+            FMemory::Memcpy(Current.Density.GetData() + Offset, Previous.Density.GetData() + Offset, Count * sizeof(float));
+        }
+    });
+}
+
+void FFluidSimulationCPUSolver::ShallowWaterRow(const int32 InRow, const int32 InBegin, const int32 InEnd, const float InStiffness, const float InDampingFactor, const float InDeltaTime)
+{
+    using namespace FluidSimulationCPUSolver;
+
+    const int32 N = SimulationGridSize;
+    const float* const Height = GetRow(Previous.VelocityX, InRow);
+    const float* const Left = GetRow(Previous.VelocityX, InRow - 1);
+    const float* const Right = GetRow(Previous.VelocityX, InRow + 1);
+    const float* const Speed = Previous.VelocityY.GetData() + InRow * N;
+    float* const OutHeight = Current.VelocityX.GetData() + InRow * N;
+    float* const OutSpeed = Current.VelocityY.GetData() + InRow * N;
+
+    // Symplectic Euler, same as FluidSimulationCS.usf, the speed is updated first and moves the height
+    auto IntegrateCell = [&](const int32 Y)
+    {
+        const float Upper = (Y + 1 < N) ? Height[Y + 1] : 0.0f;
+        const float Bottom = (Y > 0) ? Height[Y - 1] : 0.0f;
+        const float Laplacian = Upper + Bottom + Left[Y] + Right[Y] - 4.0f * Height[Y];
+        const float VerticalSpeed = (Speed[Y] + InStiffness * Laplacian) * InDampingFactor;
+
+        OutSpeed[Y] = VerticalSpeed;
+        OutHeight[Y] = Height[Y] + VerticalSpeed * InDeltaTime;
+    };
+
+    // First and last cells of the row have an out of grid neighbour, the rest is vectorized
+    int32 Y = InBegin;
+    if (Y == 0)
+    {
+        IntegrateCell(Y++);
+    }
+
+    const VectorRegister StiffnessVector = VectorSetFloat1(InStiffness);
+    const VectorRegister DampingVector = VectorSetFloat1(InDampingFactor);
+    const VectorRegister DeltaTimeVector = VectorSetFloat1(InDeltaTime);
+    const VectorRegister FourVector = VectorSetFloat1(4.0f);
+    const int32 VectorEnd = FMath::Min(InEnd, N - 1);
+
+    for (; Y + VectorWidth <= VectorEnd; Y += VectorWidth)
+    {
+        const VectorRegister Center = VectorLoad(Height + Y);
+
+        VectorRegister Neighbours = VectorAdd(VectorLoad(Height + Y + 1), VectorLoad(Height + Y - 1));
+        Neighbours = VectorAdd(Neighbours, VectorAdd(VectorLoad(Left + Y), VectorLoad(Right + Y)));
+
+        const VectorRegister Laplacian = VectorSubtract(Neighbours, VectorMultiply(FourVector, Center));
+        const VectorRegister VerticalSpeed = VectorMultiply(VectorMultiplyAdd(StiffnessVector, Laplacian, VectorLoad(Speed + Y)), DampingVector);
+
+        VectorStore(VerticalSpeed, OutSpeed + Y);
+        VectorStore(VectorMultiplyAdd(VerticalSpeed, DeltaTimeVector, Center), OutHeight + Y);
+    }
+
+    for (; Y < InEnd; ++Y)
+    {
+        IntegrateCell(Y);
+    }
+}
+
+void FFluidSimulationCPUSolver::Project()
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_Project);
+
+    Stats.NumPressureCycles = 0;
+    Stats.PressureResidual = 0.0f;
+
+    // Nothing moves when no tile is active, the pressure of the last solve is kept as the warm start. The heightfield has no pressure to solve
+    if (ProjectionSettings.bEnabled && Solver == EFluidSimulationSolver::NavierStokes && ActiveTiles.Num() > 0)
+    {
+        // Only the listed tiles are projected, the others hold no fluid and nothing would measure or clear what the gradient left there
+        const TArrayView<const uint8> Listed = ActivitySettings.bEnabled ? TArrayView<const uint8>(TileListed) : TArrayView<const uint8>();
+        Stats.NumPressureCycles = Multigrid.Project(ProjectionSettings, Current.VelocityX, Current.VelocityY, Stats.PressureResidual, Listed, Settings.TileSize);
+    }
+}
+
+void FFluidSimulationCPUSolver::DiffuseRow(const int32 InRow, const int32 InBegin, const int32 InEnd, const float InDiffusionRate, const FFluidSimulationPlane& InSource, FFluidSimulationPlane& OutDestination) const
+{
+    using namespace FluidSimulationCPUSolver;
+
+    const int32 N = SimulationGridSize;
+    const float* const Center = GetRow(InSource, InRow);
+    const float* const Left = GetRow(InSource, InRow - 1);
+    const float* const Right = GetRow(InSource, InRow + 1);
+    float* const Destination = OutDestination.GetData() + InRow * N;
+
+    const float Denominator = 1.0f + 4.0f * InDiffusionRate;
+
+    auto DiffuseCell = [&](const int32 Y)
+    {
+        const float Upper = (Y + 1 < N) ? Center[Y + 1] : 0.0f;
+        const float Bottom = (Y > 0) ? Center[Y - 1] : 0.0f;
+        const float Neighbours = Upper + Bottom + Left[Y] + Right[Y];
+
+        Destination[Y] = (Center[Y] + InDiffusionRate * Neighbours) / Denominator;
+    };
+
+    // First and last cells of the row have an out of grid neighbour, the rest is vectorized
+    int32 Y = InBegin;
+    if (Y == 0)
+    {
+        DiffuseCell(Y++);
+    }
+
+    const VectorRegister RateVector = VectorSetFloat1(InDiffusionRate);
+    const VectorRegister DenominatorVector = VectorSetFloat1(Denominator);
+    const int32 VectorEnd = FMath::Min(InEnd, N - 1);
+
+    for (; Y + VectorWidth <= VectorEnd; Y += VectorWidth)
+    {
+        VectorRegister Neighbours = VectorAdd(VectorLoad(Center + Y + 1), VectorLoad(Center + Y - 1));
+        Neighbours = VectorAdd(Neighbours, VectorAdd(VectorLoad(Left + Y), VectorLoad(Right + Y)));
+
+        VectorStore(VectorDivide(VectorMultiplyAdd(RateVector, Neighbours, VectorLoad(Center + Y)), DenominatorVector), Destination + Y);
+    }
+
+    for (; Y < InEnd; ++Y)
+    {
+        DiffuseCell(Y);
+    }
+}
+
+const float* FFluidSimulationCPUSolver::GetRow(const FFluidSimulationPlane& InPlane, const int32 InRow) const
+{
+    return (InRow >= 0 && InRow < SimulationGridSize) ? InPlane.GetData() + InRow * SimulationGridSize : ZeroRow.GetData();
+}
+
+bool FFluidSimulationCPUSolver::Sample(const FVector2D& InCoords, FVector2D& OutVelocity, float& OutDensity) const
+{
+    if (!IsInit())
+    {
+        return false;
+    }
+
+    const int32 MaxCell = SimulationGridSize - 1;
+    const float X = FMath::Clamp(InCoords.X, 0.0f, static_cast<float>(MaxCell));
+    const float Y = FMath::Clamp(InCoords.Y, 0.0f, static_cast<float>(MaxCell));
+
+    const int32 X0 = FMath::FloorToInt(X);
+    const int32 Y0 = FMath::FloorToInt(Y);
+    const int32 X1 = FMath::Min(X0 + 1, MaxCell);
+    const int32 Y1 = FMath::Min(Y0 + 1, MaxCell);
+    const float FracX = X - X0;
+    const float FracY = Y - Y0;
+
+    auto Bilinear = [&](const FFluidSimulationPlane& InPlane)
+    {
+        const float Bottom = FMath::Lerp(InPlane[X0 * SimulationGridSize + Y0], InPlane[X1 * SimulationGridSize + Y0], FracX);
+        const float Top = FMath::Lerp(InPlane[X0 * SimulationGridSize + Y1], InPlane[X1 * SimulationGridSize + Y1], FracX);
+        return FMath::Lerp(Bottom, Top, FracY);
+    };
+
+    OutVelocity = FVector2D(Bilinear(Current.VelocityX), Bilinear(Current.VelocityY));
+    OutDensity = Bilinear(Current.Density);
+    return true;
+}
+
+void FFluidSimulationCPUSolver::DrawToColorBuffer(TArray<FColor>& OutColors, const float InInterpolationAlpha) const
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationCPUSolver_DrawToColorBuffer);
+
+    OutColors.SetNumUninitialized(SimulationGridSize * SimulationGridSize);
+
+    const float Alpha = FMath::Clamp(InInterpolationAlpha, 0.0f, 1.0f);
+    const bool bShallowWater = Solver == EFluidSimulationSolver::ShallowWater;
+
+    // Interpolated height, cells outside the grid are at rest
+    auto GetHeight = [&](const int32 X, const int32 Y)
+    {
+        const bool bInside = X >= 0 && X < SimulationGridSize && Y >= 0 && Y < SimulationGridSize;
+        return bInside ? FMath::Lerp(Solved.VelocityX[X * SimulationGridSize + Y], Current.VelocityX[X * SimulationGridSize + Y], Alpha) : 0.0f;
+    };
+
+    ForEachTile([&](const FIntRect& InTile)
+    {
+        for (int32 X = InTile.Min.X; X < InTile.Max.X; ++X)
+        {
+            for (int32 Y = InTile.Min.Y; Y < InTile.Max.Y; ++Y)
+            {
+                const int32 Index = X * SimulationGridSize + Y;
+                FLinearColor Color;
+
+                if (bShallowWater)
+                {
+                    // Tangent space normal in RGB and the height around 0.5 in A, same encoding as FluidSimulationDrawCS.usf
+                    const FVector Slope = FVector(GetHeight(X + 1, Y) - GetHeight(X - 1, Y), GetHeight(X, Y + 1) - GetHeight(X, Y - 1), 0.0f) * 0.5f * ShallowWaterSettings.NormalStrength;
+                    const FVector Normal = FVector(-Slope.X, -Slope.Y, 1.0f).GetSafeNormal();
+                    Color = FLinearColor(Normal.X * 0.5f + 0.5f, Normal.Y * 0.5f + 0.5f, Normal.Z * 0.5f + 0.5f, FMath::Clamp(GetHeight(X, Y) * 0.5f + 0.5f, 0.0f, 1.0f));
+                }
+                else
+                {
+                    const float VelocityX = FMath::Lerp(Solved.VelocityX[Index], Current.VelocityX[Index], Alpha);
+                    const float VelocityY = FMath::Lerp(Solved.VelocityY[Index], Current.VelocityY[Index], Alpha);
+                    Color = FLinearColor(FMath::Abs(VelocityX), FMath::Abs(VelocityY), 0.0f, 1.0f);
+                }
+
+                // Texel (X, Y) of the render target, same as OutTexture[uint2(x, y)] in the draw shader
+                OutColors[Y * SimulationGridSize + X] = Color.ToFColor(false);
+            }
+        }
+    });
+}
@@ -1,8 +1,15 @@
 // Copyright (C) Ronaldo Veloso. All Rights Reserved.
 
 #include "FluidSimulation/FluidSimulationActor.h"
+#include "FluidSimulation/FluidSimulationManagerActor.h"
+#include "FluidSimulation/FluidSimulationSnapshot.h"
+#include "FluidSimulation/FluidSimulationSnapshotAsset.h"
+#include "NullVisualEffects.h"
 #include "FluidSimulation/Render/FluidSimulationRender.h"
+#include "Camera/PlayerCameraManager.h"
 #include "Components/StaticMeshComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
 #include "Engine/TextureRenderTarget2D.h"
 #include "Kismet/KismetMaterialLibrary.h"
 #include "Kismet/KismetRenderingLibrary.h"
@@ -13,12 +20,33 @@
 
 AFluidSimulationActor::AFluidSimulationActor()
     : SimulationGridSize(256)
+    , SimulationBackend(EFluidSimulationBackend::GPU)
+    , Solver(EFluidSimulationSolver::NavierStokes)
+    , FieldPrecision(EFluidSimulationFieldPrecision::Full)
+    , FieldBufferCount(2)
+    , SlidingWindowFocus(nullptr)
+    , bBatchWithManager(true)
     , RenderTargetSize(2048)
+    , UpsampleFilter(EFluidSimulationUpsampleFilter::Bilinear)
+    , SampleReadbackLatency(2)
+    , WarmStartSnapshot(nullptr)
+    , bGenerateMips(false)
     , MaterialSlotName(FName(TEXT("M_BaseMaterial")))
     , RenderTargetMaterialParameterName(FName(TEXT("SimulationRT")))
     , FluidRenderTarget(nullptr)
     , MaterialInstanceDynamic(nullptr)
+    , FluidSimulationRender(nullptr)
+    , SimulationSlice(INDEX_NONE)
+    , CachedBounds(ForceInit)
+    , SlidingWindowCell(FIntPoint::ZeroValue)
+    , SlidingWindowCellSize(0.0f)
+    , bStandaloneSimulation(false)
+    , Manager(nullptr)
 {
+    // Only sliding window surfaces tick, BeginPlay turns it on
+    PrimaryActorTick.bCanEverTick = true;
+    PrimaryActorTick.bStartWithTickEnabled = false;
+
     static ConstructorHelpers::FObjectFinder<UStaticMesh> DefaultStaticMeshRef(TEXT("StaticMesh'/NullVisualEffects/FluidSimulation/SM_FluidSimulation_Plane.SM_FluidSimulation_Plane'"));
     if (DefaultStaticMeshRef.Succeeded())
     {
@@ -45,23 +73,118 @@ void AFluidSimulationActor::BeginPlay()
 {
     Super::BeginPlay();
 
-    InitResources();
+    if (SlidingWindowSettings.bEnabled)
+    {
+        RootComponent->SetMobility(EComponentMobility::Movable);
+        StaticMeshComponent->SetMobility(EComponentMobility::Movable);
+        SetActorTickEnabled(true);
+    }
+
+    UpdateCachedBounds();
+
+    // The manager routes the bodies to the surface and, when batched, creates its simulation on its next tick
+    Manager = AFluidSimulationManagerActor::FindOrSpawn(GetWorld());
+
+    if (Manager != nullptr)
+    {
+        Manager->RegisterSurface(this);
+    }
+
+    if (Manager == nullptr || !IsBatchedWithManager())
+    {
+        InitResources();
+    }
 }
 
 void AFluidSimulationActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
+    if (Manager != nullptr)
+    {
+        Manager->UnregisterSurface(this);
+        Manager = nullptr;
+    }
+
     Super::EndPlay(EndPlayReason);
 }
 
+void AFluidSimulationActor::Tick(float DeltaSeconds)
+{
+    Super::Tick(DeltaSeconds);
+
+    if (SlidingWindowSettings.bEnabled)
+    {
+        UpdateSlidingWindow();
+    }
+}
+
 void AFluidSimulationActor::InitResources()
 {
-    // Temporary
-    // FluidRenderTarget = UKismetRenderingLibrary::CreateRenderTarget2D(this, RenderTargetSize, RenderTargetSize, ETextureRenderTargetFormat::RTF_RGBA8, FLinearColor::White);
+    // A standalone simulation takes the surface out of its batch until the next play, the manager keeps routing the bodies to it
+    const bool bWasBatched = Manager != nullptr && IsBatchedWithManager();
+
+    if (bWasBatched)
+    {
+        Manager->UnregisterSurface(this);
+    }
+
+    bStandaloneSimulation = true;
+
+    if (bWasBatched)
+    {
+        Manager->RegisterSurface(this);
+    }
+
+    UFluidSimulationRender* const Render = NewObject<UFluidSimulationRender>(this, FName(TEXT("FluidSimulationRender")), RF_Transient);
+    ApplySimulationSettings(Render);
+    Render->Init(SimulationGridSize, SimulationBackend);
+
+    SetSimulation(Render, 0);
+}
+
+void AFluidSimulationActor::ApplySimulationSettings(UFluidSimulationRender* InRender) const
+{
+    InRender->SetSolver(Solver);
+    InRender->SetShallowWaterSettings(ShallowWaterSettings);
+    InRender->SetAdvectionSettings(AdvectionSettings);
+    InRender->SetCPUSettings(CPUSettings);
+    InRender->SetProjectionSettings(ProjectionSettings);
+    InRender->SetActivitySettings(ActivitySettings);
+    InRender->SetDetailSettings(DetailSettings);
+    InRender->SetTimestepSettings(TimestepSettings);
+    InRender->SetFieldPrecision(FieldPrecision);
+    InRender->SetUpsampleFilter(UpsampleFilter);
+    InRender->SetNumFieldBuffers(FieldBufferCount);
+    InRender->SetSampleReadbackLatency(SampleReadbackLatency);
+}
+
+void AFluidSimulationActor::SetSimulation(UFluidSimulationRender* InRender, const int32 InSlice)
+{
+    FluidSimulationRender = InRender;
+    SimulationSlice = InSlice;
+
+    if (FluidSimulationRender == nullptr)
+    {
+        return;
+    }
+
+    // The CPU backend uploads FColor rows, the GPU one writes through a UAV which 8 bit BGRA does not support everywhere
+    const bool bGPU = FluidSimulationRender->GetBackend() == EFluidSimulationBackend::GPU;
+    const int32 TargetSize = (bGPU && RenderTargetSize > 0) ? RenderTargetSize : SimulationGridSize;
+
+    FluidRenderTarget = NewObject<UTextureRenderTarget2D>(this);
+    FluidRenderTarget->RenderTargetFormat = bGPU ? ETextureRenderTargetFormat::RTF_RGBA16f : ETextureRenderTargetFormat::RTF_RGBA8;
+    FluidRenderTarget->ClearColor = FLinearColor::Black;
+    FluidRenderTarget->bAutoGenerateMips = bGPU && bGenerateMips;
+    FluidRenderTarget->bCanCreateUAV = bGPU;
+    FluidRenderTarget->InitAutoFormat(TargetSize, TargetSize);
+    FluidRenderTarget->UpdateResourceImmediate(true);
 
-    FluidRenderTarget = UKismetRenderingLibrary::CreateRenderTarget2D(this, SimulationGridSize, SimulationGridSize, ETextureRenderTargetFormat::RTF_RGBA8, FLinearColor::Black);
-    FluidSimulationRender = NewObject<UFluidSimulationRender>(this, FName(TEXT("FluidSimulationRender")), RF_Transient);
-    FluidSimulationRender->SetRenderTarget(FluidRenderTarget);
-    FluidSimulationRender->Init(SimulationGridSize);
+    FluidSimulationRender->SetRenderTarget(FluidRenderTarget, SimulationSlice);
+
+    if (WarmStartSnapshot != nullptr && WarmStartSnapshot->HasData())
+    {
+        FluidSimulationRender->RestoreSnapshot(WarmStartSnapshot->GetData(), SimulationSlice);
+    }
 
     if (StaticMeshComponent != nullptr)
     {
@@ -89,32 +212,261 @@ void AFluidSimulationActor::InitResources()
     }
 }
 
-void AFluidSimulationActor::RegisterBody(const FVector& InCurrentLocation, const FVector& InPreviousLocation, const FVector& InVelocity, const float InRadius, const float InStrength)
+void AFluidSimulationActor::UpdateCachedBounds()
 {
     FVector BoundsOrigin = FVector::ZeroVector;
     FVector BoundsBoxExtent = FVector::ZeroVector;
     GetActorBounds(false, BoundsOrigin, BoundsBoxExtent, false);
 
+    CachedBounds = FBox::BuildAABB(BoundsOrigin, BoundsBoxExtent);
+}
+
+void AFluidSimulationActor::RegisterBody(const FVector& InCurrentLocation, const FVector& InPreviousLocation, const FVector& InVelocity, const float InRadius, const float InStrength, const float InFalloff)
+{
+    if (FluidSimulationRender == nullptr || !CachedBounds.IsValid)
+    {
+        return;
+    }
+
+    const FVector& BoundsOrigin = CachedBounds.GetCenter();
+    const FVector& BoundsBoxExtent = CachedBounds.GetExtent();
+
     const FVector& CurrentLocationDelta = (BoundsOrigin - InCurrentLocation) / BoundsBoxExtent;
-    const FVector& CurrentLocationNormalizedDelta = static_cast<FVector>(CurrentLocationDelta / SimulationGridSize); // #TODO: Implement size squared.
+    const FVector& PreviousLocationDelta = (BoundsOrigin - InPreviousLocation) / BoundsBoxExtent;
 
-    const FVector& PreviousLocationDelta = BoundsOrigin - InPreviousLocation;
-    const FVector& PreviousLocationNormalizedDelta = static_cast<FVector>(PreviousLocationDelta / SimulationGridSize); // #TODO: Implement size squared.
+    // Radius relative to the full grid side, which spans twice the extent
+    const float Radius = InRadius / (BoundsBoxExtent.X * 2.0f);
 
-    const FVector& Radius = FVector(InRadius, InRadius, InRadius) / BoundsBoxExtent;
+    // The swept capsule can reach into the grid even if the current location is slightly out
+    const float Margin = 1.0f + Radius * 2.0f;
+    if (FMath::Abs(CurrentLocationDelta.X) <= Margin && FMath::Abs(CurrentLocationDelta.Y) <= Margin)
+    {
+        FluidSimulationRender->AddVelocityDensity(CurrentLocationDelta, PreviousLocationDelta, InVelocity, Radius, InStrength, InFalloff, SimulationSlice);
+    }
+}
 
-    if (CurrentLocationNormalizedDelta.X <= 1.0f && CurrentLocationNormalizedDelta.X >= -1.0f && CurrentLocationNormalizedDelta.Y <= 1.0f && CurrentLocationNormalizedDelta.Y >= -1.0f)
+void AFluidSimulationActor::Draw()
+{
+    if (FluidSimulationRender != nullptr)
     {
-        FluidSimulationRender->AddVelocityDensity(CurrentLocationDelta, InVelocity * InStrength, Radius.X, 1.0f);
+        FluidSimulationRender->DrawToRenderTarget(FluidRenderTarget, SimulationSlice);
     }
+}
+
+bool AFluidSimulationActor::SampleFluid(const FVector& InWorldLocation, FVector& OutVelocity, float& OutDensity) const
+{
+    OutVelocity = FVector::ZeroVector;
+    OutDensity = 0.0f;
 
-#if !UE_BUILD_SHIPPING
+    FVector2D GridCoords = FVector2D::ZeroVector;
+    if (FluidSimulationRender == nullptr || !WorldToGridCoords(InWorldLocation, GridCoords))
+    {
+        return false;
+    }
 
-    DrawDebugDirectionalArrow(GetWorld(), InCurrentLocation, InCurrentLocation + (InVelocity * InStrength), 0.0f, FColor::Red, false, 1.0f, 0, 10.0f);
-#endif
+    // Cell i spans [i, i + 1] and the samplers take integer coords as cell centers, same as the warm start resample
+    FVector2D Velocity = FVector2D::ZeroVector;
+    if (FluidSimulationRender->SampleVelocityDensity(GridCoords - FVector2D(0.5f, 0.5f), Velocity, OutDensity))
+    {
+        OutVelocity = FVector(Velocity.X, Velocity.Y, 0.0f);
+        return true;
+    }
+
+    return false;
 }
 
-void AFluidSimulationActor::Draw()
+TFuture<TArray<FFluidSimulationSample>> AFluidSimulationActor::QueryFluid(TArrayView<const FVector> InWorldLocations) const
+{
+    TArray<FVector2D> GridCoords;
+    GridCoords.Reserve(InWorldLocations.Num());
+
+    // The mapping only fails without usable bounds, no location of the query can be placed then
+    bool bMapped = FluidSimulationRender != nullptr;
+
+    for (int32 Index = 0; Index < InWorldLocations.Num() && bMapped; ++Index)
+    {
+        // Cell centers are at integer coords for the samplers, see SampleFluid
+        FVector2D& Coords = GridCoords.AddZeroed_GetRef();
+        bMapped = WorldToGridCoords(InWorldLocations[Index], Coords);
+        Coords -= FVector2D(0.5f, 0.5f);
+    }
+
+    if (!bMapped || GridCoords.Num() == 0)
+    {
+        TPromise<TArray<FFluidSimulationSample>> Promise;
+        Promise.SetValue(TArray<FFluidSimulationSample>());
+        return Promise.GetFuture();
+    }
+
+    return FluidSimulationRender->SampleVelocityDensityAsync(GridCoords, SimulationSlice);
+}
+
+void AFluidSimulationActor::QueryFluid(TArrayView<const FVector> InWorldLocations, TFunction<void(const TArray<FFluidSimulationSample>&)> InCallback) const
+{
+    // Promises are fulfilled on the game thread, so is the continuation
+    QueryFluid(InWorldLocations).Then([Callback = MoveTemp(InCallback)](TFuture<TArray<FFluidSimulationSample>> InFuture)
+    {
+        if (Callback)
+        {
+            Callback(InFuture.Get());
+        }
+    });
+}
+
+TFuture<TArray<uint8>> AFluidSimulationActor::CaptureSnapshot() const
+{
+    if (FluidSimulationRender == nullptr)
+    {
+        TPromise<TArray<uint8>> Promise;
+        Promise.SetValue(TArray<uint8>());
+        return Promise.GetFuture();
+    }
+
+    return FluidSimulationRender->CaptureSnapshot(SimulationSlice);
+}
+
+bool AFluidSimulationActor::RestoreSnapshot(TArrayView<const uint8> InData)
+{
+    return FluidSimulationRender != nullptr && FluidSimulationRender->RestoreSnapshot(InData, SimulationSlice);
+}
+
+void AFluidSimulationActor::SaveSnapshotToFile(const FString& InFilename) const
+{
+    CaptureSnapshot().Then([Filename = InFilename](TFuture<TArray<uint8>> InFuture)
+    {
+        const TArray<uint8> Data = InFuture.Get();
+
+        if (!FFluidSimulationSnapshot::SaveToFile(Data, Filename))
+        {
+            UE_LOG(LogNullVisualEffects, Warning, TEXT("Failed to save the fluid simulation snapshot to %s."), *Filename);
+        }
+    });
+}
+
+bool AFluidSimulationActor::RestoreSnapshotFromFile(const FString& InFilename)
+{
+    FFluidSimulationMappedSnapshot Snapshot;
+    return Snapshot.Open(InFilename) && RestoreSnapshot(Snapshot.GetData());
+}
+
+void AFluidSimulationActor::CaptureWarmStartSnapshot()
+{
+    if (WarmStartSnapshot == nullptr || FluidSimulationRender == nullptr)
+    {
+        UE_LOG(LogNullVisualEffects, Warning, TEXT("%s: Needs a warm start snapshot asset and a running simulation to capture."), *GetName());
+        return;
+    }
+
+    CaptureSnapshot().Then([Asset = TWeakObjectPtr<UFluidSimulationSnapshotAsset>(WarmStartSnapshot)](TFuture<TArray<uint8>> InFuture)
+    {
+        TArray<uint8> Data = InFuture.Get();
+
+        if (Asset.IsValid() && Data.Num() > 0)
+        {
+            Asset->Modify();
+            Asset->SetData(MoveTemp(Data));
+            Asset->MarkPackageDirty();
+        }
+    });
+}
+
+bool AFluidSimulationActor::WorldToGridCoords(const FVector& InWorldLocation, FVector2D& OutGridCoords) const
+{
+    if (!CachedBounds.IsValid)
+    {
+        return false;
+    }
+
+    const FVector& BoundsOrigin = CachedBounds.GetCenter();
+    const FVector& BoundsBoxExtent = CachedBounds.GetExtent();
+
+    if (BoundsBoxExtent.X <= 0.0f || BoundsBoxExtent.Y <= 0.0f)
+    {
+        return false;
+    }
+
+    // Same mapping as RegisterBody / AddVelocityDensity, bounds minimum is cell 0
+    const FVector& NormalizedLocation = (InWorldLocation - (BoundsOrigin - BoundsBoxExtent)) / (BoundsBoxExtent * 2.0f);
+    OutGridCoords = FVector2D(NormalizedLocation.X, NormalizedLocation.Y) * static_cast<float>(SimulationGridSize);
+    return true;
+}
+
+bool AFluidSimulationActor::GetSlidingWindowFocus(FVector& OutLocation) const
+{
+    if (SlidingWindowFocus != nullptr)
+    {
+        OutLocation = SlidingWindowFocus->GetActorLocation();
+        return true;
+    }
+
+    const APlayerController* const PlayerController = GetWorld() != nullptr ? GetWorld()->GetFirstPlayerController() : nullptr;
+
+    if (PlayerController != nullptr && PlayerController->PlayerCameraManager != nullptr)
+    {
+        OutLocation = PlayerController->PlayerCameraManager->GetCameraLocation();
+        return true;
+    }
+
+    return false;
+}
+
+void AFluidSimulationActor::UpdateSlidingWindow()
+{
+    FVector FocusLocation = FVector::ZeroVector;
+    if (!CachedBounds.IsValid || SimulationGridSize <= 0 || !GetSlidingWindowFocus(FocusLocation))
+    {
+        return;
+    }
+
+    // The grid keeps the cell size the surface was placed with
+    const bool bPlaced = SlidingWindowCellSize > 0.0f;
+    if (!bPlaced)
+    {
+        SlidingWindowCellSize = CachedBounds.GetSize().X / static_cast<float>(SimulationGridSize);
+
+        if (SlidingWindowCellSize <= 0.0f)
+        {
+            return;
+        }
+    }
+
+    // First cell of a window centered on the focus, snapped so small moves of the focus do not move the grid
+    const int32 Snap = SlidingWindowSettings.GetSnapCells(ActivitySettings);
+    const FVector2D FocusCells = FVector2D(FocusLocation.X, FocusLocation.Y) / SlidingWindowCellSize - FVector2D(SimulationGridSize, SimulationGridSize) * 0.5f;
+    const FIntPoint WindowCell(FMath::FloorToInt(FocusCells.X / Snap) * Snap, FMath::FloorToInt(FocusCells.Y / Snap) * Snap);
+
+    if (bPlaced && WindowCell == SlidingWindowCell)
+    {
+        return;
+    }
+
+    // The fluid stays in the world, the simulation only learns how far the window moved
+    if (bPlaced && FluidSimulationRender != nullptr)
+    {
+        FluidSimulationRender->MoveWindow(WindowCell - SlidingWindowCell);
+    }
+
+    SlidingWindowCell = WindowCell;
+
+    const FVector WindowMin(WindowCell.X * SlidingWindowCellSize, WindowCell.Y * SlidingWindowCellSize, CachedBounds.Min.Z);
+    const FVector Offset = FVector(WindowMin.X - CachedBounds.Min.X, WindowMin.Y - CachedBounds.Min.Y, 0.0f);
+
+    AddActorWorldOffset(Offset);
+    CachedBounds = CachedBounds.ShiftBy(Offset);
+
+    // Bodies are routed with the bounds
+    if (Manager != nullptr)
+    {
+        Manager->NotifySurfaceMoved(this);
+    }
+}
+
+FFluidSimulationSolverStats AFluidSimulationActor::GetSolverStats() const
+{
+    return FluidSimulationRender != nullptr ? FluidSimulationRender->GetSolverStats() : FFluidSimulationSolverStats();
+}
+
+FFluidSimulationSurfaceStats AFluidSimulationActor::GetSurfaceStats() const
 {
-    FluidSimulationRender->DrawToRenderTarget(FluidRenderTarget);
+    return Manager != nullptr ? Manager->GetSurfaceStats(this) : FFluidSimulationSurfaceStats();
 }
@@ -0,0 +1,395 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/FluidSimulationBenchmarkCommandlet.h"
+#include "NullVisualEffects.h"
+#include "FluidSimulation/Render/FluidSimulationRender.h"
+#include "FluidSimulation/Render/FluidSimulationUploadBuffer.h"
+#include "Dom/JsonObject.h"
+#include "DynamicRHI.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+#include "Misc/App.h"
+#include "Misc/DateTime.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "RenderingThread.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "UObject/Package.h"
+
+namespace FluidSimulationBenchmark
+{
+    /** Simulated frame time, the solver steps once per frame */
+    static constexpr float StepSeconds = 1.0f / 60.0f;
+
+    /** Parses a comma separated list of integers, keeps InDefault when the value is missing */
+    static TArray<int32> ParseIntList(const TCHAR* InParams, const TCHAR* InName, const TArray<int32>& InDefault)
+    {
+        FString Value;
+        if (!FParse::Value(InParams, InName, Value, false))
+        {
+            return InDefault;
+        }
+
+        TArray<FString> Tokens;
+        Value.ParseIntoArray(Tokens, TEXT(","));
+
+        TArray<int32> Values;
+        for (const FString& Token : Tokens)
+        {
+            Values.Add(FCString::Atoi(*Token));
+        }
+
+        return Values;
+    }
+
+    /** Parses a comma separated list of floats, keeps InDefault when the value is missing */
+    static TArray<float> ParseFloatList(const TCHAR* InParams, const TCHAR* InName, const TArray<float>& InDefault)
+    {
+        FString Value;
+        if (!FParse::Value(InParams, InName, Value, false))
+        {
+            return InDefault;
+        }
+
+        TArray<FString> Tokens;
+        Value.ParseIntoArray(Tokens, TEXT(","));
+
+        TArray<float> Values;
+        for (const FString& Token : Tokens)
+        {
+            Values.Add(FCString::Atof(*Token));
+        }
+
+        return Values;
+    }
+
+    /** Returns the InPercentile of sorted samples, nearest rank */
+    static double GetPercentile(const TArray<double>& InSortedSamples, const double InPercentile)
+    {
+        if (InSortedSamples.Num() == 0)
+        {
+            return 0.0;
+        }
+
+        const int32 Index = FMath::Clamp(FMath::CeilToInt(InPercentile * InSortedSamples.Num()) - 1, 0, InSortedSamples.Num() - 1);
+        return InSortedSamples[Index];
+    }
+
+    /** Blocks until the GPU has run everything submitted so far, so the step time covers its work */
+    static void WaitForGPU()
+    {
+        ENQUEUE_RENDER_COMMAND(FluidSimulationBenchmark_WaitForGPU)
+        (
+            [](FRHICommandListImmediate& RHICmdList)
+            {
+                RHICmdList.SubmitCommandsAndFlushGPU();
+                RHICmdList.BlockUntilGPUIdle();
+            }
+        );
+
+        FlushRenderingCommands();
+    }
+
+    /** Body moving on a circle, normalized grid coords */
+    struct FBodyPath
+    {
+        FVector2D Center;
+        float Radius;
+        float AngularSpeed;
+        float Phase;
+
+        /** Returns the location at InTime */
+        FVector GetLocation(const float InTime) const
+        {
+            const float Angle = Phase + AngularSpeed * InTime;
+            return FVector(Center.X + Radius * FMath::Cos(Angle), Center.Y + Radius * FMath::Sin(Angle), 0.0f);
+        }
+
+        /** Returns the velocity at InTime */
+        FVector GetVelocity(const float InTime) const
+        {
+            const float Angle = Phase + AngularSpeed * InTime;
+            return FVector(-FMath::Sin(Angle), FMath::Cos(Angle), 0.0f) * Radius * AngularSpeed;
+        }
+    };
+}
+
+UFluidSimulationBenchmarkCommandlet::UFluidSimulationBenchmarkCommandlet()
+{
+    IsClient = false;
+    IsEditor = false;
+    IsServer = false;
+    LogToConsole = true;
+    ShowErrorCount = true;
+}
+
+int32 UFluidSimulationBenchmarkCommandlet::Main(const FString& Params)
+{
+    using namespace FluidSimulationBenchmark;
+
+    const TCHAR* const ParamsString = *Params;
+
+    FSuiteSettings Settings;
+    FParse::Value(ParamsString, TEXT("Steps="), Settings.NumSteps);
+    FParse::Value(ParamsString, TEXT("Warmup="), Settings.NumWarmupSteps);
+    FParse::Value(ParamsString, TEXT("Seed="), Settings.Seed);
+    Settings.NumSteps = FMath::Max(Settings.NumSteps, 1);
+    Settings.NumWarmupSteps = FMath::Max(Settings.NumWarmupSteps, 0);
+    Settings.ProjectionSettings.bEnabled = !FParse::Param(ParamsString, TEXT("NoProjection"));
+    Settings.ActivitySettings.bEnabled = FParse::Param(ParamsString, TEXT("Activity"));
+
+    FString SolverName;
+    if (FParse::Value(ParamsString, TEXT("Solver="), SolverName))
+    {
+        const int64 SolverValue = StaticEnum<EFluidSimulationSolver>()->GetValueByNameString(SolverName);
+        if (SolverValue == INDEX_NONE)
+        {
+            UE_LOG(LogNullVisualEffects, Error, TEXT("Unknown solver %s."), *SolverName);
+            return 1;
+        }
+
+        Settings.Solver = static_cast<EFluidSimulationSolver>(SolverValue);
+    }
+
+    FString AdvectionName;
+    if (FParse::Value(ParamsString, TEXT("Advection="), AdvectionName))
+    {
+        const int64 AdvectionValue = StaticEnum<EFluidSimulationAdvection>()->GetValueByNameString(AdvectionName);
+        if (AdvectionValue == INDEX_NONE || AdvectionValue == static_cast<int64>(EFluidSimulationAdvection::MAX))
+        {
+            UE_LOG(LogNullVisualEffects, Error, TEXT("Unknown advection scheme %s."), *AdvectionName);
+            return 1;
+        }
+
+        Settings.AdvectionSettings.Scheme = static_cast<EFluidSimulationAdvection>(AdvectionValue);
+    }
+
+    FString BackendsString(TEXT("CPU,GPU"));
+    FParse::Value(ParamsString, TEXT("Backends="), BackendsString, false);
+
+    TArray<FString> BackendNames;
+    BackendsString.ParseIntoArray(BackendNames, TEXT(","));
+
+    TArray<EFluidSimulationBackend> Backends;
+    for (const FString& BackendName : BackendNames)
+    {
+        const int64 BackendValue = StaticEnum<EFluidSimulationBackend>()->GetValueByNameString(BackendName);
+        if (BackendValue == INDEX_NONE)
+        {
+            UE_LOG(LogNullVisualEffects, Error, TEXT("Unknown backend %s."), *BackendName);
+            return 1;
+        }
+
+        Backends.Add(static_cast<EFluidSimulationBackend>(BackendValue));
+    }
+
+    const TArray<int32> GridSizes = ParseIntList(ParamsString, TEXT("GridSizes="), { 128, 256, 512, 1024, 2048 });
+    const TArray<int32> BodyCounts = ParseIntList(ParamsString, TEXT("Bodies="), { 0, 10, 100, 1000 });
+    const TArray<float> BrushRadii = ParseFloatList(ParamsString, TEXT("Radii="), { 0.01f, 0.05f });
+
+    FString OutputPath = FPaths::ProjectSavedDir() / TEXT("FluidSimulation") / FString::Printf(TEXT("Benchmark-%s.json"), *FDateTime::Now().ToString());
+    FParse::Value(ParamsString, TEXT("Output="), OutputPath);
+
+    TArray<TSharedPtr<FJsonValue>> Results;
+
+    for (const EFluidSimulationBackend Backend : Backends)
+    {
+        for (const int32 GridSize : GridSizes)
+        {
+            for (const int32 NumBodies : BodyCounts)
+            {
+                for (const float BrushRadius : BrushRadii)
+                {
+                    FScenario Scenario;
+                    Scenario.Backend = Backend;
+                    Scenario.GridSize = FMath::Max(GridSize, 16);
+                    Scenario.NumBodies = FMath::Max(NumBodies, 0);
+                    Scenario.BrushRadius = FMath::Max(BrushRadius, 0.0f);
+
+                    Results.Add(MakeShared<FJsonValueObject>(RunScenario(Scenario, Settings)));
+                }
+            }
+        }
+    }
+
+    TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+    Report->SetNumberField(TEXT("version"), 1);
+    Report->SetStringField(TEXT("engineVersion"), FEngineVersion::Current().ToString());
+    Report->SetStringField(TEXT("platform"), FPlatformProperties::IniPlatformName());
+    Report->SetStringField(TEXT("cpu"), FPlatformMisc::GetCPUBrand().TrimStartAndEnd());
+    Report->SetStringField(TEXT("rhi"), FApp::CanEverRender() && GDynamicRHI != nullptr ? GDynamicRHI->GetName() : TEXT("Null"));
+    Report->SetNumberField(TEXT("numWorkerThreads"), FTaskGraphInterface::Get().GetNumWorkerThreads());
+    Report->SetStringField(TEXT("solver"), StaticEnum<EFluidSimulationSolver>()->GetNameStringByValue(static_cast<int64>(Settings.Solver)));
+    Report->SetStringField(TEXT("advection"), StaticEnum<EFluidSimulationAdvection>()->GetNameStringByValue(static_cast<int64>(Settings.AdvectionSettings.Scheme)));
+    Report->SetBoolField(TEXT("projection"), Settings.ProjectionSettings.bEnabled);
+    Report->SetBoolField(TEXT("activity"), Settings.ActivitySettings.bEnabled);
+    Report->SetNumberField(TEXT("steps"), Settings.NumSteps);
+    Report->SetNumberField(TEXT("warmupSteps"), Settings.NumWarmupSteps);
+    Report->SetNumberField(TEXT("seed"), Settings.Seed);
+    Report->SetArrayField(TEXT("scenarios"), Results);
+
+    FString Json;
+    const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+    FJsonSerializer::Serialize(Report, Writer);
+
+    if (!FFileHelper::SaveStringToFile(Json, *OutputPath))
+    {
+        UE_LOG(LogNullVisualEffects, Error, TEXT("Could not write the benchmark report to %s."), *OutputPath);
+        return 1;
+    }
+
+    UE_LOG(LogNullVisualEffects, Display, TEXT("Fluid simulation benchmark, %d scenarios written to %s"), Results.Num(), *FPaths::ConvertRelativePathToFull(OutputPath));
+    return 0;
+}
+
+TSharedPtr<FJsonObject> UFluidSimulationBenchmarkCommandlet::RunScenario(const FScenario& InScenario, const FSuiteSettings& InSettings) const
+{
+    using namespace FluidSimulationBenchmark;
+
+    TSharedPtr<FJsonObject> Result = MakeShared<FJsonObject>();
+    Result->SetStringField(TEXT("backend"), StaticEnum<EFluidSimulationBackend>()->GetNameStringByValue(static_cast<int64>(InScenario.Backend)));
+    Result->SetNumberField(TEXT("gridSize"), InScenario.GridSize);
+    Result->SetNumberField(TEXT("bodies"), InScenario.NumBodies);
+    Result->SetNumberField(TEXT("brushRadius"), InScenario.BrushRadius);
+
+    const bool bGPU = InScenario.Backend == EFluidSimulationBackend::GPU;
+
+    // Init would fall back to the CPU solver, which is already measured on its own
+    if (bGPU && !FApp::CanEverRender())
+    {
+        Result->SetStringField(TEXT("skipped"), TEXT("No RHI"));
+        return Result;
+    }
+
+    const FPlatformMemoryStats MemoryBefore = FPlatformMemory::GetStats();
+    const int32 ReallocationsBefore = GFluidSimulationUploadBuffer.GetNumReallocations();
+
+    FFluidSimulationTimestepSettings TimestepSettings;
+    TimestepSettings.bFixedTimestep = false;
+
+    UFluidSimulationRender* const Render = NewObject<UFluidSimulationRender>(GetTransientPackage(), NAME_None, RF_Transient);
+    Render->SetTickedExternally(true);
+    Render->SetTimestepSettings(TimestepSettings);
+    Render->SetSolver(InSettings.Solver);
+    Render->SetAdvectionSettings(InSettings.AdvectionSettings);
+    Render->SetProjectionSettings(InSettings.ProjectionSettings);
+    Render->SetActivitySettings(InSettings.ActivitySettings);
+
+    const double InitStartTime = FPlatformTime::Seconds();
+    Render->Init(InScenario.GridSize, InScenario.Backend);
+    Render->WaitUntilReady();
+    const double InitMs = (FPlatformTime::Seconds() - InitStartTime) * 1000.0;
+
+    // Same seeded paths for every backend and grid size, bodies stay inside the grid
+    FRandomStream RandomStream(InSettings.Seed + InScenario.NumBodies);
+    TArray<FBodyPath> Paths;
+    Paths.SetNum(InScenario.NumBodies);
+
+    for (FBodyPath& Path : Paths)
+    {
+        Path.Radius = RandomStream.FRandRange(0.05f, 0.35f);
+        Path.Center = FVector2D(RandomStream.FRandRange(-0.6f, 0.6f), RandomStream.FRandRange(-0.6f, 0.6f));
+        Path.AngularSpeed = RandomStream.FRandRange(0.5f, 3.0f);
+        Path.Phase = RandomStream.FRandRange(0.0f, 2.0f * PI);
+    }
+
+    TArray<double> StepMs;
+    StepMs.Reserve(InSettings.NumSteps);
+
+    double EnqueueMs = 0.0;
+    double AddInputMs = 0.0;
+    double UpdateFluidMs = 0.0;
+    double ProjectMs = 0.0;
+    int64 NumActiveTiles = 0;
+    uint64 UploadedBytes = 0;
+
+    for (int32 Step = -InSettings.NumWarmupSteps; Step < InSettings.NumSteps; ++Step)
+    {
+        const bool bMeasure = Step >= 0;
+        const float Time = (Step + InSettings.NumWarmupSteps) * StepSeconds;
+
+        const double EnqueueStartTime = FPlatformTime::Seconds();
+
+        for (const FBodyPath& Path : Paths)
+        {
+            Render->AddVelocityDensity(Path.GetLocation(Time), Path.GetLocation(Time - StepSeconds), Path.GetVelocity(Time), InScenario.BrushRadius, 1.0f);
+        }
+
+        const uint64 UploadedBefore = GFluidSimulationUploadBuffer.GetBytesUploaded();
+        const double StepStartTime = FPlatformTime::Seconds();
+
+        Render->Tick(StepSeconds);
+
+        if (bGPU)
+        {
+            WaitForGPU();
+        }
+
+        const double StepEndTime = FPlatformTime::Seconds();
+
+        if (bMeasure)
+        {
+            const FFluidSimulationSolverStats Stats = Render->GetSolverStats();
+
+            EnqueueMs += (StepStartTime - EnqueueStartTime) * 1000.0;
+            StepMs.Add((StepEndTime - StepStartTime) * 1000.0);
+            AddInputMs += Stats.AddInputMs;
+            UpdateFluidMs += Stats.UpdateFluidMs;
+            ProjectMs += Stats.ProjectMs;
+            NumActiveTiles += Stats.NumActiveTiles;
+            UploadedBytes += GFluidSimulationUploadBuffer.GetBytesUploaded() - UploadedBefore;
+        }
+    }
+
+    const FPlatformMemoryStats MemoryAfter = FPlatformMemory::GetStats();
+    const EFluidSimulationBackend ActualBackend = Render->GetBackend();
+
+    Render->ConditionalBeginDestroy();
+    CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+
+    double TotalMs = 0.0;
+    for (const double Ms : StepMs)
+    {
+        TotalMs += Ms;
+    }
+
+    const double NumSteps = static_cast<double>(StepMs.Num());
+    const double MeanMs = TotalMs / NumSteps;
+    StepMs.Sort();
+
+    TSharedPtr<FJsonObject> StepObject = MakeShared<FJsonObject>();
+    StepObject->SetNumberField(TEXT("mean"), MeanMs);
+    StepObject->SetNumberField(TEXT("min"), StepMs[0]);
+    StepObject->SetNumberField(TEXT("p50"), GetPercentile(StepMs, 0.5));
+    StepObject->SetNumberField(TEXT("p95"), GetPercentile(StepMs, 0.95));
+    StepObject->SetNumberField(TEXT("max"), StepMs.Last());
+
+    // The GPU is only timed as a whole, from the tick to the GPU going idle
+    TSharedPtr<FJsonObject> PhaseObject = MakeShared<FJsonObject>();
+    PhaseObject->SetNumberField(TEXT("enqueueBrushes"), EnqueueMs / NumSteps);
+    if (ActualBackend == EFluidSimulationBackend::CPU)
+    {
+        PhaseObject->SetNumberField(TEXT("addInput"), AddInputMs / NumSteps);
+        PhaseObject->SetNumberField(TEXT("updateFluid"), UpdateFluidMs / NumSteps);
+        PhaseObject->SetNumberField(TEXT("project"), ProjectMs / NumSteps);
+    }
+
+    Result->SetStringField(TEXT("actualBackend"), StaticEnum<EFluidSimulationBackend>()->GetNameStringByValue(static_cast<int64>(ActualBackend)));
+    Result->SetNumberField(TEXT("initMs"), InitMs);
+    Result->SetObjectField(TEXT("stepMs"), StepObject);
+    Result->SetObjectField(TEXT("phaseMs"), PhaseObject);
+    Result->SetNumberField(TEXT("cellsPerSecond"), MeanMs > 0.0 ? static_cast<double>(InScenario.GridSize) * InScenario.GridSize / (MeanMs / 1000.0) : 0.0);
+    Result->SetNumberField(TEXT("activeTiles"), NumActiveTiles / NumSteps);
+    Result->SetNumberField(TEXT("uploadBytesPerFrame"), UploadedBytes / NumSteps);
+    Result->SetNumberField(TEXT("uploadRingReallocations"), GFluidSimulationUploadBuffer.GetNumReallocations() - ReallocationsBefore);
+    Result->SetNumberField(TEXT("usedPhysicalDeltaBytes"), static_cast<double>(static_cast<int64>(MemoryAfter.UsedPhysical) - static_cast<int64>(MemoryBefore.UsedPhysical)));
+
+    UE_LOG(LogNullVisualEffects, Display, TEXT("%s %dx%d, %d bodies, radius %.3f: %.3f ms/step (p95 %.3f ms), %.2f MCells/s"),
+        *Result->GetStringField(TEXT("actualBackend")), InScenario.GridSize, InScenario.GridSize, InScenario.NumBodies, InScenario.BrushRadius,
+        MeanMs, GetPercentile(StepMs, 0.95), Result->GetNumberField(TEXT("cellsPerSecond")) / 1000000.0);
+
+    return Result;
+}
\ No newline at end of file
@@ -1,18 +1,16 @@
 // Copyright (C) Ronaldo Veloso. All Rights Reserved.
 
 #include "FluidSimulation\FluidSimulationBodyComponent.h"
-#include "FluidSimulation\FluidSimulationActor.h"
+#include "FluidSimulation\FluidSimulationManagerActor.h"
 
 UFluidSimulationBodyComponent::UFluidSimulationBodyComponent()
     : MinimumUpdateDistance(5.0f)
     , Strength(1.0f)
-    , CurrentLocation(FVector::ZeroVector)
-    , PreviousLocation(FVector::ZeroVector)
-    , SecondPreviousLocation(FVector::ZeroVector)
+    , Falloff(1.0f)
+    , Manager(nullptr)
 {
-    PrimaryComponentTick.bCanEverTick = true;
-    PrimaryComponentTick.bStartWithTickEnabled = true;
-    PrimaryComponentTick.TickInterval = 0.0333f;
+    // The manager gathers every body in a single pass, bodies do not tick nor listen to overlaps
+    PrimaryComponentTick.bCanEverTick = false;
 }
 
 UFluidSimulationBodyComponent::~UFluidSimulationBodyComponent()
@@ -23,52 +21,21 @@ void UFluidSimulationBodyComponent::BeginPlay()
 {
     Super::BeginPlay();
 
-    OnComponentBeginOverlap.AddDynamic(this, &UFluidSimulationBodyComponent::ComponentBeginOverlap);
-    OnComponentEndOverlap.AddDynamic(this, &UFluidSimulationBodyComponent::ComponentEndOverlap);
-}
-
-void UFluidSimulationBodyComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
-{
-    Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+    Manager = AFluidSimulationManagerActor::FindOrSpawn(GetWorld());
 
-    if (CurrentUpdateActor != nullptr)
+    if (Manager != nullptr)
     {
-        CurrentLocation = GetComponentLocation();
-
-        if ((CurrentLocation - PreviousLocation).Size2D() > MinimumUpdateDistance) // #TODO : Add a Recip here
-        {
-            if (AActor* const Owner = GetOwner())
-            {
-                CurrentUpdateActor->RegisterBody(CurrentLocation, PreviousLocation, Owner->GetVelocity(), GetScaledSphereRadius(), Strength);
-            }
-
-            SecondPreviousLocation = PreviousLocation;
-            PreviousLocation = CurrentLocation;
-        }
+        Manager->RegisterBody(this);
     }
 }
 
 void UFluidSimulationBodyComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-    Super::EndPlay(EndPlayReason);
-
-    OnComponentBeginOverlap.RemoveDynamic(this, &UFluidSimulationBodyComponent::ComponentBeginOverlap);
-    OnComponentEndOverlap.RemoveDynamic(this, &UFluidSimulationBodyComponent::ComponentEndOverlap);
-}
-
-void UFluidSimulationBodyComponent::ComponentBeginOverlap(class UPrimitiveComponent* InOverlappedComp, class AActor* InOtherActor, class UPrimitiveComponent* InOtherComp, int32 InOtherBodyIndex, bool InFromSweep, const FHitResult& InSweepResult)
-{
-    if (InOtherActor != nullptr)
+    if (Manager != nullptr)
     {
-        CurrentUpdateActor = Cast<AFluidSimulationActor>(InOtherActor);
-        CurrentLocation = GetComponentLocation();
-        PreviousLocation = CurrentLocation;
-        SecondPreviousLocation = CurrentLocation;
+        Manager->UnregisterBody(this);
+        Manager = nullptr;
     }
 
-}
-
-void UFluidSimulationBodyComponent::ComponentEndOverlap(class UPrimitiveComponent* InOverlappedComp, class AActor* InOtherActor, class UPrimitiveComponent* InOtherComp, int32 InOtherBodyIndex)
-{
-    CurrentUpdateActor = nullptr;
-}
+    Super::EndPlay(EndPlayReason);
+}
\ No newline at end of file
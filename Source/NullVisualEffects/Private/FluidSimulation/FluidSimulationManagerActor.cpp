@@ -1 +1,853 @@
 // Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/FluidSimulationManagerActor.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "NullVisualEffects.h"
+#include "FluidSimulation/FluidSimulationActor.h"
+#include "FluidSimulation/FluidSimulationBodyComponent.h"
+#include "FluidSimulation/Render/FluidSimulationRender.h"
+#include "DrawDebugHelpers.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/App.h"
+
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationManagerActor Tick"), STAT_FluidSimulationManagerActor_Tick, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationManagerActor RebuildBatches"), STAT_FluidSimulationManagerActor_RebuildBatches, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationManagerActor UpdateBatchLODs"), STAT_FluidSimulationManagerActor_UpdateBatchLODs, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationManagerActor UpdateBatches"), STAT_FluidSimulationManagerActor_UpdateBatches, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationManagerActor GatherBodies"), STAT_FluidSimulationManagerActor_GatherBodies, STATGROUP_NullVisualEffects);
+
+static TAutoConsoleVariable<int32> CVarFluidSimulationDrawBodies
+(
+    TEXT("FluidSimulation.DrawBodies"),
+    0,
+    TEXT("Draws the velocity of every body brush sent to a fluid surface."),
+    ECVF_Cheat
+);
+
+namespace FluidSimulationManagerActor
+{
+    /** Update interval of each rate level, in frames */
+    static constexpr int32 RateLevelIntervals[] = { 1, 2, 4 };
+
+    /** Returns the rate level of a screen size, thresholds move against InCurrentLevel by InHysteresis */
+    static int32 SelectRateLevel(const float InScreenSize, const int32 InCurrentLevel, const FFluidSimulationLODSettings& InSettings)
+    {
+        const float Thresholds[] = { InSettings.HalfRateScreenSize, InSettings.QuarterRateScreenSize };
+
+        int32 Level = 0;
+        for (int32 ThresholdIndex = 0; ThresholdIndex < static_cast<int32>(UE_ARRAY_COUNT(Thresholds)); ++ThresholdIndex)
+        {
+            const float Scale = InCurrentLevel > ThresholdIndex ? 1.0f + InSettings.Hysteresis : 1.0f - InSettings.Hysteresis;
+            if (InScreenSize < Thresholds[ThresholdIndex] * Scale)
+            {
+                Level = ThresholdIndex + 1;
+            }
+        }
+
+        return Level;
+    }
+}
+
+static FAutoConsoleCommandWithWorld GFluidSimulationDumpManagerStats
+(
+    TEXT("FluidSimulation.DumpManagerStats"),
+    TEXT("Logs the batches of the fluid simulation manager and the stats of every surface"),
+    FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* InWorld)
+    {
+        for (TActorIterator<AFluidSimulationManagerActor> It(InWorld); It; ++It)
+        {
+            const FFluidSimulationManagerStats& Stats = It->GetManagerStats();
+            UE_LOG(LogNullVisualEffects, Log, TEXT("%s: %d surfaces in %d batches (%d updated, %d dormant), tick %.3f ms, step %.3f ms, %d/%d active tiles"),
+                *It->GetPathName(), Stats.NumSurfaces, Stats.NumBatches, Stats.NumUpdatedBatches, Stats.NumDormantBatches, Stats.TickMs, Stats.StepMs, Stats.NumActiveTiles, Stats.NumTiles);
+
+            for (TActorIterator<AFluidSimulationActor> SurfaceIt(InWorld); SurfaceIt; ++SurfaceIt)
+            {
+                const FFluidSimulationSurfaceStats& SurfaceStats = It->GetSurfaceStats(*SurfaceIt);
+                if (SurfaceStats.BatchIndex != INDEX_NONE)
+                {
+                    UE_LOG(LogNullVisualEffects, Log, TEXT("  %s: batch %d slice %d/%d, every %d frames, %d brushes, amortized tick %.3f ms"),
+                        *SurfaceIt->GetName(), SurfaceStats.BatchIndex, SurfaceStats.Slice, SurfaceStats.NumBatchSurfaces, SurfaceStats.UpdateInterval, SurfaceStats.NumBrushes, SurfaceStats.AmortizedTickMs);
+                }
+            }
+        }
+    })
+);
+
+AFluidSimulationManagerActor::AFluidSimulationManagerActor()
+    : MaxSurfacesPerBatch(16)
+    , BodyUpdateInterval(0.0333f)
+    , BroadphaseCellSize(2048.0f)
+    , bBatchesDirty(false)
+    , bBroadphaseDirty(false)
+    , BodyUpdateAccumulator(0.0f)
+    , NextBatchIndex(0)
+    , NumUpdatedBatches(0)
+{
+    PrimaryActorTick.bCanEverTick = true;
+    PrimaryActorTick.bStartWithTickEnabled = true;
+
+    // Bodies register their brushes during the regular tick groups, the batches step after all of them
+    PrimaryActorTick.TickGroup = TG_PostUpdateWork;
+
+    RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("FluidSimulationManagerRootComponent"));
+}
+
+AFluidSimulationManagerActor::~AFluidSimulationManagerActor()
+{
+}
+
+void AFluidSimulationManagerActor::Tick(float DeltaSeconds)
+{
+    Super::Tick(DeltaSeconds);
+
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationManagerActor_Tick);
+
+    if (bBatchesDirty)
+    {
+        RebuildBatches();
+    }
+
+    if (bBroadphaseDirty)
+    {
+        RebuildBroadphase();
+    }
+
+    BodyUpdateAccumulator += DeltaSeconds;
+
+    if (BodyUpdateAccumulator >= BodyUpdateInterval)
+    {
+        // Keeps the leftover so the gathers follow the interval, a hitch is caught up by at most one extra gather
+        BodyUpdateAccumulator = FMath::Min(BodyUpdateAccumulator - BodyUpdateInterval, BodyUpdateInterval);
+        GatherBodies();
+    }
+
+    UpdateBatchLODs();
+    UpdateBatches(DeltaSeconds);
+
+    INC_DWORD_STAT_BY(STAT_FluidSimulation_Batches, Batches.Num());
+    INC_DWORD_STAT_BY(STAT_FluidSimulation_Bodies, Bodies.Num());
+}
+
+void AFluidSimulationManagerActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    ReleaseBatches();
+    Surfaces.Reset();
+    Bodies.Reset();
+    BroadphaseCells.Reset();
+
+    Super::EndPlay(EndPlayReason);
+}
+
+AFluidSimulationManagerActor* AFluidSimulationManagerActor::FindOrSpawn(UWorld* InWorld)
+{
+    if (InWorld == nullptr)
+    {
+        return nullptr;
+    }
+
+    for (TActorIterator<AFluidSimulationManagerActor> It(InWorld); It; ++It)
+    {
+        if (!It->IsPendingKill())
+        {
+            return *It;
+        }
+    }
+
+    FActorSpawnParameters SpawnParameters;
+    SpawnParameters.Name = FName(TEXT("FluidSimulationManager"));
+    SpawnParameters.NameMode = FActorSpawnParameters::ESpawnActorNameMode::Requested;
+    SpawnParameters.ObjectFlags = RF_Transient;
+    SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+    return InWorld->SpawnActor<AFluidSimulationManagerActor>(SpawnParameters);
+}
+
+void AFluidSimulationManagerActor::RegisterSurface(AFluidSimulationActor* InSurface)
+{
+    if (InSurface != nullptr && !Surfaces.Contains(InSurface))
+    {
+        Surfaces.Add(InSurface);
+        bBatchesDirty = true;
+        bBroadphaseDirty = true;
+    }
+}
+
+void AFluidSimulationManagerActor::UnregisterSurface(AFluidSimulationActor* InSurface)
+{
+    if (Surfaces.Remove(InSurface) > 0)
+    {
+        if (InSurface->IsBatchedWithManager())
+        {
+            InSurface->SetSimulation(nullptr, INDEX_NONE);
+        }
+        else if (UFluidSimulationRender* const Render = InSurface->GetSimulation())
+        {
+            Render->SetTickedExternally(false);
+        }
+
+        bBatchesDirty = true;
+        bBroadphaseDirty = true;
+    }
+}
+
+void AFluidSimulationManagerActor::NotifySurfaceMoved(AFluidSimulationActor* InSurface)
+{
+    if (Surfaces.Contains(InSurface))
+    {
+        bBroadphaseDirty = true;
+    }
+}
+
+void AFluidSimulationManagerActor::RegisterBody(UFluidSimulationBodyComponent* InBody)
+{
+    if (InBody != nullptr && !Bodies.Components.Contains(InBody))
+    {
+        Bodies.Add(InBody, InBody->GetComponentLocation());
+    }
+}
+
+void AFluidSimulationManagerActor::UnregisterBody(UFluidSimulationBodyComponent* InBody)
+{
+    const int32 BodyIndex = Bodies.Components.IndexOfByPredicate([InBody](const TWeakObjectPtr<UFluidSimulationBodyComponent>& InRegisteredBody) { return InRegisteredBody.Get() == InBody; });
+
+    if (BodyIndex != INDEX_NONE)
+    {
+        Bodies.RemoveAtSwap(BodyIndex);
+    }
+}
+
+FFluidSimulationSurfaceStats AFluidSimulationManagerActor::GetSurfaceStats(const AFluidSimulationActor* InSurface) const
+{
+    FFluidSimulationSurfaceStats Stats;
+
+    for (int32 BatchIndex = 0; BatchIndex < Batches.Num(); ++BatchIndex)
+    {
+        const FBatch& Batch = Batches[BatchIndex];
+        const int32 Slice = Batch.Surfaces.IndexOfByPredicate([InSurface](const TWeakObjectPtr<AFluidSimulationActor>& InBatchSurface) { return InBatchSurface.Get() == InSurface; });
+
+        if (Slice != INDEX_NONE)
+        {
+            const UFluidSimulationRender* const Render = BatchRenders[BatchIndex];
+
+            Stats.BatchIndex = BatchIndex;
+            Stats.Slice = Slice;
+            Stats.NumBatchSurfaces = Batch.Surfaces.Num();
+            Stats.NumBrushes = Render->GetNumBrushes(Slice);
+            Stats.UpdateInterval = Batch.UpdateInterval;
+            Stats.AmortizedTickMs = Batch.TickMs / static_cast<float>(Batch.Surfaces.Num());
+            Stats.BatchStats = Render->GetSolverStats();
+            break;
+        }
+    }
+
+    return Stats;
+}
+
+FFluidSimulationManagerStats AFluidSimulationManagerActor::GetManagerStats() const
+{
+    FFluidSimulationManagerStats Stats;
+    Stats.NumSurfaces = Surfaces.Num();
+    Stats.NumBatches = Batches.Num();
+    Stats.NumUpdatedBatches = NumUpdatedBatches;
+
+    for (int32 BatchIndex = 0; BatchIndex < Batches.Num(); ++BatchIndex)
+    {
+        const FFluidSimulationSolverStats& BatchStats = BatchRenders[BatchIndex]->GetSolverStats();
+
+        Stats.NumDormantBatches += Batches[BatchIndex].UpdateInterval == 0 ? 1 : 0;
+        Stats.TickMs += Batches[BatchIndex].TickMs;
+        Stats.StepMs += BatchStats.StepMs;
+        Stats.NumTiles += BatchStats.NumTiles;
+        Stats.NumActiveTiles += BatchStats.NumActiveTiles;
+    }
+
+    return Stats;
+}
+
+void AFluidSimulationManagerActor::RebuildBatches()
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationManagerActor_RebuildBatches);
+
+    bBatchesDirty = false;
+
+    Surfaces.RemoveAll([](const AFluidSimulationActor* InSurface) { return InSurface == nullptr || InSurface->IsPendingKill(); });
+    bBroadphaseDirty = true;
+
+    // Surfaces keep their batch and slice, only the batches losing or gaining a surface are touched
+    TSet<const AFluidSimulationActor*> BatchedSurfaces;
+
+    for (int32 BatchIndex = Batches.Num() - 1; BatchIndex >= 0; --BatchIndex)
+    {
+        FBatch& Batch = Batches[BatchIndex];
+        UFluidSimulationRender* const Render = BatchRenders[BatchIndex];
+
+        if (Batch.bStandalone)
+        {
+            const AFluidSimulationActor* const Surface = Batch.Surfaces[0].Get();
+
+            if (Surface != nullptr && Surfaces.Contains(Surface) && Surface->GetSimulation() == Render)
+            {
+                BatchedSurfaces.Add(Surface);
+            }
+            else
+            {
+                Batches.RemoveAt(BatchIndex);
+                BatchRenders.RemoveAt(BatchIndex);
+            }
+
+            continue;
+        }
+
+        TArray<int32, TInlineAllocator<8>> FreedSlices;
+
+        for (int32 Slice = 0; Slice < Batch.Surfaces.Num(); ++Slice)
+        {
+            TWeakObjectPtr<AFluidSimulationActor>& Surface = Batch.Surfaces[Slice];
+
+            if (Surface.IsExplicitlyNull())
+            {
+                continue;
+            }
+
+            if (Surface.IsValid() && Surfaces.Contains(Surface.Get()))
+            {
+                BatchedSurfaces.Add(Surface.Get());
+                continue;
+            }
+
+            Surface.Reset();
+            FreedSlices.Add(Slice);
+        }
+
+        // Freed slices at the end are dropped, the ones in between are still water until a surface that fits takes them
+        int32 NumSlices = Batch.Surfaces.Num();
+        while (NumSlices > 0 && Batch.Surfaces[NumSlices - 1].IsExplicitlyNull())
+        {
+            --NumSlices;
+        }
+
+        if (NumSlices == 0)
+        {
+            Batches.RemoveAt(BatchIndex);
+            BatchRenders.RemoveAt(BatchIndex);
+            continue;
+        }
+
+        Batch.Surfaces.SetNum(NumSlices);
+
+        for (const int32 Slice : FreedSlices)
+        {
+            if (Slice < NumSlices)
+            {
+                Render->ResetSlice(Slice);
+            }
+        }
+    }
+
+    NextBatchIndex = Batches.Num() > 0 ? NextBatchIndex % Batches.Num() : 0;
+
+    // Batch and slice of every surface joining an existing batch
+    TArray<FIntPoint, TInlineAllocator<8>> JoinedSlices;
+
+    for (AFluidSimulationActor* const Surface : Surfaces)
+    {
+        if (BatchedSurfaces.Contains(Surface))
+        {
+            continue;
+        }
+
+        // Standalone surfaces get a batch of their own so they follow the same update policy
+        if (!Surface->IsBatchedWithManager())
+        {
+            if (UFluidSimulationRender* const Render = Surface->GetSimulation())
+            {
+                FBatch& Batch = Batches.AddDefaulted_GetRef();
+                Batch.Surfaces.Add(Surface);
+                Batch.bStandalone = true;
+
+                Render->SetTickedExternally(true);
+                BatchRenders.Add(Render);
+            }
+
+            continue;
+        }
+
+        // A free slice of a compatible batch first, then a compatible batch with room left, then a new batch
+        int32 TargetBatchIndex = INDEX_NONE;
+        int32 TargetSlice = INDEX_NONE;
+
+        for (int32 BatchIndex = 0; BatchIndex < Batches.Num() && TargetSlice == INDEX_NONE; ++BatchIndex)
+        {
+            const FBatch& Batch = Batches[BatchIndex];
+            const TWeakObjectPtr<AFluidSimulationActor>* const BatchSurface = Batch.Surfaces.FindByPredicate([](const TWeakObjectPtr<AFluidSimulationActor>& InBatchSurface) { return InBatchSurface.IsValid(); });
+
+            if (Batch.bStandalone || BatchSurface == nullptr || !CanShareBatch(BatchSurface->Get(), Surface))
+            {
+                continue;
+            }
+
+            const int32 FreeSlice = Batch.Surfaces.IndexOfByPredicate([](const TWeakObjectPtr<AFluidSimulationActor>& InBatchSurface) { return InBatchSurface.IsExplicitlyNull(); });
+
+            if (FreeSlice != INDEX_NONE)
+            {
+                TargetBatchIndex = BatchIndex;
+                TargetSlice = FreeSlice;
+            }
+            else if (TargetBatchIndex == INDEX_NONE && Batch.Surfaces.Num() < MaxSurfacesPerBatch)
+            {
+                TargetBatchIndex = BatchIndex;
+            }
+        }
+
+        if (TargetBatchIndex == INDEX_NONE)
+        {
+            TargetBatchIndex = Batches.Num();
+            Batches.AddDefaulted();
+            BatchRenders.Add(nullptr);
+        }
+
+        FBatch& TargetBatch = Batches[TargetBatchIndex];
+
+        if (TargetSlice == INDEX_NONE)
+        {
+            TargetSlice = TargetBatch.Surfaces.Add(Surface);
+        }
+        else
+        {
+            TargetBatch.Surfaces[TargetSlice] = Surface;
+        }
+
+        JoinedSlices.Add(FIntPoint(TargetBatchIndex, TargetSlice));
+    }
+
+    for (int32 BatchIndex = 0; BatchIndex < Batches.Num(); ++BatchIndex)
+    {
+        const FBatch& Batch = Batches[BatchIndex];
+
+        if (Batch.bStandalone)
+        {
+            continue;
+        }
+
+        const AFluidSimulationActor* const FirstSurface = Batch.Surfaces.FindByPredicate([](const TWeakObjectPtr<AFluidSimulationActor>& InBatchSurface) { return InBatchSurface.IsValid(); })->Get();
+        UFluidSimulationRender* Render = BatchRenders[BatchIndex];
+        bool bAttachAll = false;
+
+        if (Render == nullptr)
+        {
+            Render = NewObject<UFluidSimulationRender>(this, NAME_None, RF_Transient);
+            FirstSurface->ApplySimulationSettings(Render);
+            Render->SetNumSlices(Batch.Surfaces.Num());
+            Render->SetTickedExternally(true);
+            Render->Init(FirstSurface->SimulationGridSize, FirstSurface->SimulationBackend);
+
+            BatchRenders[BatchIndex] = Render;
+            bAttachAll = true;
+        }
+        else if (Render->GetNumSlices() != Batch.Surfaces.Num())
+        {
+            // The slices that stay are carried over by the resample, a simulation not ready yet only had the warm starts to carry
+            bAttachAll = !Render->IsReady();
+            Render->SetNumSlices(Batch.Surfaces.Num());
+            Render->Init(FirstSurface->SimulationGridSize, FirstSurface->SimulationBackend, true);
+        }
+
+        for (int32 Slice = 0; Slice < Batch.Surfaces.Num(); ++Slice)
+        {
+            AFluidSimulationActor* const Surface = Batch.Surfaces[Slice].Get();
+
+            if (Surface != nullptr && (bAttachAll || JoinedSlices.Contains(FIntPoint(BatchIndex, Slice))))
+            {
+                Surface->SetSimulation(Render, Slice);
+            }
+        }
+    }
+
+    UE_LOG(LogNullVisualEffects, Log, TEXT("%s: %d fluid surfaces packed in %d batches."), *GetPathName(), Surfaces.Num(), Batches.Num());
+}
+
+void AFluidSimulationManagerActor::UpdateBatchLODs()
+{
+    using namespace FluidSimulationManagerActor;
+
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationManagerActor_UpdateBatchLODs);
+
+    TArray<FVector, TInlineAllocator<4>> ViewLocations;
+
+    if (UWorld* const World = GetWorld())
+    {
+        for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+        {
+            if (const APlayerController* const PlayerController = It->Get())
+            {
+                FVector ViewLocation = FVector::ZeroVector;
+                FRotator ViewRotation = FRotator::ZeroRotator;
+                PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+                ViewLocations.Add(ViewLocation);
+            }
+        }
+    }
+
+    // Without views (servers, headless runs) nothing can be judged, gameplay may still sample the surfaces
+    if (!LODSettings.bEnabled || ViewLocations.Num() == 0)
+    {
+        for (FBatch& Batch : Batches)
+        {
+            Batch.UpdateInterval = 1;
+        }
+
+        return;
+    }
+
+    const bool bCheckRendered = FApp::CanEverRender();
+    const float Hysteresis = LODSettings.Hysteresis;
+
+    for (FBatch& Batch : Batches)
+    {
+        const bool bDormant = Batch.UpdateInterval == 0;
+        const int32 CurrentLevel = bDormant ? static_cast<int32>(UE_ARRAY_COUNT(RateLevelIntervals)) - 1 : static_cast<int32>(FMath::FloorLog2(static_cast<uint32>(Batch.UpdateInterval)));
+
+        // The batch follows its most relevant surface
+        float ScreenSize = 0.0f;
+        float Distance = TNumericLimits<float>::Max();
+        bool bRendered = !bCheckRendered;
+
+        for (const TWeakObjectPtr<AFluidSimulationActor>& Surface : Batch.Surfaces)
+        {
+            if (!Surface.IsValid() || !Surface->GetCachedBounds().IsValid)
+            {
+                continue;
+            }
+
+            const FBox& Bounds = Surface->GetCachedBounds();
+            const float Diameter = Bounds.GetExtent().Size() * 2.0f;
+
+            for (const FVector& ViewLocation : ViewLocations)
+            {
+                const float ViewDistance = FMath::Sqrt(Bounds.ComputeSquaredDistanceToPoint(ViewLocation));
+                Distance = FMath::Min(Distance, ViewDistance);
+                ScreenSize = FMath::Max(ScreenSize, Diameter / FMath::Max(ViewDistance, 1.0f));
+            }
+
+            if (bCheckRendered && Surface->StaticMeshComponent != nullptr)
+            {
+                bRendered |= Surface->StaticMeshComponent->WasRecentlyRendered(LODSettings.DormantDelay);
+            }
+        }
+
+        const float DormantDistance = LODSettings.DormantDistance * (bDormant ? 1.0f - Hysteresis : 1.0f + Hysteresis);
+
+        if (!bRendered || Distance > DormantDistance)
+        {
+            Batch.UpdateInterval = 0;
+        }
+        else
+        {
+            Batch.UpdateInterval = RateLevelIntervals[SelectRateLevel(ScreenSize, CurrentLevel, LODSettings)];
+        }
+    }
+}
+
+void AFluidSimulationManagerActor::UpdateBatches(const float InDeltaSeconds)
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationManagerActor_UpdateBatches);
+
+    NumUpdatedBatches = 0;
+
+    const int32 NumBatches = Batches.Num();
+    const float BudgetMs = LODSettings.bEnabled ? LODSettings.FrameBudgetMs : 0.0f;
+    float SpentMs = 0.0f;
+    int32 LastUpdatedIndex = INDEX_NONE;
+
+    for (int32 Offset = 0; Offset < NumBatches; ++Offset)
+    {
+        const int32 BatchIndex = (NextBatchIndex + Offset) % NumBatches;
+        FBatch& Batch = Batches[BatchIndex];
+
+        // Dormant batches freeze, they do not catch up when they wake up. Their queries are still answered from the frozen state
+        if (Batch.UpdateInterval == 0)
+        {
+            Batch.PendingDeltaTime = 0.0f;
+            Batch.FramesSinceUpdate = 0;
+            BatchRenders[BatchIndex]->UpdateSampler();
+            continue;
+        }
+
+        Batch.PendingDeltaTime += InDeltaSeconds;
+        ++Batch.FramesSinceUpdate;
+
+        // Over budget batches stay due and are first in line next frame
+        const bool bDue = Batch.FramesSinceUpdate >= Batch.UpdateInterval;
+        const bool bInBudget = BudgetMs <= 0.0f || SpentMs < BudgetMs || NumUpdatedBatches == 0;
+
+        if (bDue && bInBudget)
+        {
+            const double StartTime = FPlatformTime::Seconds();
+
+            // The fixed clock turns the elapsed time into substeps
+            BatchRenders[BatchIndex]->Tick(Batch.PendingDeltaTime);
+
+            Batch.TickMs = static_cast<float>((FPlatformTime::Seconds() - StartTime) * 1000.0);
+            Batch.PendingDeltaTime = 0.0f;
+            Batch.FramesSinceUpdate = 0;
+
+            SpentMs += Batch.TickMs;
+            LastUpdatedIndex = BatchIndex;
+            ++NumUpdatedBatches;
+        }
+        else
+        {
+            BatchRenders[BatchIndex]->UpdateSampler();
+        }
+    }
+
+    if (LastUpdatedIndex != INDEX_NONE)
+    {
+        NextBatchIndex = (LastUpdatedIndex + 1) % NumBatches;
+    }
+}
+
+void AFluidSimulationManagerActor::RebuildBroadphase()
+{
+    BroadphaseCells.Reset();
+    bBroadphaseDirty = false;
+
+    for (int32 SurfaceIndex = 0; SurfaceIndex < Surfaces.Num(); ++SurfaceIndex)
+    {
+        const FBox& Bounds = Surfaces[SurfaceIndex]->GetCachedBounds();
+
+        if (Bounds.IsValid)
+        {
+            const FIntPoint& MinCell = GetBroadphaseCell(Bounds.Min);
+            const FIntPoint& MaxCell = GetBroadphaseCell(Bounds.Max);
+
+            for (int32 CellX = MinCell.X; CellX <= MaxCell.X; ++CellX)
+            {
+                for (int32 CellY = MinCell.Y; CellY <= MaxCell.Y; ++CellY)
+                {
+                    BroadphaseCells.FindOrAdd(FIntPoint(CellX, CellY)).Add(SurfaceIndex);
+                }
+            }
+        }
+    }
+}
+
+void AFluidSimulationManagerActor::GatherBodies()
+{
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationManagerActor_GatherBodies);
+
+    // Transforms first, in a single pass over the components
+    for (int32 BodyIndex = Bodies.Num() - 1; BodyIndex >= 0; --BodyIndex)
+    {
+        if (const UFluidSimulationBodyComponent* const Body = Bodies.Components[BodyIndex].Get())
+        {
+            Bodies.Locations[BodyIndex] = Body->GetComponentLocation();
+            Bodies.Radii[BodyIndex] = Body->GetScaledSphereRadius();
+        }
+        else
+        {
+            Bodies.RemoveAtSwap(BodyIndex);
+        }
+    }
+
+    if (BroadphaseCells.Num() == 0)
+    {
+        return;
+    }
+
+    const bool bDrawBodies = CVarFluidSimulationDrawBodies.GetValueOnGameThread() != 0;
+
+    TArray<int32, TInlineAllocator<8>> CandidateSurfaces;
+
+    for (int32 BodyIndex = 0; BodyIndex < Bodies.Num(); ++BodyIndex)
+    {
+        const UFluidSimulationBodyComponent* const Body = Bodies.Components[BodyIndex].Get();
+        const FVector& Location = Bodies.Locations[BodyIndex];
+        // By value, the array element is moved to the current location below and the sweep still needs the old one
+        const FVector PreviousLocation = Bodies.PreviousLocations[BodyIndex];
+        const float Radius = Bodies.Radii[BodyIndex];
+
+        if (FVector::DistSquared2D(Location, PreviousLocation) <= FMath::Square(Body->MinimumUpdateDistance))
+        {
+            continue;
+        }
+
+        Bodies.PreviousLocations[BodyIndex] = Location;
+
+        // Swept sphere against the surfaces of the cells it covers
+        const FBox SweptBounds = FBox(Location.ComponentMin(PreviousLocation), Location.ComponentMax(PreviousLocation)).ExpandBy(Radius);
+        const FIntPoint& MinCell = GetBroadphaseCell(SweptBounds.Min);
+        const FIntPoint& MaxCell = GetBroadphaseCell(SweptBounds.Max);
+
+        CandidateSurfaces.Reset();
+
+        for (int32 CellX = MinCell.X; CellX <= MaxCell.X; ++CellX)
+        {
+            for (int32 CellY = MinCell.Y; CellY <= MaxCell.Y; ++CellY)
+            {
+                if (const TArray<int32>* const CellSurfaces = BroadphaseCells.Find(FIntPoint(CellX, CellY)))
+                {
+                    for (const int32 SurfaceIndex : *CellSurfaces)
+                    {
+                        CandidateSurfaces.AddUnique(SurfaceIndex);
+                    }
+                }
+            }
+        }
+
+        if (CandidateSurfaces.Num() == 0)
+        {
+            continue;
+        }
+
+        const AActor* const Owner = Body->GetOwner();
+        const FVector& Velocity = Owner != nullptr ? Owner->GetVelocity() : FVector::ZeroVector;
+
+        for (const int32 SurfaceIndex : CandidateSurfaces)
+        {
+            AFluidSimulationActor* const Surface = Surfaces[SurfaceIndex];
+
+            if (Surface->GetCachedBounds().IntersectXY(SweptBounds))
+            {
+                Surface->RegisterBody(Location, PreviousLocation, Velocity, Radius, Body->Strength, Body->Falloff);
+            }
+        }
+
+#if !UE_BUILD_SHIPPING
+
+        if (bDrawBodies)
+        {
+            DrawDebugDirectionalArrow(GetWorld(), Location, Location + (Velocity * Body->Strength), 0.0f, FColor::Red, false, 1.0f, 0, 10.0f);
+        }
+#endif
+    }
+}
+
+FIntPoint AFluidSimulationManagerActor::GetBroadphaseCell(const FVector& InLocation) const
+{
+    const float CellSizeRecip = 1.0f / FMath::Max(BroadphaseCellSize, 1.0f);
+    return FIntPoint(FMath::FloorToInt(InLocation.X * CellSizeRecip), FMath::FloorToInt(InLocation.Y * CellSizeRecip));
+}
+
+void AFluidSimulationManagerActor::ReleaseBatches()
+{
+    for (int32 BatchIndex = 0; BatchIndex < Batches.Num(); ++BatchIndex)
+    {
+        const FBatch& Batch = Batches[BatchIndex];
+
+        // Standalone simulations go back to ticking themselves
+        if (Batch.bStandalone)
+        {
+            BatchRenders[BatchIndex]->SetTickedExternally(false);
+            continue;
+        }
+
+        for (const TWeakObjectPtr<AFluidSimulationActor>& Surface : Batch.Surfaces)
+        {
+            if (Surface.IsValid())
+            {
+                Surface->SetSimulation(nullptr, INDEX_NONE);
+            }
+        }
+    }
+
+    Batches.Reset();
+    BatchRenders.Reset();
+    NextBatchIndex = 0;
+}
+
+bool AFluidSimulationManagerActor::CanShareBatch(const AFluidSimulationActor* InSurface, const AFluidSimulationActor* InOtherSurface)
+{
+    if (InSurface == nullptr || InOtherSurface == nullptr)
+    {
+        return false;
+    }
+
+    // The CPU solver only solves a single surface, GPU requests fall back to it when there is no RHI
+    if (InSurface->SimulationBackend != EFluidSimulationBackend::GPU || InOtherSurface->SimulationBackend != EFluidSimulationBackend::GPU || !FApp::CanEverRender())
+    {
+        return false;
+    }
+
+    // Every surface of a simulation shares the window origin, a sliding one gets a simulation of its own
+    if (InSurface->SlidingWindowSettings.bEnabled || InOtherSurface->SlidingWindowSettings.bEnabled)
+    {
+        return false;
+    }
+
+    const FFluidSimulationProjectionSettings& Projection = InSurface->ProjectionSettings;
+    const FFluidSimulationProjectionSettings& OtherProjection = InOtherSurface->ProjectionSettings;
+
+    const FFluidSimulationActivitySettings& Activity = InSurface->ActivitySettings;
+    const FFluidSimulationActivitySettings& OtherActivity = InOtherSurface->ActivitySettings;
+
+    const FFluidSimulationShallowWaterSettings& ShallowWater = InSurface->ShallowWaterSettings;
+    const FFluidSimulationShallowWaterSettings& OtherShallowWater = InOtherSurface->ShallowWaterSettings;
+
+    const FFluidSimulationAdvectionSettings& Advection = InSurface->AdvectionSettings;
+    const FFluidSimulationAdvectionSettings& OtherAdvection = InOtherSurface->AdvectionSettings;
+
+    const FFluidSimulationTimestepSettings& Timestep = InSurface->TimestepSettings;
+    const FFluidSimulationTimestepSettings& OtherTimestep = InOtherSurface->TimestepSettings;
+
+    // The patch pool is shared by every surface of the simulation
+    const FFluidSimulationDetailSettings& Detail = InSurface->DetailSettings;
+    const FFluidSimulationDetailSettings& OtherDetail = InOtherSurface->DetailSettings;
+
+    return InSurface->SimulationGridSize == InOtherSurface->SimulationGridSize
+        && InSurface->FieldPrecision == InOtherSurface->FieldPrecision
+        && InSurface->FieldBufferCount == InOtherSurface->FieldBufferCount
+        && InSurface->UpsampleFilter == InOtherSurface->UpsampleFilter
+        && InSurface->Solver == InOtherSurface->Solver
+        && ShallowWater.WaveSpeed == OtherShallowWater.WaveSpeed
+        && ShallowWater.Damping == OtherShallowWater.Damping
+        && ShallowWater.BrushDepth == OtherShallowWater.BrushDepth
+        && ShallowWater.NormalStrength == OtherShallowWater.NormalStrength
+        && Advection.Scheme == OtherAdvection.Scheme
+        && Advection.VelocityScale == OtherAdvection.VelocityScale
+        && Advection.MaxCellsPerStep == OtherAdvection.MaxCellsPerStep
+        && Projection.bEnabled == OtherProjection.bEnabled
+        && Projection.NumCycles == OtherProjection.NumCycles
+        && Projection.NumSmoothingIterations == OtherProjection.NumSmoothingIterations
+        && Activity.bEnabled == OtherActivity.bEnabled
+        && Activity.GetTileSize() == OtherActivity.GetTileSize()
+        && Activity.Threshold == OtherActivity.Threshold
+        && Timestep.bFixedTimestep == OtherTimestep.bFixedTimestep
+        && Timestep.StepRate == OtherTimestep.StepRate
+        && Timestep.MaxSubsteps == OtherTimestep.MaxSubsteps
+        && Timestep.bInterpolate == OtherTimestep.bInterpolate
+        && Detail.bEnabled == OtherDetail.bEnabled
+        && Detail.GetPatchGridSize() == OtherDetail.GetPatchGridSize()
+        && Detail.GetRefinementRatio() == OtherDetail.GetRefinementRatio()
+        && Detail.GetMaxPatches() == OtherDetail.GetMaxPatches()
+        && Detail.PatchLifetime == OtherDetail.PatchLifetime;
+}
+
+void AFluidSimulationManagerActor::FBodies::Add(UFluidSimulationBodyComponent* InBody, const FVector& InLocation)
+{
+    Components.Add(InBody);
+    Locations.Add(InLocation);
+    PreviousLocations.Add(InLocation);
+    Radii.Add(0.0f);
+}
+
+void AFluidSimulationManagerActor::FBodies::RemoveAtSwap(const int32 InIndex)
+{
+    Components.RemoveAtSwap(InIndex);
+    Locations.RemoveAtSwap(InIndex);
+    PreviousLocations.RemoveAtSwap(InIndex);
+    Radii.RemoveAtSwap(InIndex);
+}
+
+void AFluidSimulationManagerActor::FBodies::Reset()
+{
+    Components.Reset();
+    Locations.Reset();
+    PreviousLocations.Reset();
+    Radii.Reset();
+}
\ No newline at end of file
@@ -0,0 +1,389 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/FluidSimulationSnapshot.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "NullVisualEffects.h"
+#include "Async/MappedFileHandle.h"
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationSnapshot Encode"), STAT_FluidSimulationSnapshot_Encode, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationSnapshot Decode"), STAT_FluidSimulationSnapshot_Decode, STATGROUP_NullVisualEffects);
+
+namespace FluidSimulationSnapshot
+{
+    /** Identifies a snapshot blob */
+    static constexpr uint32 Magic = 0x504E5346;
+
+    /** Bumped whenever the layout changes, older blobs are rejected */
+    static constexpr uint32 Version = 1;
+
+    /** Fixed header at the start of the blob */
+    struct FHeader
+    {
+        uint32 Magic;
+        uint32 Version;
+        int32 SimulationGridSize;
+        int32 TileSize;
+        uint32 Solver;
+        uint32 bCompressed;
+        uint32 RawSize;
+        uint32 PayloadSize;
+        float TimeAccumulator;
+        float Padding;
+        double SimulationTime;
+    };
+
+    /** Range of every field inside a tile, the quantized values span [Min, Max] */
+    struct FTileRange
+    {
+        float VelocityXMin;
+        float VelocityXMax;
+        float VelocityYMin;
+        float VelocityYMax;
+        float DensityMin;
+        float DensityMax;
+    };
+
+    /** Views of the fields in the uncompressed payload */
+    template<typename ByteType>
+    struct TPayload
+    {
+        ByteType* Ranges = nullptr;
+        ByteType* VelocityX = nullptr;
+        ByteType* VelocityY = nullptr;
+        ByteType* Density = nullptr;
+    };
+
+    /** Returns the tiles per side of a grid */
+    static int32 GetNumTilesPerSide(const int32 InSimulationGridSize)
+    {
+        return FMath::DivideAndRoundUp(InSimulationGridSize, FFluidSimulationSnapshot::TileSize);
+    }
+
+    /** Returns the size of the uncompressed payload of a grid */
+    static uint32 GetRawSize(const int32 InSimulationGridSize)
+    {
+        const uint32 NumCells = InSimulationGridSize * InSimulationGridSize;
+        const uint32 NumTiles = FMath::Square(GetNumTilesPerSide(InSimulationGridSize));
+        return NumTiles * sizeof(FTileRange) + NumCells * (sizeof(uint16) * 2 + sizeof(uint8));
+    }
+
+    /** Splits an uncompressed payload in its fields */
+    template<typename ByteType>
+    static TPayload<ByteType> GetPayload(ByteType* InRaw, const int32 InSimulationGridSize)
+    {
+        const uint32 NumCells = InSimulationGridSize * InSimulationGridSize;
+        const uint32 NumTiles = FMath::Square(GetNumTilesPerSide(InSimulationGridSize));
+
+        TPayload<ByteType> Payload;
+        Payload.Ranges = InRaw;
+        Payload.VelocityX = Payload.Ranges + NumTiles * sizeof(FTileRange);
+        Payload.VelocityY = Payload.VelocityX + NumCells * sizeof(uint16);
+        Payload.Density = Payload.VelocityY + NumCells * sizeof(uint16);
+        return Payload;
+    }
+
+    /** Returns the cells of a tile */
+    static FIntRect GetTile(const int32 InTileIndex, const int32 InSimulationGridSize)
+    {
+        const int32 NumTilesPerSide = GetNumTilesPerSide(InSimulationGridSize);
+        const int32 X = (InTileIndex / NumTilesPerSide) * FFluidSimulationSnapshot::TileSize;
+        const int32 Y = (InTileIndex % NumTilesPerSide) * FFluidSimulationSnapshot::TileSize;
+        return FIntRect(X, Y, FMath::Min(X + FFluidSimulationSnapshot::TileSize, InSimulationGridSize), FMath::Min(Y + FFluidSimulationSnapshot::TileSize, InSimulationGridSize));
+    }
+
+    /** Quantizes a value of the [InMin, InMax] range to InMaxCode steps */
+    static uint32 Quantize(const float InValue, const float InMin, const float InMax, const float InMaxCode)
+    {
+        return InMax > InMin ? static_cast<uint32>(FMath::RoundToInt(FMath::Clamp((InValue - InMin) / (InMax - InMin), 0.0f, 1.0f) * InMaxCode)) : 0;
+    }
+
+    /** Restores a value quantized to InMaxCode steps */
+    static float Dequantize(const uint32 InCode, const float InMin, const float InMax, const float InMaxCode)
+    {
+        return InMin + (InMax - InMin) * (static_cast<float>(InCode) / InMaxCode);
+    }
+
+    /** Bilinear sample of a plane at InCoords, in cells, clamped to the grid */
+    static float SamplePlane(const FFluidSimulationPlane& InPlane, const int32 InSimulationGridSize, const FVector2D& InCoords)
+    {
+        const int32 MaxCell = InSimulationGridSize - 1;
+        const float X = FMath::Clamp(InCoords.X, 0.0f, static_cast<float>(MaxCell));
+        const float Y = FMath::Clamp(InCoords.Y, 0.0f, static_cast<float>(MaxCell));
+
+        const int32 X0 = FMath::FloorToInt(X);
+        const int32 Y0 = FMath::FloorToInt(Y);
+        const int32 X1 = FMath::Min(X0 + 1, MaxCell);
+        const int32 Y1 = FMath::Min(Y0 + 1, MaxCell);
+
+        const float Bottom = FMath::Lerp(InPlane[X0 * InSimulationGridSize + Y0], InPlane[X1 * InSimulationGridSize + Y0], X - X0);
+        const float Top = FMath::Lerp(InPlane[X0 * InSimulationGridSize + Y1], InPlane[X1 * InSimulationGridSize + Y1], X - X0);
+        return FMath::Lerp(Bottom, Top, Y - Y0);
+    }
+}
+
+void FFluidSimulationSnapshot::Encode(const FFluidSimulationPlanes& InPlanes, const FFluidSimulationSnapshotInfo& InInfo, TArray<uint8>& OutData, const bool bInCompress)
+{
+    using namespace FluidSimulationSnapshot;
+
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationSnapshot_Encode);
+
+    const int32 GridSize = InInfo.SimulationGridSize;
+    const int32 NumCells = GridSize * GridSize;
+    OutData.Reset();
+
+    if (GridSize <= 0 || GridSize > MaxSimulationGridSize || InPlanes.VelocityX.Num() != NumCells || InPlanes.VelocityY.Num() != NumCells || InPlanes.Density.Num() != NumCells)
+    {
+        return;
+    }
+
+    const uint32 RawSize = GetRawSize(GridSize);
+    TArray<uint8> Raw;
+    Raw.SetNumUninitialized(RawSize);
+
+    const TPayload<uint8> Payload = GetPayload(Raw.GetData(), GridSize);
+    FTileRange* const Ranges = reinterpret_cast<FTileRange*>(Payload.Ranges);
+    uint16* const VelocityX = reinterpret_cast<uint16*>(Payload.VelocityX);
+    uint16* const VelocityY = reinterpret_cast<uint16*>(Payload.VelocityY);
+    uint8* const Density = Payload.Density;
+
+    ParallelFor(FMath::Square(GetNumTilesPerSide(GridSize)), [&](const int32 InTileIndex)
+    {
+        const FIntRect Tile = GetTile(InTileIndex, GridSize);
+
+        FTileRange Range = { MAX_flt, -MAX_flt, MAX_flt, -MAX_flt, MAX_flt, -MAX_flt };
+        for (int32 X = Tile.Min.X; X < Tile.Max.X; ++X)
+        {
+            for (int32 Index = X * GridSize + Tile.Min.Y; Index < X * GridSize + Tile.Max.Y; ++Index)
+            {
+                Range.VelocityXMin = FMath::Min(Range.VelocityXMin, InPlanes.VelocityX[Index]);
+                Range.VelocityXMax = FMath::Max(Range.VelocityXMax, InPlanes.VelocityX[Index]);
+                Range.VelocityYMin = FMath::Min(Range.VelocityYMin, InPlanes.VelocityY[Index]);
+                Range.VelocityYMax = FMath::Max(Range.VelocityYMax, InPlanes.VelocityY[Index]);
+                Range.DensityMin = FMath::Min(Range.DensityMin, InPlanes.Density[Index]);
+                Range.DensityMax = FMath::Max(Range.DensityMax, InPlanes.Density[Index]);
+            }
+        }
+
+        Ranges[InTileIndex] = Range;
+
+        for (int32 X = Tile.Min.X; X < Tile.Max.X; ++X)
+        {
+            for (int32 Index = X * GridSize + Tile.Min.Y; Index < X * GridSize + Tile.Max.Y; ++Index)
+            {
+                VelocityX[Index] = static_cast<uint16>(Quantize(InPlanes.VelocityX[Index], Range.VelocityXMin, Range.VelocityXMax, 65535.0f));
+                VelocityY[Index] = static_cast<uint16>(Quantize(InPlanes.VelocityY[Index], Range.VelocityYMin, Range.VelocityYMax, 65535.0f));
+                Density[Index] = static_cast<uint8>(Quantize(InPlanes.Density[Index], Range.DensityMin, Range.DensityMax, 255.0f));
+            }
+        }
+    });
+
+    FHeader Header;
+    FMemory::Memzero(Header);
+    Header.Magic = Magic;
+    Header.Version = Version;
+    Header.SimulationGridSize = GridSize;
+    Header.TileSize = TileSize;
+    Header.Solver = static_cast<uint32>(InInfo.Solver);
+    Header.RawSize = RawSize;
+    Header.TimeAccumulator = InInfo.TimeAccumulator;
+    Header.SimulationTime = InInfo.SimulationTime;
+
+    // Still water is long runs of zeros, LZ4 decompresses faster than the payload can be read from disk
+    if (bInCompress)
+    {
+        int32 CompressedSize = FCompression::CompressMemoryBound(NAME_LZ4, RawSize);
+        OutData.SetNumUninitialized(sizeof(FHeader) + CompressedSize);
+
+        if (FCompression::CompressMemory(NAME_LZ4, OutData.GetData() + sizeof(FHeader), CompressedSize, Raw.GetData(), RawSize) && static_cast<uint32>(CompressedSize) < RawSize)
+        {
+            Header.bCompressed = 1;
+            Header.PayloadSize = CompressedSize;
+        }
+    }
+
+    if (Header.bCompressed == 0)
+    {
+        Header.PayloadSize = RawSize;
+        OutData.SetNumUninitialized(sizeof(FHeader) + RawSize);
+        FMemory::Memcpy(OutData.GetData() + sizeof(FHeader), Raw.GetData(), RawSize);
+    }
+
+    OutData.SetNum(sizeof(FHeader) + Header.PayloadSize, false);
+    FMemory::Memcpy(OutData.GetData(), &Header, sizeof(FHeader));
+}
+
+bool FFluidSimulationSnapshot::ReadInfo(TArrayView<const uint8> InData, FFluidSimulationSnapshotInfo& OutInfo)
+{
+    using namespace FluidSimulationSnapshot;
+
+    if (InData.Num() < static_cast<int32>(sizeof(FHeader)))
+    {
+        return false;
+    }
+
+    FHeader Header;
+    FMemory::Memcpy(&Header, InData.GetData(), sizeof(FHeader));
+
+    // The grid size is checked first so the size math below cannot overflow
+    if (Header.Magic != Magic || Header.Version != Version || Header.TileSize != TileSize
+        || Header.SimulationGridSize <= 0 || Header.SimulationGridSize > MaxSimulationGridSize
+        || Header.Solver > static_cast<uint32>(EFluidSimulationSolver::ShallowWater) || Header.RawSize != GetRawSize(Header.SimulationGridSize))
+    {
+        return false;
+    }
+
+    // An uncompressed payload is read in place and must hold every cell, a compressed one only ever shrinks
+    const bool bValidPayloadSize = Header.bCompressed != 0 ? Header.PayloadSize < Header.RawSize : Header.PayloadSize == Header.RawSize;
+    if (!bValidPayloadSize || static_cast<int64>(InData.Num()) < static_cast<int64>(sizeof(FHeader)) + Header.PayloadSize)
+    {
+        return false;
+    }
+
+    OutInfo.SimulationGridSize = Header.SimulationGridSize;
+    OutInfo.Solver = static_cast<EFluidSimulationSolver>(Header.Solver);
+    OutInfo.TimeAccumulator = Header.TimeAccumulator;
+    OutInfo.SimulationTime = Header.SimulationTime;
+    return true;
+}
+
+bool FFluidSimulationSnapshot::Decode(TArrayView<const uint8> InData, const int32 InSimulationGridSize, FFluidSimulationPlanes& OutPlanes, FFluidSimulationSnapshotInfo* OutInfo)
+{
+    using namespace FluidSimulationSnapshot;
+
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationSnapshot_Decode);
+
+    FFluidSimulationSnapshotInfo Info;
+    if (InSimulationGridSize <= 0 || InSimulationGridSize > MaxSimulationGridSize || !ReadInfo(InData, Info))
+    {
+        return false;
+    }
+
+    FHeader Header;
+    FMemory::Memcpy(&Header, InData.GetData(), sizeof(FHeader));
+
+    // An uncompressed payload is read in place, straight from the mapped file or the asset
+    const uint8* Raw = InData.GetData() + sizeof(FHeader);
+    TArray<uint8> Uncompressed;
+
+    if (Header.bCompressed != 0)
+    {
+        Uncompressed.SetNumUninitialized(Header.RawSize);
+
+        if (!FCompression::UncompressMemory(NAME_LZ4, Uncompressed.GetData(), Header.RawSize, Raw, Header.PayloadSize))
+        {
+            UE_LOG(LogNullVisualEffects, Warning, TEXT("Corrupted fluid simulation snapshot, the payload does not decompress."));
+            return false;
+        }
+
+        Raw = Uncompressed.GetData();
+    }
+
+    const int32 SourceGridSize = Info.SimulationGridSize;
+    const TPayload<const uint8> Payload = GetPayload(Raw, SourceGridSize);
+
+    FFluidSimulationPlanes Resampled;
+    FFluidSimulationPlanes& Source = SourceGridSize == InSimulationGridSize ? OutPlanes : Resampled;
+    Source.Init(SourceGridSize * SourceGridSize);
+
+    ParallelFor(FMath::Square(GetNumTilesPerSide(SourceGridSize)), [&](const int32 InTileIndex)
+    {
+        const FIntRect Tile = GetTile(InTileIndex, SourceGridSize);
+
+        FTileRange Range;
+        FMemory::Memcpy(&Range, Payload.Ranges + InTileIndex * sizeof(FTileRange), sizeof(FTileRange));
+
+        for (int32 X = Tile.Min.X; X < Tile.Max.X; ++X)
+        {
+            for (int32 Index = X * SourceGridSize + Tile.Min.Y; Index < X * SourceGridSize + Tile.Max.Y; ++Index)
+            {
+                uint16 VelocityX = 0;
+                uint16 VelocityY = 0;
+                FMemory::Memcpy(&VelocityX, Payload.VelocityX + Index * sizeof(uint16), sizeof(uint16));
+                FMemory::Memcpy(&VelocityY, Payload.VelocityY + Index * sizeof(uint16), sizeof(uint16));
+
+                Source.VelocityX[Index] = Dequantize(VelocityX, Range.VelocityXMin, Range.VelocityXMax, 65535.0f);
+                Source.VelocityY[Index] = Dequantize(VelocityY, Range.VelocityYMin, Range.VelocityYMax, 65535.0f);
+                Source.Density[Index] = Dequantize(Payload.Density[Index], Range.DensityMin, Range.DensityMax, 255.0f);
+            }
+        }
+    });
+
+    if (SourceGridSize != InSimulationGridSize)
+    {
+        // Cell centers of the target grid mapped onto the source grid
+        const float Scale = static_cast<float>(SourceGridSize) / static_cast<float>(InSimulationGridSize);
+        OutPlanes.Init(InSimulationGridSize * InSimulationGridSize);
+
+        ParallelFor(InSimulationGridSize, [&](const int32 InX)
+        {
+            for (int32 Y = 0; Y < InSimulationGridSize; ++Y)
+            {
+                const FVector2D Coords = (FVector2D(InX, Y) + 0.5f) * Scale - 0.5f;
+                const int32 Index = InX * InSimulationGridSize + Y;
+
+                OutPlanes.VelocityX[Index] = SamplePlane(Source.VelocityX, SourceGridSize, Coords);
+                OutPlanes.VelocityY[Index] = SamplePlane(Source.VelocityY, SourceGridSize, Coords);
+                OutPlanes.Density[Index] = SamplePlane(Source.Density, SourceGridSize, Coords);
+            }
+        });
+    }
+
+    if (OutInfo != nullptr)
+    {
+        *OutInfo = Info;
+    }
+
+    return true;
+}
+
+bool FFluidSimulationSnapshot::SaveToFile(TArrayView<const uint8> InData, const FString& InFilename)
+{
+    return InData.Num() > 0 && FFileHelper::SaveArrayToFile(InData, *InFilename);
+}
+
+FFluidSimulationMappedSnapshot::FFluidSimulationMappedSnapshot()
+{
+}
+
+FFluidSimulationMappedSnapshot::~FFluidSimulationMappedSnapshot()
+{
+    // The region must go before the file it maps
+    Region.Reset();
+    Handle.Reset();
+}
+
+bool FFluidSimulationMappedSnapshot::Open(const FString& InFilename)
+{
+    Region.Reset();
+    Handle.Reset();
+    FallbackData.Reset();
+
+    Handle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*InFilename));
+
+    if (Handle.IsValid() && Handle->GetFileSize() > 0)
+    {
+        Region.Reset(Handle->MapRegion(0, Handle->GetFileSize()));
+    }
+
+    if (Region.IsValid())
+    {
+        return true;
+    }
+
+    Handle.Reset();
+    return FFileHelper::LoadFileToArray(FallbackData, *InFilename, FILEREAD_Silent);
+}
+
+TArrayView<const uint8> FFluidSimulationMappedSnapshot::GetData() const
+{
+    if (Region.IsValid())
+    {
+        return TArrayView<const uint8>(Region->GetMappedPtr(), static_cast<int32>(Region->GetMappedSize()));
+    }
+
+    return FallbackData;
+}
@@ -0,0 +1,22 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/FluidSimulationSnapshotAsset.h"
+#include "FluidSimulation/FluidSimulationSnapshot.h"
+
+UFluidSimulationSnapshotAsset::UFluidSimulationSnapshotAsset()
+    : SimulationGridSize(0)
+    , SimulationTime(0.0f)
+    , DataSize(0)
+{
+}
+
+void UFluidSimulationSnapshotAsset::SetData(TArray<uint8>&& InData)
+{
+    Data = MoveTemp(InData);
+    DataSize = Data.Num();
+
+    FFluidSimulationSnapshotInfo Info;
+    const bool bValid = FFluidSimulationSnapshot::ReadInfo(Data, Info);
+    SimulationGridSize = bValid ? Info.SimulationGridSize : 0;
+    SimulationTime = bValid ? static_cast<float>(Info.SimulationTime) : 0.0f;
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/FluidSimulationStats.h"
+
+DEFINE_STAT(STAT_FluidSimulation_Surfaces);
+DEFINE_STAT(STAT_FluidSimulation_Batches);
+DEFINE_STAT(STAT_FluidSimulation_Bodies);
+DEFINE_STAT(STAT_FluidSimulation_Steps);
+DEFINE_STAT(STAT_FluidSimulation_InputRecords);
+DEFINE_STAT(STAT_FluidSimulation_ActiveCells);
+DEFINE_STAT(STAT_FluidSimulation_SamplePoints);
+
+DEFINE_STAT(STAT_FluidSimulation_FieldMemory);
+DEFINE_STAT(STAT_FluidSimulation_ProjectionMemory);
+DEFINE_STAT(STAT_FluidSimulation_ActivityMemory);
+DEFINE_STAT(STAT_FluidSimulation_DetailMemory);
+DEFINE_STAT(STAT_FluidSimulation_UploadMemory);
+DEFINE_STAT(STAT_FluidSimulation_CPUMemory);
+
+UE_TRACE_CHANNEL_DEFINE(FluidSimulationChannel);
\ No newline at end of file
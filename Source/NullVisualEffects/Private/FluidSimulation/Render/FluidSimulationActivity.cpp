@@ -0,0 +1,214 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationActivity.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "FluidSimulation/Render/FluidSimulationActivityCS.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "RHIGPUReadback.h"
+
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationActivity BuildActiveList RT"), STAT_FluidSimulationActivity_BuildActiveList_RenderThread, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationActivity Measure RT"), STAT_FluidSimulationActivity_Measure_RenderThread, STATGROUP_NullVisualEffects);
+
+DECLARE_GPU_STAT_NAMED(FluidSimulationActivity, TEXT("Fluid Simulation Activity"));
+
+namespace FluidSimulationActivity
+{
+    /** Creates a uint buffer in GraphBuilder */
+    static FRDGBufferRef CreateBuffer(FRDGBuilder& GraphBuilder, const int32 InNumElements, const TCHAR* InDebugName)
+    {
+        return GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), FMath::Max(InNumElements, 1)), InDebugName);
+    }
+
+    /** Returns the permutation of a pass */
+    static TShaderMapRef<FFluidSimulationActivityCS> GetShader(const EFluidSimulationActivityPass InPass)
+    {
+        FFluidSimulationActivityCS::FPermutationDomain PermutationVector;
+        PermutationVector.Set<FFluidSimulationActivityCS::FPassDim>(InPass);
+
+        return TShaderMapRef<FFluidSimulationActivityCS>(GetGlobalShaderMap(GMaxRHIFeatureLevel), PermutationVector);
+    }
+}
+
+void FFluidSimulationActivity::Init_RenderThread(const int32 InSimulationGridSize, const int32 InNumSlices, const FFluidSimulationActivitySettings& InSettings, FRHICommandListImmediate& RHICmdList)
+{
+    using namespace FluidSimulationActivity;
+
+    check(IsInRenderingThread());
+
+    SafeRelease();
+
+    SimulationGridSize = InSimulationGridSize;
+    NumSlices = FMath::Max(InNumSlices, 1);
+    TileSize = InSettings.GetTileSize();
+    NumTilesPerSide = FMath::DivideAndRoundUp(SimulationGridSize, TileSize);
+    Threshold = InSettings.Threshold;
+
+    FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationActivity_Init"));
+
+    const FRDGBufferRef TileActivityBuffer = CreateBuffer(GraphBuilder, GetNumTiles(), TEXT("FluidSimulationTileActivity"));
+    const FRDGBufferRef TileListedBuffer = CreateBuffer(GraphBuilder, GetNumTiles(), TEXT("FluidSimulationTileListed"));
+
+    AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(TileActivityBuffer, PF_R32_UINT), 0u);
+    AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(TileListedBuffer, PF_R32_UINT), 0u);
+
+    GraphBuilder.QueueBufferExtraction(TileActivityBuffer, &TileActivity);
+    GraphBuilder.QueueBufferExtraction(TileListedBuffer, &TileListed);
+    GraphBuilder.Execute();
+
+    ActiveTileCount = MakeShared<FReadback, ESPMode::ThreadSafe>();
+    ActiveTileCount->Readback = MakeUnique<FRHIGPUBufferReadback>(TEXT("FluidSimulationActiveTileCount"));
+}
+
+void FFluidSimulationActivity::SafeRelease()
+{
+    TileActivity.SafeRelease();
+    TileListed.SafeRelease();
+    ActiveTileCount.Reset();
+}
+
+uint64 FFluidSimulationActivity::GetAllocatedSize() const
+{
+    return (TileActivity.IsValid() ? TileActivity->Desc.GetTotalNumBytes() : 0) + (TileListed.IsValid() ? TileListed->Desc.GetTotalNumBytes() : 0);
+}
+
+FFluidSimulationActiveTiles FFluidSimulationActivity::BuildActiveList_RenderThread(const int32 InSolveThreadGroupSize, TArrayView<const FFluidSimulationFieldTextures> InFields, FRDGTextureRef InScratchVelocity, FRDGBufferSRVRef InBrushes, const FFluidSimulationUploadBuffer::FAllocation& InAllocation, const FIntPoint& InFieldOrigin, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const
+{
+    using namespace FluidSimulationActivity;
+
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationActivity_BuildActiveList_RenderThread);
+    RDG_EVENT_SCOPE(GraphBuilder, "FluidSimulationActivity_BuildActiveList_RenderThread");
+    RDG_GPU_STAT_SCOPE(GraphBuilder, FluidSimulationActivity);
+
+    FFluidSimulationActiveTiles ActiveTiles;
+
+    if (!IsValid())
+    {
+        return ActiveTiles;
+    }
+
+    const FRDGBufferRef ActiveTileList = CreateBuffer(GraphBuilder, GetNumTiles(), TEXT("FluidSimulationActiveTileList"));
+    const FRDGBufferRef RetiredTileList = CreateBuffer(GraphBuilder, GetNumTiles(), TEXT("FluidSimulationRetiredTileList"));
+
+    ActiveTiles.IndirectArgs = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateIndirectDesc(NumArgs), TEXT("FluidSimulationActivityArgs"));
+    ActiveTiles.ActiveTileList = GraphBuilder.CreateSRV(ActiveTileList, PF_R32_UINT);
+    ActiveTiles.TileActivity = GraphBuilder.RegisterExternalBuffer(TileActivity, TEXT("FluidSimulationTileActivity"));
+
+    const FRDGBufferRef TileListedBuffer = GraphBuilder.RegisterExternalBuffer(TileListed, TEXT("FluidSimulationTileListed"));
+    const FRDGBufferUAVRef IndirectArgsUAV = GraphBuilder.CreateUAV(ActiveTiles.IndirectArgs, PF_R32_UINT);
+    const int32 BlocksPerSide = TileSize / InSolveThreadGroupSize;
+
+    // Reset the dispatch arguments
+    {
+        FFluidSimulationActivityCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationActivityCS::FParameters>();
+        Params->IndirectArgs = IndirectArgsUAV;
+
+        FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ResetArgs"), InPassFlags, GetShader(EFluidSimulationActivityPass::ResetArgs), Params, FIntVector(1, 1, 1));
+    }
+
+    // Append the active and retired tiles of every slice
+    {
+        FFluidSimulationActivityCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationActivityCS::FParameters>();
+        Params->IndirectArgs = IndirectArgsUAV;
+        Params->TileActivity = GraphBuilder.CreateUAV(ActiveTiles.TileActivity, PF_R32_UINT);
+        Params->TileListed = GraphBuilder.CreateUAV(TileListedBuffer, PF_R32_UINT);
+        Params->ActiveTileList = GraphBuilder.CreateUAV(ActiveTileList, PF_R32_UINT);
+        Params->RetiredTileList = GraphBuilder.CreateUAV(RetiredTileList, PF_R32_UINT);
+        Params->Brushes = InBrushes;
+        Params->BrushOffset = InAllocation.Offset;
+        Params->NumBrushes = InAllocation.Num;
+        Params->SimulationGridSize = SimulationGridSize;
+        Params->ActivityTileSize = TileSize;
+        Params->NumTilesPerSide = NumTilesPerSide;
+        Params->NumSolveBlocks = BlocksPerSide * BlocksPerSide;
+        Params->Threshold = Threshold;
+
+        FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("BuildList"), InPassFlags, GetShader(EFluidSimulationActivityPass::BuildList), Params, FComputeShaderUtils::GetGroupCount(FIntVector(NumTilesPerSide, NumTilesPerSide, NumSlices), FIntVector(FFluidSimulationActivityCS::ThreadGroupSize, FFluidSimulationActivityCS::ThreadGroupSize, 1)));
+    }
+
+    // Retired tiles are cleared in the whole ring, the scratch velocity pairs with any field density as those are cleared anyway
+    const FRDGBufferSRVRef RetiredTileListSRV = GraphBuilder.CreateSRV(RetiredTileList, PF_R32_UINT);
+    for (int32 Index = 0; Index <= InFields.Num(); ++Index)
+    {
+        const bool bScratch = Index == InFields.Num();
+        if (bScratch && (InScratchVelocity == nullptr || InFields.Num() == 0))
+        {
+            break;
+        }
+
+        FFluidSimulationActivityCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationActivityCS::FParameters>();
+        Params->TileList = RetiredTileListSRV;
+        Params->OutputVelocity = GraphBuilder.CreateUAV(bScratch ? InScratchVelocity : InFields[Index].Velocity);
+        Params->OutputDensity = GraphBuilder.CreateUAV(bScratch ? InFields[0].Density : InFields[Index].Density);
+        Params->SimulationGridSize = SimulationGridSize;
+        Params->ActivityTileSize = TileSize;
+        Params->FieldOrigin = InFieldOrigin;
+        Params->IndirectDispatchArgs = ActiveTiles.IndirectArgs;
+
+        FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ClearRetired"), InPassFlags, GetShader(EFluidSimulationActivityPass::ClearRetired), Params, ActiveTiles.IndirectArgs, ClearArgsOffset * sizeof(uint32));
+    }
+
+    return ActiveTiles;
+}
+
+void FFluidSimulationActivity::Measure_RenderThread(const FFluidSimulationActiveTiles& InActiveTiles, const FFluidSimulationFieldTextures& InField, const FIntPoint& InFieldOrigin, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const
+{
+    using namespace FluidSimulationActivity;
+
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationActivity_Measure_RenderThread);
+    RDG_EVENT_SCOPE(GraphBuilder, "FluidSimulationActivity_Measure_RenderThread");
+    RDG_GPU_STAT_SCOPE(GraphBuilder, FluidSimulationActivity);
+
+    if (!IsValid() || InActiveTiles.IndirectArgs == nullptr || InField.Velocity == nullptr || InField.Density == nullptr)
+    {
+        return;
+    }
+
+    FFluidSimulationActivityCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationActivityCS::FParameters>();
+    Params->TileActivity = GraphBuilder.CreateUAV(InActiveTiles.TileActivity, PF_R32_UINT);
+    Params->TileList = InActiveTiles.ActiveTileList;
+    Params->FieldVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InField.Velocity));
+    Params->FieldDensity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InField.Density));
+    Params->SimulationGridSize = SimulationGridSize;
+    Params->ActivityTileSize = TileSize;
+    Params->NumTilesPerSide = NumTilesPerSide;
+    Params->Threshold = Threshold;
+    Params->FieldOrigin = InFieldOrigin;
+    Params->IndirectDispatchArgs = InActiveTiles.IndirectArgs;
+
+    FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("Measure"), InPassFlags, GetShader(EFluidSimulationActivityPass::Measure), Params, InActiveTiles.IndirectArgs, MeasureArgsOffset * sizeof(uint32));
+
+    // Only one copy in flight, the count lags a few frames behind which is fine for stats
+    FReadback& Readback = *ActiveTileCount;
+    if (Readback.bPending && Readback.Readback->IsReady())
+    {
+        const uint32* const Count = static_cast<const uint32*>(Readback.Readback->Lock(sizeof(uint32)));
+        Readback.NumActiveTiles.Set(static_cast<int32>(Count[SolveArgsOffset]));
+        Readback.Readback->Unlock();
+        Readback.bPending = false;
+    }
+
+    if (!Readback.bPending)
+    {
+        AddEnqueueCopyPass(GraphBuilder, Readback.Readback.Get(), InActiveTiles.IndirectArgs, sizeof(uint32));
+        Readback.bPending = true;
+    }
+}
+
+void FFluidSimulationActivity::ActivateAll_RenderThread(FRDGBuilder& GraphBuilder) const
+{
+    check(IsInRenderingThread());
+
+    if (IsValid())
+    {
+        // The next build dilates the flags and lists every tile, the measure pass retires the still ones
+        AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(GraphBuilder.RegisterExternalBuffer(TileActivity, TEXT("FluidSimulationTileActivity")), PF_R32_UINT), 1u);
+    }
+}
+
+int32 FFluidSimulationActivity::GetNumActiveTiles() const
+{
+    return ActiveTileCount.IsValid() ? ActiveTileCount->NumActiveTiles.GetValue() : 0;
+}
\ No newline at end of file
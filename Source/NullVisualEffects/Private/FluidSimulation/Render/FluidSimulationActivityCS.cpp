@@ -0,0 +1,5 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationActivityCS.h"
+
+IMPLEMENT_GLOBAL_SHADER(FFluidSimulationActivityCS, "/NullVisualEffects/FluidSimulation/FluidSimulationActivityCS.usf", "MainCS", SF_Compute);
\ No newline at end of file
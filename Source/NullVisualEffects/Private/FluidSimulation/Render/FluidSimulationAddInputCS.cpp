@@ -1,5 +0,0 @@
-// Copyright (C) Ronaldo Veloso. All Rights Reserved.
-
-#include "FluidSimulation/Render/FluidSimulationAddInputCS.h"
-
-IMPLEMENT_GLOBAL_SHADER(FFluidSimulationAddInputCS, "/NullVisualEffects/FluidSimulation/FluidSimulationAddInputCS.usf", "MainCS", SF_Compute);
\ No newline at end of file
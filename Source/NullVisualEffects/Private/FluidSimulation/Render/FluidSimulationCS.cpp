@@ -1,5 +1,19 @@
 // Copyright (C) Ronaldo Veloso. All Rights Reserved.
 
 #include "FluidSimulation/Render/FluidSimulationCS.h"
+#include "HAL/IConsoleManager.h"
 
-IMPLEMENT_GLOBAL_SHADER(FFluidSimulationCS, "/NullVisualEffects/FluidSimulation/FluidSimulationCS.usf", "MainCS", SF_Compute);
\ No newline at end of file
+static TAutoConsoleVariable<int32> CVarFluidSimulationThreadGroupSize
+(
+    TEXT("r.FluidSimulation.ThreadGroupSize"),
+    8,
+    TEXT("Thread group side of the fluid solver, 8 (8x8) or 16 (16x16)."),
+    ECVF_RenderThreadSafe
+);
+
+IMPLEMENT_GLOBAL_SHADER(FFluidSimulationCS, "/NullVisualEffects/FluidSimulation/FluidSimulationCS.usf", "MainCS", SF_Compute);
+
+int32 FFluidSimulationCS::GetThreadGroupSize()
+{
+    return CVarFluidSimulationThreadGroupSize.GetValueOnRenderThread() >= 16 ? 16 : 8;
+}
\ No newline at end of file
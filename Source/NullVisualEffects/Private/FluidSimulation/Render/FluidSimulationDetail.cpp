@@ -0,0 +1,274 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationDetail.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "FluidSimulation/Render/FluidSimulationActivity.h"
+#include "FluidSimulation/Render/FluidSimulationDetailCS.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationDetail Prolongate RT"), STAT_FluidSimulationDetail_Prolongate_RenderThread, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationDetail Restrict RT"), STAT_FluidSimulationDetail_Restrict_RenderThread, STATGROUP_NullVisualEffects);
+
+DECLARE_GPU_STAT_NAMED(FluidSimulationDetail, TEXT("Fluid Simulation Detail"));
+
+namespace FluidSimulationDetail
+{
+    /** Fraction of a patch side a brush keeps from its edges to stay in the patch, closer ones get a patch of their own */
+    static constexpr float PatchMargin = 0.25f;
+
+    /** Returns the permutation of a pass */
+    static TShaderMapRef<FFluidSimulationDetailCS> GetShader(const EFluidSimulationDetailPass InPass, const bool bInActiveTiles)
+    {
+        FFluidSimulationDetailCS::FPermutationDomain PermutationVector;
+        PermutationVector.Set<FFluidSimulationDetailCS::FPassDim>(InPass);
+        PermutationVector.Set<FFluidSimulationDetailCS::FActiveTilesDim>(bInActiveTiles);
+
+        return TShaderMapRef<FFluidSimulationDetailCS>(GetGlobalShaderMap(GMaxRHIFeatureLevel), PermutationVector);
+    }
+}
+
+void FFluidSimulationDetail::Init_RenderThread(const FFluidSimulationDetailSettings& InSettings, const int32 InNumFieldBuffers, const EFluidSimulationFieldPrecision InFieldPrecision, const bool bInProjection, FRHICommandListImmediate& RHICmdList)
+{
+    check(IsInRenderingThread());
+
+    SafeRelease();
+
+    PatchGridSize = InSettings.GetPatchGridSize();
+    RefinementRatio = InSettings.GetRefinementRatio();
+    CurrentFieldIndex = 0;
+    Patches.SetNum(InSettings.GetMaxPatches());
+
+    Fields.SetNum(InNumFieldBuffers);
+
+    for (FFluidSimulationField& Field : Fields)
+    {
+        Field.Init_RenderThread(PatchGridSize, Patches.Num(), InFieldPrecision, RHICmdList);
+    }
+
+    if (bInProjection)
+    {
+        Projection.Init_RenderThread(PatchGridSize, Patches.Num(), InFieldPrecision, RHICmdList);
+    }
+}
+
+void FFluidSimulationDetail::SafeRelease()
+{
+    for (FFluidSimulationField& Field : Fields)
+    {
+        Field.SafeRelease();
+    }
+
+    Fields.Reset();
+    Projection.SafeRelease();
+    Patches.Reset();
+}
+
+uint64 FFluidSimulationDetail::GetAllocatedSize() const
+{
+    uint64 Size = Projection.GetAllocatedSize();
+
+    for (const FFluidSimulationField& Field : Fields)
+    {
+        Size += Field.GetAllocatedSize();
+    }
+
+    return Size;
+}
+
+bool FFluidSimulationDetail::HasLivePatches() const
+{
+    return Patches.ContainsByPredicate([](const FFluidSimulationDetailPatch& InPatch) { return InPatch.IsLive(); });
+}
+
+void FFluidSimulationDetail::UpdatePatches(TArrayView<const FFluidSimulationBrush> InBrushes, const int32 InSimulationGridSize, const float InLifetime, const float InDeltaTime)
+{
+    using namespace FluidSimulationDetail;
+
+    const int32 PatchCoarseSize = GetPatchCoarseSize();
+    if (PatchCoarseSize <= 0 || PatchCoarseSize > InSimulationGridSize)
+    {
+        return;
+    }
+
+    for (FFluidSimulationDetailPatch& Patch : Patches)
+    {
+        Patch.Lifetime = FMath::Max(Patch.Lifetime - InDeltaTime, 0.0f);
+    }
+
+    const float Margin = PatchCoarseSize * PatchMargin;
+    const float Lifetime = FMath::Max(InLifetime, KINDA_SMALL_NUMBER);
+
+    for (const FFluidSimulationBrush& Brush : InBrushes)
+    {
+        const int32 Slice = static_cast<int32>(Brush.Slice);
+
+        FFluidSimulationDetailPatch* const Covering = Patches.FindByPredicate([&](const FFluidSimulationDetailPatch& InPatch)
+        {
+            const FVector2D Local = Brush.Center - FVector2D(InPatch.Origin);
+            return InPatch.IsLive() && InPatch.Slice == Slice && Local.X >= Margin && Local.Y >= Margin && Local.X < PatchCoarseSize - Margin && Local.Y < PatchCoarseSize - Margin;
+        });
+
+        if (Covering != nullptr)
+        {
+            Covering->Lifetime = Lifetime;
+            continue;
+        }
+
+        // Bodies past the pool keep the grid resolution until a patch is freed
+        FFluidSimulationDetailPatch* const Free = Patches.FindByPredicate([](const FFluidSimulationDetailPatch& InPatch) { return !InPatch.IsLive(); });
+        if (Free == nullptr)
+        {
+            continue;
+        }
+
+        Free->Origin.X = FMath::Clamp(FMath::RoundToInt(Brush.Center.X - PatchCoarseSize * 0.5f), 0, InSimulationGridSize - PatchCoarseSize);
+        Free->Origin.Y = FMath::Clamp(FMath::RoundToInt(Brush.Center.Y - PatchCoarseSize * 0.5f), 0, InSimulationGridSize - PatchCoarseSize);
+        Free->Slice = Slice;
+        Free->Lifetime = Lifetime;
+        Free->bNeedsInit = true;
+    }
+}
+
+void FFluidSimulationDetail::GetPatchBrushes(TArrayView<const FFluidSimulationBrush> InBrushes, TArray<FFluidSimulationBrush>& OutBrushes) const
+{
+    const float PatchCoarseSize = static_cast<float>(GetPatchCoarseSize());
+    const float Ratio = static_cast<float>(RefinementRatio);
+
+    for (int32 PatchIndex = 0; PatchIndex < Patches.Num(); ++PatchIndex)
+    {
+        const FFluidSimulationDetailPatch& Patch = Patches[PatchIndex];
+        if (!Patch.IsLive())
+        {
+            continue;
+        }
+
+        const FVector2D Origin(Patch.Origin);
+
+        for (const FFluidSimulationBrush& Brush : InBrushes)
+        {
+            const FVector2D Min = FVector2D(FMath::Min(Brush.Center.X, Brush.PreviousCenter.X), FMath::Min(Brush.Center.Y, Brush.PreviousCenter.Y)) - FVector2D(Brush.Radius, Brush.Radius) - Origin;
+            const FVector2D Max = FVector2D(FMath::Max(Brush.Center.X, Brush.PreviousCenter.X), FMath::Max(Brush.Center.Y, Brush.PreviousCenter.Y)) + FVector2D(Brush.Radius, Brush.Radius) - Origin;
+
+            if (static_cast<int32>(Brush.Slice) != Patch.Slice || Max.X <= 0.0f || Max.Y <= 0.0f || Min.X >= PatchCoarseSize || Min.Y >= PatchCoarseSize)
+            {
+                continue;
+            }
+
+            FFluidSimulationBrush& PatchBrush = OutBrushes.Add_GetRef(Brush);
+            PatchBrush.Center = (Brush.Center - Origin) * Ratio;
+            PatchBrush.PreviousCenter = (Brush.PreviousCenter - Origin) * Ratio;
+            PatchBrush.Radius = Brush.Radius * Ratio;
+            PatchBrush.Slice = static_cast<uint32>(PatchIndex);
+        }
+    }
+}
+
+void FFluidSimulationDetail::Translate(const FIntPoint& InDelta, const int32 InSimulationGridSize)
+{
+    const int32 PatchCoarseSize = GetPatchCoarseSize();
+
+    for (FFluidSimulationDetailPatch& Patch : Patches)
+    {
+        Patch.Origin -= InDelta;
+
+        // The grid cells the patch covered are gone, it would be driven by still water
+        if (Patch.Origin.X < 0 || Patch.Origin.Y < 0 || Patch.Origin.X + PatchCoarseSize > InSimulationGridSize || Patch.Origin.Y + PatchCoarseSize > InSimulationGridSize)
+        {
+            Patch.Lifetime = 0.0f;
+        }
+    }
+}
+
+void FFluidSimulationDetail::ResetPatches()
+{
+    for (FFluidSimulationDetailPatch& Patch : Patches)
+    {
+        Patch.bNeedsInit = Patch.IsLive();
+    }
+}
+
+int32 FFluidSimulationDetail::GetNumSubsteps(const EFluidSimulationSolver InSolver, const FFluidSimulationShallowWaterSettings& InShallowWaterSettings, const float InDeltaTime) const
+{
+    if (InSolver != EFluidSimulationSolver::ShallowWater)
+    {
+        return 1;
+    }
+
+    // Same Courant limit as FFluidSimulationShallowWaterSettings::GetCourantNumber
+    return FMath::Clamp(FMath::CeilToInt(InShallowWaterSettings.WaveSpeed * RefinementRatio * InDeltaTime / 0.7f), 1, RefinementRatio);
+}
+
+FIntVector4 FFluidSimulationDetail::GetPatchParameters(const int32 InIndex, const bool bInBorders, const bool bInPlace) const
+{
+    if (!Patches.IsValidIndex(InIndex) || !Patches[InIndex].IsLive())
+    {
+        return FIntVector4(0, 0, 0, 0);
+    }
+
+    const FFluidSimulationDetailPatch& Patch = Patches[InIndex];
+    const bool bPlace = bInPlace && Patch.bNeedsInit;
+    const int32 Flags = (bInBorders || bPlace ? FFluidSimulationDetailCS::PatchLive : 0) | (bPlace ? FFluidSimulationDetailCS::PatchFull : 0);
+
+    return FIntVector4(Patch.Origin.X, Patch.Origin.Y, Patch.Slice, Flags);
+}
+
+void FFluidSimulationDetail::Prolongate_RenderThread(const FFluidSimulationFieldTextures& InGrid, const int32 InSimulationGridSize, const FIntPoint& InFieldOrigin, const FFluidSimulationFieldTextures& InField, const bool bInBorders, const bool bInPlace, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const
+{
+    using namespace FluidSimulationDetail;
+
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationDetail_Prolongate_RenderThread);
+    RDG_GPU_STAT_SCOPE(GraphBuilder, FluidSimulationDetail);
+
+    FFluidSimulationDetailCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationDetailCS::FParameters>();
+    Params->SourceVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InGrid.Velocity));
+    Params->SourceDensity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InGrid.Density));
+    Params->OutFluidVelocity = GraphBuilder.CreateUAV(InField.Velocity);
+    Params->OutFluidDensity = GraphBuilder.CreateUAV(InField.Density);
+    Params->SimulationGridSize = InSimulationGridSize;
+    Params->FieldOrigin = InFieldOrigin;
+    Params->PatchGridSize = PatchGridSize;
+    Params->RefinementRatio = RefinementRatio;
+
+    for (int32 Index = 0; Index < FFluidSimulationDetailCS::MaxPatches; ++Index)
+    {
+        Params->Patches[Index] = GetPatchParameters(Index, bInBorders, bInPlace);
+    }
+
+    const FIntVector GroupCount = FComputeShaderUtils::GetGroupCount(FIntVector(PatchGridSize, PatchGridSize, Patches.Num()), FIntVector(FFluidSimulationDetailCS::ThreadGroupSize, FFluidSimulationDetailCS::ThreadGroupSize, 1));
+    FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSimulationDetailProlongate %dx%dx%d", PatchGridSize, PatchGridSize, Patches.Num()), InPassFlags, GetShader(EFluidSimulationDetailPass::Prolongate, false), Params, GroupCount);
+}
+
+void FFluidSimulationDetail::Restrict_RenderThread(const FFluidSimulationFieldTextures& InField, const int32 InSimulationGridSize, const FIntPoint& InFieldOrigin, const FFluidSimulationActivity& InActivity, const FFluidSimulationFieldTextures& InOutGrid, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const
+{
+    using namespace FluidSimulationDetail;
+
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationDetail_Restrict_RenderThread);
+    RDG_GPU_STAT_SCOPE(GraphBuilder, FluidSimulationDetail);
+
+    const bool bActiveTiles = InActivity.IsValid();
+
+    FFluidSimulationDetailCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationDetailCS::FParameters>();
+    Params->SourceVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InField.Velocity));
+    Params->SourceDensity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InField.Density));
+    Params->OutFluidVelocity = GraphBuilder.CreateUAV(InOutGrid.Velocity);
+    Params->OutFluidDensity = GraphBuilder.CreateUAV(InOutGrid.Density);
+    Params->TileListed = bActiveTiles ? GraphBuilder.CreateSRV(GraphBuilder.RegisterExternalBuffer(InActivity.TileListed, TEXT("FluidSimulationTileListed")), PF_R32_UINT) : nullptr;
+    Params->SimulationGridSize = InSimulationGridSize;
+    Params->FieldOrigin = InFieldOrigin;
+    Params->PatchGridSize = PatchGridSize;
+    Params->RefinementRatio = RefinementRatio;
+    Params->ActivityTileSize = InActivity.TileSize;
+    Params->NumTilesPerSide = InActivity.NumTilesPerSide;
+
+    for (int32 Index = 0; Index < FFluidSimulationDetailCS::MaxPatches; ++Index)
+    {
+        Params->Patches[Index] = GetPatchParameters(Index, true, false);
+    }
+
+    const int32 PatchCoarseSize = GetPatchCoarseSize();
+    const FIntVector GroupCount = FComputeShaderUtils::GetGroupCount(FIntVector(PatchCoarseSize, PatchCoarseSize, Patches.Num()), FIntVector(FFluidSimulationDetailCS::ThreadGroupSize, FFluidSimulationDetailCS::ThreadGroupSize, 1));
+    FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSimulationDetailRestrict %dx%dx%d", PatchCoarseSize, PatchCoarseSize, Patches.Num()), InPassFlags, GetShader(EFluidSimulationDetailPass::Restrict, bActiveTiles), Params, GroupCount);
+}
\ No newline at end of file
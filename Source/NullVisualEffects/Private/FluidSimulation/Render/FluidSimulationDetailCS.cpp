@@ -0,0 +1,5 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationDetailCS.h"
+
+IMPLEMENT_GLOBAL_SHADER(FFluidSimulationDetailCS, "/NullVisualEffects/FluidSimulation/FluidSimulationDetailCS.usf", "MainCS", SF_Compute);
\ No newline at end of file
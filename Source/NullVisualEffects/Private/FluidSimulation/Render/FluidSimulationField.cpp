@@ -0,0 +1,69 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationField.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+
+void FFluidSimulationField::Init_RenderThread(const int32 InSimulationGridSize, const int32 InNumSlices, const EFluidSimulationFieldPrecision InPrecision, FRHICommandListImmediate& RHICmdList)
+{
+    check(IsInRenderingThread());
+
+    SafeRelease();
+
+    FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationField_Init"));
+
+    const FRDGTextureRef VelocityTexture = CreateTexture(GraphBuilder, InSimulationGridSize, InNumSlices, GetVelocityFormat(InPrecision), TEXT("FluidSimulationVelocity"));
+    const FRDGTextureRef DensityTexture = CreateTexture(GraphBuilder, InSimulationGridSize, InNumSlices, GetDensityFormat(InPrecision), TEXT("FluidSimulationDensity"));
+
+    AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(VelocityTexture), FLinearColor::Transparent);
+    AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(DensityTexture), FLinearColor::Transparent);
+
+    GraphBuilder.QueueTextureExtraction(VelocityTexture, &Velocity);
+    GraphBuilder.QueueTextureExtraction(DensityTexture, &Density);
+    GraphBuilder.Execute();
+}
+
+void FFluidSimulationField::SafeRelease()
+{
+    Velocity.SafeRelease();
+    Density.SafeRelease();
+}
+
+uint64 FFluidSimulationField::GetAllocatedSize() const
+{
+    return (Velocity.IsValid() ? Velocity->ComputeMemorySize() : 0) + (Density.IsValid() ? Density->ComputeMemorySize() : 0);
+}
+
+FFluidSimulationFieldTextures FFluidSimulationField::Register(FRDGBuilder& GraphBuilder) const
+{
+    FFluidSimulationFieldTextures Textures;
+    Textures.Velocity = GraphBuilder.RegisterExternalTexture(Velocity, TEXT("FluidSimulationVelocity"));
+    Textures.Density = GraphBuilder.RegisterExternalTexture(Density, TEXT("FluidSimulationDensity"));
+    return Textures;
+}
+
+FRDGTextureRef FFluidSimulationField::CreateTexture(FRDGBuilder& GraphBuilder, const int32 InSize, const int32 InNumSlices, const EPixelFormat InFormat, const TCHAR* InDebugName)
+{
+    const FRDGTextureDesc Desc = FRDGTextureDesc::Create2DArray(FIntPoint(InSize, InSize), InFormat, FClearValueBinding::Black, TexCreate_ShaderResource | TexCreate_UAV, static_cast<uint16>(FMath::Max(InNumSlices, 1)));
+    return GraphBuilder.CreateTexture(Desc, InDebugName);
+}
+
+EPixelFormat FFluidSimulationField::GetVelocityFormat(const EFluidSimulationFieldPrecision InPrecision)
+{
+    return InPrecision == EFluidSimulationFieldPrecision::Full ? PF_G32R32F : PF_G16R16F;
+}
+
+EPixelFormat FFluidSimulationField::GetDensityFormat(const EFluidSimulationFieldPrecision InPrecision)
+{
+    switch (InPrecision)
+    {
+    case EFluidSimulationFieldPrecision::Half:
+        return PF_R16F;
+
+    case EFluidSimulationFieldPrecision::Packed:
+        return PF_R8;
+
+    default:
+        return PF_R32_FLOAT;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,256 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationProjection.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "FluidSimulation/Render/FluidSimulationActivity.h"
+#include "FluidSimulation/Render/FluidSimulationProjectionCS.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationProjection Project RT"), STAT_FluidSimulationProjection_Project_RenderThread, STATGROUP_NullVisualEffects);
+
+DECLARE_GPU_STAT_NAMED(FluidSimulationProjection, TEXT("Fluid Simulation Projection"));
+
+namespace FluidSimulationProjection
+{
+    /** Coarsening stops once a level is this small, must match FFluidSimulationCPUMultigrid */
+    static constexpr int32 MinLevelSize = 8;
+
+    /** Sweeps on the coarsest level, must match FFluidSimulationCPUMultigrid */
+    static constexpr int32 CoarsestIterations = 16;
+
+    /** Adds a projection pass over a InSize x InSize level of every slice */
+    static void AddPass(FRDGBuilder& GraphBuilder, const EFluidSimulationProjectionPass InPass, FFluidSimulationProjectionCS::FParameters* InParameters, const int32 InSize, const int32 InNumSlices, const ERDGPassFlags InPassFlags)
+    {
+        FFluidSimulationProjectionCS::FPermutationDomain PermutationVector;
+        PermutationVector.Set<FFluidSimulationProjectionCS::FPassDim>(InPass);
+        PermutationVector.Set<FFluidSimulationProjectionCS::FActiveTilesDim>(InParameters->TileListed != nullptr);
+
+        TShaderMapRef<FFluidSimulationProjectionCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel), PermutationVector);
+        FIntVector GroupCount = FComputeShaderUtils::GetGroupCount(FIntVector(InSize, InSize, InNumSlices), FIntVector(FFluidSimulationProjectionCS::ThreadGroupSize, FFluidSimulationProjectionCS::ThreadGroupSize, 1));
+        FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSimulationProjection %d %dx%dx%d", static_cast<int32>(InPass), InSize, InSize, InNumSlices), InPassFlags, ComputeShader, InParameters, GroupCount);
+    }
+
+    /** Returns new pass parameters for a level, outputs and sources are left to the pass */
+    static FFluidSimulationProjectionCS::FParameters* AllocLevelParameters(FRDGBuilder& GraphBuilder, const FFluidSimulationProjection::FLevel& InLevel)
+    {
+        FFluidSimulationProjectionCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationProjectionCS::FParameters>();
+        Params->LevelSize = InLevel.Size;
+        Params->SourceLevelSize = InLevel.Size;
+        Params->CellSizeSquared = InLevel.CellSizeSquared;
+        Params->Color = 0;
+        Params->FieldOrigin = FIntPoint::ZeroValue;
+        Params->TileListed = nullptr;
+        Params->ActivityTileSize = 0;
+        Params->NumTilesPerSide = 0;
+        return Params;
+    }
+
+    /** Creates a single channel full precision level texture array */
+    static FRDGTextureRef CreateLevelTexture(FRDGBuilder& GraphBuilder, const int32 InSize, const int32 InNumSlices, const TCHAR* InDebugName)
+    {
+        // The pressure solve always runs in full precision, half floats are not enough for the residuals
+        return FFluidSimulationField::CreateTexture(GraphBuilder, InSize, InNumSlices, PF_R32_FLOAT, InDebugName);
+    }
+}
+
+void FFluidSimulationProjection::Init_RenderThread(const int32 InSimulationGridSize, const int32 InNumSlices, const EFluidSimulationFieldPrecision InPrecision, FRHICommandListImmediate& RHICmdList)
+{
+    using namespace FluidSimulationProjection;
+
+    check(IsInRenderingThread());
+
+    SafeRelease();
+
+    if (InSimulationGridSize <= 0)
+    {
+        return;
+    }
+
+    NumSlices = FMath::Max(InNumSlices, 1);
+
+    int32 Size = InSimulationGridSize;
+    float CellSize = 1.0f;
+
+    while (Size > 0)
+    {
+        FLevel& Level = Levels.AddDefaulted_GetRef();
+        Level.Size = Size;
+        Level.CellSizeSquared = CellSize * CellSize;
+
+        if (Size <= MinLevelSize)
+        {
+            break;
+        }
+
+        Size = (Size + 1) / 2;
+        CellSize *= 2.0f;
+    }
+
+    FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationProjection_Init"));
+
+    const FRDGTextureRef PressureTexture = CreateLevelTexture(GraphBuilder, InSimulationGridSize, NumSlices, TEXT("FluidSimulationPressure"));
+    const FRDGTextureRef ScratchVelocityTexture = FFluidSimulationField::CreateTexture(GraphBuilder, InSimulationGridSize, NumSlices, FFluidSimulationField::GetVelocityFormat(InPrecision), TEXT("FluidSimulationScratchVelocity"));
+
+    AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(PressureTexture), FLinearColor::Transparent);
+    AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(ScratchVelocityTexture), FLinearColor::Transparent);
+
+    GraphBuilder.QueueTextureExtraction(PressureTexture, &Pressure);
+    GraphBuilder.QueueTextureExtraction(ScratchVelocityTexture, &ScratchVelocity);
+    GraphBuilder.Execute();
+}
+
+void FFluidSimulationProjection::SafeRelease()
+{
+    Levels.Empty();
+    Pressure.SafeRelease();
+    ScratchVelocity.SafeRelease();
+}
+
+uint64 FFluidSimulationProjection::GetAllocatedSize() const
+{
+    return (Pressure.IsValid() ? Pressure->ComputeMemorySize() : 0) + (ScratchVelocity.IsValid() ? ScratchVelocity->ComputeMemorySize() : 0);
+}
+
+void FFluidSimulationProjection::Project_RenderThread(const FFluidSimulationProjectionSettings& InSettings, FRDGTextureRef InScratchVelocity, FRDGTextureRef InOutputVelocity, const FIntPoint& InFieldOrigin, const FFluidSimulationActivity& InActivity, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const
+{
+    using namespace FluidSimulationProjection;
+
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationProjection_Project_RenderThread);
+    RDG_EVENT_SCOPE(GraphBuilder, "FluidSimulationProjection_Project_RenderThread");
+    RDG_GPU_STAT_SCOPE(GraphBuilder, FluidSimulationProjection);
+
+    if (!IsValid() || InScratchVelocity == nullptr || InOutputVelocity == nullptr)
+    {
+        return;
+    }
+
+    TArray<FLevelTextures, TInlineAllocator<8>> Textures;
+    Textures.SetNum(Levels.Num());
+
+    for (int32 LevelIndex = 0; LevelIndex < Levels.Num(); ++LevelIndex)
+    {
+        const int32 Size = Levels[LevelIndex].Size;
+        Textures[LevelIndex].Pressure = LevelIndex == 0 ? GraphBuilder.RegisterExternalTexture(Pressure, TEXT("FluidSimulationPressure")) : CreateLevelTexture(GraphBuilder, Size, NumSlices, TEXT("FluidSimulationPressure"));
+        Textures[LevelIndex].RightHandSide = CreateLevelTexture(GraphBuilder, Size, NumSlices, TEXT("FluidSimulationRightHandSide"));
+        Textures[LevelIndex].Residual = CreateLevelTexture(GraphBuilder, Size, NumSlices, TEXT("FluidSimulationResidual"));
+    }
+
+    const FLevel& Finest = Levels[0];
+    const FRDGTextureSRVRef ScratchVelocitySRV = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InScratchVelocity));
+
+    // Skipped tiles are at rest and nothing measures them, the gradient must not write velocity into them
+    const FRDGBufferSRVRef TileListedSRV = InActivity.IsValid() ? GraphBuilder.CreateSRV(GraphBuilder.RegisterExternalBuffer(InActivity.TileListed, TEXT("FluidSimulationTileListed")), PF_R32_UINT) : nullptr;
+
+    // Divergence of the scratch velocity is the right hand side of the pressure equation
+    {
+        FFluidSimulationProjectionCS::FParameters* Params = AllocLevelParameters(GraphBuilder, Finest);
+        Params->InputVelocity = ScratchVelocitySRV;
+        Params->OutputField = GraphBuilder.CreateUAV(Textures[0].RightHandSide);
+        Params->FieldOrigin = InFieldOrigin;
+        Params->TileListed = TileListedSRV;
+        Params->ActivityTileSize = InActivity.TileSize;
+        Params->NumTilesPerSide = InActivity.NumTilesPerSide;
+
+        AddPass(GraphBuilder, EFluidSimulationProjectionPass::Divergence, Params, Finest.Size, NumSlices, InPassFlags);
+    }
+
+    const int32 NumCycles = FMath::Max(InSettings.NumCycles, 1);
+    const int32 SmoothingIterations = FMath::Max(InSettings.NumSmoothingIterations, 1);
+
+    for (int32 Cycle = 0; Cycle < NumCycles; ++Cycle)
+    {
+        VCycle_RenderThread(Textures, 0, SmoothingIterations, InPassFlags, GraphBuilder);
+    }
+
+    // Subtract the pressure gradient
+    {
+        FFluidSimulationProjectionCS::FParameters* Params = AllocLevelParameters(GraphBuilder, Finest);
+        Params->InputVelocity = ScratchVelocitySRV;
+        Params->OutputVelocity = GraphBuilder.CreateUAV(InOutputVelocity);
+        Params->Pressure = GraphBuilder.CreateUAV(Textures[0].Pressure);
+        Params->FieldOrigin = InFieldOrigin;
+        Params->TileListed = TileListedSRV;
+        Params->ActivityTileSize = InActivity.TileSize;
+        Params->NumTilesPerSide = InActivity.NumTilesPerSide;
+
+        AddPass(GraphBuilder, EFluidSimulationProjectionPass::SubtractGradient, Params, Finest.Size, NumSlices, InPassFlags);
+    }
+}
+
+void FFluidSimulationProjection::VCycle_RenderThread(TArrayView<const FLevelTextures> InTextures, const int32 InLevelIndex, const int32 InSmoothingIterations, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const
+{
+    using namespace FluidSimulationProjection;
+
+    const FLevel& Level = Levels[InLevelIndex];
+    const FLevelTextures& LevelTextures = InTextures[InLevelIndex];
+
+    if (InLevelIndex == Levels.Num() - 1)
+    {
+        Smooth_RenderThread(Level, LevelTextures, CoarsestIterations, InPassFlags, GraphBuilder);
+        return;
+    }
+
+    const FLevel& Coarse = Levels[InLevelIndex + 1];
+    const FLevelTextures& CoarseTextures = InTextures[InLevelIndex + 1];
+
+    Smooth_RenderThread(Level, LevelTextures, InSmoothingIterations, InPassFlags, GraphBuilder);
+
+    // Residual
+    {
+        FFluidSimulationProjectionCS::FParameters* Params = AllocLevelParameters(GraphBuilder, Level);
+        Params->Pressure = GraphBuilder.CreateUAV(LevelTextures.Pressure);
+        Params->SourceField = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(LevelTextures.RightHandSide));
+        Params->OutputField = GraphBuilder.CreateUAV(LevelTextures.Residual);
+
+        AddPass(GraphBuilder, EFluidSimulationProjectionPass::Residual, Params, Level.Size, NumSlices, InPassFlags);
+    }
+
+    // Restrict the residual into the coarse right hand side and clear the coarse pressure
+    {
+        FFluidSimulationProjectionCS::FParameters* Params = AllocLevelParameters(GraphBuilder, Coarse);
+        Params->Pressure = GraphBuilder.CreateUAV(CoarseTextures.Pressure);
+        Params->SourceField = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(LevelTextures.Residual));
+        Params->OutputField = GraphBuilder.CreateUAV(CoarseTextures.RightHandSide);
+        Params->SourceLevelSize = Level.Size;
+
+        AddPass(GraphBuilder, EFluidSimulationProjectionPass::Restrict, Params, Coarse.Size, NumSlices, InPassFlags);
+    }
+
+    VCycle_RenderThread(InTextures, InLevelIndex + 1, InSmoothingIterations, InPassFlags, GraphBuilder);
+
+    // Add the coarse correction
+    {
+        FFluidSimulationProjectionCS::FParameters* Params = AllocLevelParameters(GraphBuilder, Level);
+        Params->Pressure = GraphBuilder.CreateUAV(LevelTextures.Pressure);
+        Params->SourcePressure = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(CoarseTextures.Pressure));
+        Params->SourceLevelSize = Coarse.Size;
+
+        AddPass(GraphBuilder, EFluidSimulationProjectionPass::Prolongate, Params, Level.Size, NumSlices, InPassFlags);
+    }
+
+    Smooth_RenderThread(Level, LevelTextures, InSmoothingIterations, InPassFlags, GraphBuilder);
+}
+
+void FFluidSimulationProjection::Smooth_RenderThread(const FLevel& InLevel, const FLevelTextures& InTextures, const int32 InIterations, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const
+{
+    using namespace FluidSimulationProjection;
+
+    const FRDGTextureUAVRef PressureUAV = GraphBuilder.CreateUAV(InTextures.Pressure);
+    const FRDGTextureSRVRef RightHandSideSRV = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InTextures.RightHandSide));
+
+    for (int32 Iteration = 0; Iteration < InIterations; ++Iteration)
+    {
+        for (int32 Color = 0; Color < 2; ++Color)
+        {
+            // Each color reads what the other one wrote, the graph puts a UAV barrier between the sweeps
+            FFluidSimulationProjectionCS::FParameters* Params = AllocLevelParameters(GraphBuilder, InLevel);
+            Params->Pressure = PressureUAV;
+            Params->SourceField = RightHandSideSRV;
+            Params->Color = Color;
+
+            AddPass(GraphBuilder, EFluidSimulationProjectionPass::Smooth, Params, InLevel.Size, NumSlices, InPassFlags);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,5 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationProjectionCS.h"
+
+IMPLEMENT_GLOBAL_SHADER(FFluidSimulationProjectionCS, "/NullVisualEffects/FluidSimulation/FluidSimulationProjectionCS.usf", "MainCS", SF_Compute);
\ No newline at end of file
@@ -1,28 +1,102 @@
 // Copyright (C) Ronaldo Veloso. All Rights Reserved.
 
 #include "FluidSimulation/Render/FluidSimulationRender.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "FluidSimulation/FluidSimulationSnapshot.h"
+#include "NullVisualEffects.h"
 #include "FluidSimulation/Render/FluidSimulationCS.h"
-#include "FluidSimulation/Render/FluidSimulationAddInputCS.h"
 #include "FluidSimulation/Render/FluidSimulationDrawCS.h"
+#include "FluidSimulation/Render/FluidSimulationResampleCS.h"
+#include "FluidSimulation/Render/FluidSimulationRestoreCS.h"
+#include "FluidSimulation/Render/FluidSimulationUploadBuffer.h"
 #include "FluidSimulation/Render/FluidSimulationVS.h"
+#include "FluidSimulation/Render/FluidSimulationWindowCS.h"
 #include "FluidSimulation/Render/FluidSimulationPS.h"
+#include "CommonRenderResources.h"
 #include "Engine/TextureRenderTarget2D.h"
-#include "Library/NullVisualEffectsFunctionLibrary.h"
+#include "GenerateMips.h"
+#include "PipelineStateCache.h"
+#include "RenderGraphBuilder.h"
 #include "RenderGraphUtils.h"
-#include "RenderTargetPool.h"
-#include "Library/NullVisualEffectsFunctionLibrary.h"
+#include "Async/ParallelFor.h"
 #include "Math/UnrealMathUtility.h"
+#include "Misc/App.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectIterator.h"
 
-const FVertexDeclarationElementList UFluidSimulationRender::VertexSimulationDataDeclaration
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationRender Tick"), STAT_FluidSimulationRender_Tick, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationRender UpdateFluid RT"), STAT_FluidSimulationRender_UpdateFluid_RenderThread, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationRender UpdateDetail RT"), STAT_FluidSimulationRender_UpdateDetail_RenderThread, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationRender DrawToRenderTarget RT"), STAT_FluidSimulationRender_DrawToRenderTarget_RenderThread, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationRender InitResources RT"), STAT_FluidSimulationRender_InitResources_RenderThread, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationRender RestoreFields RT"), STAT_FluidSimulationRender_RestoreFields_RenderThread, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationRender MoveWindow RT"), STAT_FluidSimulationRender_MoveWindow_RenderThread, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationRender DrawCPUToRenderTarget RT"), STAT_FluidSimulationRender_DrawCPUToRenderTarget_RenderThread, STATGROUP_NullVisualEffects);
+
+DECLARE_GPU_STAT_NAMED(FluidSimulationSolve, TEXT("Fluid Simulation Solve"));
+DECLARE_GPU_STAT_NAMED(FluidSimulationDraw, TEXT("Fluid Simulation Draw"));
+
+static TAutoConsoleVariable<int32> CVarFluidSimulationTickInEditor
+(
+    TEXT("FluidSimulation.TickInEditor"),
+    0,
+    TEXT("Steps the fluid simulations created outside of play, in editor worlds."),
+    ECVF_Default
+);
+
+static TAutoConsoleVariable<int32> CVarFluidSimulationAsyncCompute
+(
+    TEXT("r.FluidSimulation.AsyncCompute"),
+    1,
+    TEXT("Runs the fluid simulation passes on the async compute queue where the RHI supports it efficiently."),
+    ECVF_RenderThreadSafe
+);
+
+namespace FluidSimulationRender
 {
-    FVertexElement(0, offsetof(FFluidSimulationVertex, Coords)      , EVertexElementType::VET_Float2, 0, sizeof(FFluidSimulationVertex)),
-    FVertexElement(0, offsetof(FFluidSimulationVertex, Velocity)    , EVertexElementType::VET_Float2, 1, sizeof(FFluidSimulationVertex)),
-    FVertexElement(0, offsetof(FFluidSimulationVertex, Density)     , EVertexElementType::VET_Float1, 2, sizeof(FFluidSimulationVertex))
-};
+    /** Returns the flags of the simulation compute passes, render thread only */
+    static ERDGPassFlags GetComputePassFlags()
+    {
+        return (GSupportsEfficientAsyncCompute && CVarFluidSimulationAsyncCompute.GetValueOnRenderThread() != 0) ? ERDGPassFlags::AsyncCompute : ERDGPassFlags::Compute;
+    }
+}
+
+static FAutoConsoleCommand GFluidSimulationDumpSolverStats
+(
+    TEXT("FluidSimulation.DumpSolverStats"),
+    TEXT("Logs the timings of the last step of every fluid simulation"),
+    FConsoleCommandDelegate::CreateLambda([]()
+    {
+        for (TObjectIterator<UFluidSimulationRender> It; It; ++It)
+        {
+            const FFluidSimulationSolverStats& Stats = It->GetSolverStats();
+            UE_LOG(LogNullVisualEffects, Log, TEXT("%s: Step %.3f ms (AddInput %.3f ms, UpdateFluid %.3f ms, Project %.3f ms), %d pressure cycles, residual %g, %.2f MCells/s, %d/%d active tiles, %d threads"),
+                *It->GetPathName(), Stats.StepMs, Stats.AddInputMs, Stats.UpdateFluidMs, Stats.ProjectMs, Stats.NumPressureCycles, Stats.PressureResidual, Stats.CellsPerSecond / 1000000.0f, Stats.NumActiveTiles, Stats.NumTiles, Stats.NumThreads);
+        }
+
+        UE_LOG(LogNullVisualEffects, Log, TEXT("Upload ring: %d brushes capacity, %llu bytes uploaded, %d reallocations"),
+            GFluidSimulationUploadBuffer.GetCapacity(), GFluidSimulationUploadBuffer.GetBytesUploaded(), GFluidSimulationUploadBuffer.GetNumReallocations());
+    })
+);
 
 UFluidSimulationRender::UFluidSimulationRender()
     : bIsInit(false)
+    , FluidDifusion(0.0f)
+    , FluidViscosity(0.0f)
     , SimulationGridSize(0)
+    , Backend(EFluidSimulationBackend::GPU)
+    , Solver(EFluidSimulationSolver::NavierStokes)
+    , FieldPrecision(EFluidSimulationFieldPrecision::Full)
+    , NumFieldBuffers(2)
+    , NumSlices(1)
+    , TimeAccumulator(0.0f)
+    , SimulationTime(0.0)
+    , InterpolationAlpha(1.0f)
+    , UpsampleFilter(EFluidSimulationUpsampleFilter::Bilinear)
+    , bTickedExternally(false)
+    , CurrentFieldIndex(0)
+    , FieldOrigin(FIntPoint::ZeroValue)
+    , SampleReadbackLatency(2)
 {
 }
 
@@ -34,6 +108,10 @@ void UFluidSimulationRender::BeginDestroy()
 {
     Super::BeginDestroy();
     RenderFence.Wait();
+
+    CPUSolver.Reset();
+    Sampler.Release();
+    MemoryUsage.Release();
 }
 
 bool UFluidSimulationRender::IsReadyForFinishDestroy()
@@ -43,29 +121,92 @@ bool UFluidSimulationRender::IsReadyForFinishDestroy()
 
 void UFluidSimulationRender::Tick(float DeltaTime)
 {
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationRender_Tick);
+
     RenderFence.BeginFence(true);
+    UpdateInitState();
 
-    if (bIsInit)
+    // Time and brushes wait for the resources, the surface starts simulating once they exist
+    if (!bIsInit)
     {
-        UNullVisualEffectsFunctionLibrary::CopyVertexBuffer(VertexBuffer, SpareVertexBuffer);
-        AddInputData();
-        UpdateFluid(DeltaTime);
+        return;
+    }
+
+    LastSliceBrushCounts = SliceBrushCounts;
+    SliceBrushCounts.Init(0, NumSlices);
+
+    int32 NumSteps = 1;
+    float StepDeltaTime = DeltaTime;
+    InterpolationAlpha = 1.0f;
+
+    if (TimestepSettings.bFixedTimestep)
+    {
+        StepDeltaTime = TimestepSettings.GetStepSeconds();
+        TimeAccumulator += DeltaTime;
+
+        NumSteps = FMath::FloorToInt(TimeAccumulator / StepDeltaTime);
+        TimeAccumulator -= NumSteps * StepDeltaTime;
+
+        // Hitches past the cap are dropped, the simulation slows down instead of spiraling
+        NumSteps = FMath::Min(NumSteps, FMath::Max(TimestepSettings.MaxSubsteps, 1));
+
+        if (TimestepSettings.bInterpolate)
+        {
+            InterpolationAlpha = TimeAccumulator / StepDeltaTime;
+        }
+    }
+
+    // Brushes go to the first substep, a frame without steps keeps them for the next one
+    for (int32 Step = 0; Step < NumSteps; ++Step)
+    {
+        INC_DWORD_STAT(STAT_FluidSimulation_Steps);
+        INC_DWORD_STAT_BY(STAT_FluidSimulation_InputRecords, PendingBrushes.Num());
+        SimulationTime += StepDeltaTime;
+
+        if (Backend == EFluidSimulationBackend::CPU)
+        {
+            CPUSolver->Step(PendingBrushes, FluidDifusion, FluidViscosity, StepDeltaTime);
+            PendingBrushes.Reset();
+        }
+        else
+        {
+            // The solver splats the brushes into the latest state as it reads it and writes the next field of the ring
+            UpdateFluid(StepDeltaTime);
+            CurrentFieldIndex = GetNextFieldIndex();
+        }
+    }
 
-        if (OutputRenderTarget != nullptr)
+    // Queries of the frame read the latest state, before the draws so they overlap with them on the GPU
+    UpdateSampler();
+
+    for (int32 Slice = 0; Slice < OutputRenderTargets.Num(); ++Slice)
+    {
+        if (OutputRenderTargets[Slice] != nullptr)
         {
-            DrawToRenderTarget(OutputRenderTarget);
+            DrawToRenderTarget(OutputRenderTargets[Slice], Slice);
         }
     }
+
+    INC_DWORD_STAT_BY(STAT_FluidSimulation_Surfaces, NumSlices);
+    INC_DWORD_STAT_BY(STAT_FluidSimulation_ActiveCells, GetSolverStats().NumActiveCells);
+}
+
+void UFluidSimulationRender::UpdateSampler()
+{
+    if (bIsInit && Backend == EFluidSimulationBackend::GPU && Fields.Num() > 0)
+    {
+        Sampler.Update(Fields[CurrentFieldIndex], SimulationGridSize, SampleReadbackLatency, FieldOrigin);
+    }
 }
 
 bool UFluidSimulationRender::IsTickable() const
 {
-    return true;
+    return !bTickedExternally;
 }
 
 bool UFluidSimulationRender::IsTickableInEditor() const
 {
-    return true;
+    return CVarFluidSimulationTickInEditor.GetValueOnGameThread() != 0;
 }
 
 bool UFluidSimulationRender::IsTickableWhenPaused() const
@@ -75,298 +216,1176 @@ bool UFluidSimulationRender::IsTickableWhenPaused() const
 
 TStatId UFluidSimulationRender::GetStatId() const
 {
-    return TStatId();
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UFluidSimulationRender, STATGROUP_NullVisualEffects);
 }
 
-bool UFluidSimulationRender::Init(const int32 InSimulationGridSize)
+bool UFluidSimulationRender::Init(const int32 InSimulationGridSize, const EFluidSimulationBackend InBackend, const bool bInPreserveState)
 {
-    RenderFence.Wait();
+    // In flight commands hold their own references to the resources, nothing here waits on the render thread
+    EFluidSimulationBackend NewBackend = InBackend;
+
+    if (NewBackend == EFluidSimulationBackend::GPU && !FApp::CanEverRender())
+    {
+        UE_LOG(LogNullVisualEffects, Log, TEXT("%s: No RHI available, falling back to the CPU fluid solver."), *GetPathName());
+        NewBackend = EFluidSimulationBackend::CPU;
+    }
+
+    if (NewBackend == EFluidSimulationBackend::CPU && DetailSettings.bEnabled)
+    {
+        UE_LOG(LogNullVisualEffects, Warning, TEXT("%s: The CPU fluid solver has no detail level, the grid is solved alone."), *GetPathName());
+    }
+
+    if (NewBackend == EFluidSimulationBackend::CPU && NumSlices > 1)
+    {
+        UE_LOG(LogNullVisualEffects, Warning, TEXT("%s: The CPU fluid solver only solves a single surface, %d requested."), *GetPathName(), NumSlices);
+        NumSlices = 1;
+    }
+
+    const bool bPreserveState = bInPreserveState && bIsInit && Backend == NewBackend && InSimulationGridSize > 0;
+    const FFluidSimulationField SourceField = bPreserveState && Backend == EFluidSimulationBackend::GPU ? Fields[CurrentFieldIndex] : FFluidSimulationField();
+    const int32 SourceGridSize = SimulationGridSize;
+    const int32 SourceNumSlices = SourceField.IsValid() ? FMath::Min(NumSlices, static_cast<int32>(SourceField.Velocity->GetDesc().ArraySize)) : 0;
+    const FIntPoint SourceFieldOrigin = FieldOrigin;
+
+    TUniquePtr<FFluidSimulationCPUSolver> SourceSolver;
+    if (bPreserveState && Backend == EFluidSimulationBackend::CPU)
+    {
+        SourceSolver = MoveTemp(CPUSolver);
+    }
+
+    for (FFluidSimulationField& Field : Fields)
+    {
+        Field.SafeRelease();
+    }
 
-    VertexBuffer.SafeRelease();
-    VertexBufferUAV.SafeRelease();
-    SpareVertexBuffer.SafeRelease();
-    SpareVertexBufferUAV.SafeRelease();
+    Fields.Reset();
+    CurrentFieldIndex = 0;
+    FieldOrigin = FIntPoint::ZeroValue;
+    Projection.SafeRelease();
+    Activity.SafeRelease();
+    Detail.SafeRelease();
+    PendingInit.Reset();
+    CPUSolver.Reset();
+    Sampler.Release();
+    MemoryUsage.Release();
 
     SimulationGridSize = InSimulationGridSize;
-    bIsInit = SimulationGridSize > 0;
+    Backend = NewBackend;
+    bIsInit = false;
 
-    if (bIsInit)
+    SliceBrushCounts.Init(0, NumSlices);
+    LastSliceBrushCounts.Init(0, NumSlices);
+    InterpolationAlpha = 1.0f;
+
+    if (!bPreserveState)
     {
-        ENQUEUE_RENDER_COMMAND(CreateBuffer)
-        (
-            [ this ]
-            (FRHICommandListImmediate& RHICmdList)
-            {
-                TResourceArray<FFluidSimulationVertex, VERTEXBUFFER_ALIGNMENT> VertexBufferData;
+        TimeAccumulator = 0.0f;
+        SimulationTime = 0.0;
+    }
 
-                const float CoordsRecip = 1.0f / (SimulationGridSize - 1);
-                for (int32 i = 0; i < SimulationGridSize; ++i)
+    if (SimulationGridSize > 0 && Backend == EFluidSimulationBackend::CPU)
+    {
+        CPUSolver = MakeUnique<FFluidSimulationCPUSolver>();
+        CPUSolver->Init(SimulationGridSize, CPUSettings, ProjectionSettings, ActivitySettings, FieldPrecision, Solver, ShallowWaterSettings, AdvectionSettings);
+        bIsInit = true;
+
+        if (SourceSolver.IsValid())
+        {
+            // Cell centers of the new grid mapped onto the old one, sampled like a brush query
+            const int32 GridSize = SimulationGridSize;
+            const float Scale = static_cast<float>(SourceSolver->GetSimulationGridSize()) / static_cast<float>(GridSize);
+
+            FFluidSimulationPlanes Planes;
+            Planes.Init(GridSize * GridSize);
+
+            ParallelFor(GridSize, [&](const int32 InX)
+            {
+                for (int32 Y = 0; Y < GridSize; ++Y)
                 {
-                    for (int32 j = 0; j < SimulationGridSize; ++j)
-                    {
-                        const FVector& RandomVector = FMath::VRand();
-                        const FVector2D& CurrentCorrds = FVector2D(CoordsRecip * static_cast<float>(i), CoordsRecip * static_cast<float>(j));
-                        VertexBufferData.Emplace(FFluidSimulationVertex(CurrentCorrds, FVector2D::ZeroVector, 0.0f));
-                    }
+                    const int32 Index = InX * GridSize + Y;
+                    FVector2D Velocity = FVector2D::ZeroVector;
+                    SourceSolver->Sample((FVector2D(InX, Y) + 0.5f) * Scale - 0.5f, Velocity, Planes.Density[Index]);
+                    Planes.VelocityX[Index] = Velocity.X;
+                    Planes.VelocityY[Index] = Velocity.Y;
                 }
+            });
 
-                FRHIResourceCreateInfo ResourceCreateInfo(&VertexBufferData);
-                const uint32 BufferUsage = BUF_Static | BUF_UnorderedAccess | BUF_ShaderResource;
+            CPUSolver->SetState(Planes);
+        }
+    }
+    else if (SimulationGridSize > 0)
+    {
+        PendingInit = MakeShared<FPendingInit, ESPMode::ThreadSafe>();
 
-                VertexBuffer = RHICreateVertexBuffer(VertexBufferData.GetResourceDataSize(), BufferUsage, ResourceCreateInfo);
-                VertexBufferUAV = RHICreateUnorderedAccessView(VertexBuffer.GetReference(), PF_R32_FLOAT);
+        // Patches larger than the grid would not refine anything
+        FFluidSimulationDetailSettings EffectiveDetailSettings = DetailSettings;
+        EffectiveDetailSettings.bEnabled = DetailSettings.bEnabled && SimulationGridSize >= DetailSettings.GetPatchCoarseSize();
 
-                SpareVertexBuffer = RHICreateVertexBuffer(VertexBufferData.GetResourceDataSize(), BufferUsage, ResourceCreateInfo);
-                SpareVertexBufferUAV = RHICreateUnorderedAccessView(SpareVertexBuffer.GetReference(), PF_R32_FLOAT);
+        ENQUEUE_RENDER_COMMAND(FluidSimulationRender_InitResources)
+        (
+            [
+                PendingInit         = PendingInit,
+                SimulationGridSize  = SimulationGridSize,
+                NumSlices           = NumSlices,
+                NumFieldBuffers     = NumFieldBuffers,
+                FieldPrecision      = FieldPrecision,
+                bProjection         = ProjectionSettings.bEnabled && Solver == EFluidSimulationSolver::NavierStokes,
+                ActivitySettings    = ActivitySettings,
+                DetailSettings      = EffectiveDetailSettings,
+                SourceField         = SourceField,
+                SourceGridSize      = SourceGridSize,
+                SourceNumSlices     = SourceNumSlices,
+                SourceFieldOrigin   = SourceFieldOrigin
+            ]
+            (FRHICommandListImmediate& RHICmdList)
+            {
+                InitResources_RenderThread(*PendingInit, SimulationGridSize, NumSlices, NumFieldBuffers, FieldPrecision, bProjection, ActivitySettings, DetailSettings, SourceField, SourceGridSize, SourceNumSlices, SourceFieldOrigin, RHICmdList);
             }
         );
 
-        FlushRenderingCommands();
+        InitFence.BeginFence();
+    }
+
+    UpdateMemoryStats();
+
+    return SimulationGridSize > 0;
+}
+
+void UFluidSimulationRender::WaitUntilReady()
+{
+    if (PendingInit.IsValid())
+    {
+        InitFence.Wait();
+        UpdateInitState();
+    }
+}
+
+void UFluidSimulationRender::UpdateInitState()
+{
+    if (!PendingInit.IsValid() || !InitFence.IsFenceComplete())
+    {
+        return;
     }
 
-    return bIsInit;
+    // Copies, restores queued before the fence completed may still read the pending resources on the render thread
+    Fields = PendingInit->Fields;
+    Projection = PendingInit->Projection;
+    Activity = PendingInit->Activity;
+    Detail = PendingInit->Detail;
+    CurrentFieldIndex = 0;
+    PendingInit.Reset();
+
+    bIsInit = Fields.Num() > 0;
+    UpdateMemoryStats();
+
+    if (bIsInit)
+    {
+        ReadyEvent.Broadcast(this);
+    }
 }
 
 void UFluidSimulationRender::UpdateFluid(const float InDeltaTime)
 {
+    // Patches follow the bodies, placed from the brushes before they are handed to the render thread
+    TArray<FFluidSimulationBrush> DetailBrushes;
+    if (Detail.IsValid())
+    {
+        Detail.UpdatePatches(PendingBrushes, SimulationGridSize, DetailSettings.PatchLifetime, InDeltaTime);
+        Detail.GetPatchBrushes(PendingBrushes, DetailBrushes);
+    }
+
     ENQUEUE_RENDER_COMMAND(FluidSimulationRender_UpdateFluid)
     (
         [
-            DeltaTime           = InDeltaTime,
-            CurrentUAV          = VertexBufferUAV,
-            PreviousUAV         = SpareVertexBufferUAV,
-            SimulationGridSize  = SimulationGridSize,
-            FluidDifusion       = FluidDifusion,
-            FluidViscosity      = FluidViscosity
-
+            DeltaTime            = InDeltaTime,
+            CurrentField         = Fields[GetNextFieldIndex()],
+            PreviousField        = Fields[CurrentFieldIndex],
+            SimulationGridSize   = SimulationGridSize,
+            NumSlices            = NumSlices,
+            FluidDifusion        = FluidDifusion,
+            FluidViscosity       = FluidViscosity,
+            ProjectionSettings   = ProjectionSettings,
+            Projection           = Projection,
+            Fields               = Fields,
+            Activity             = Activity,
+            Solver               = Solver,
+            ShallowWaterSettings = ShallowWaterSettings,
+            AdvectionSettings    = AdvectionSettings,
+            Brushes              = MoveTemp(PendingBrushes),
+            FieldOrigin          = FieldOrigin
         ]
         (FRHICommandListImmediate& RHICmdList)
         {
-            UpdateFluid_RenderThread(SimulationGridSize, FluidDifusion, FluidViscosity, DeltaTime, CurrentUAV, PreviousUAV, RHICmdList);
+            UpdateFluid_RenderThread(SimulationGridSize, NumSlices, FluidDifusion, FluidViscosity, DeltaTime, CurrentField, PreviousField, ProjectionSettings, Projection, Fields, Activity, Solver, ShallowWaterSettings, AdvectionSettings, Brushes, FieldOrigin, RHICmdList);
         }
     );
-}
 
-void UFluidSimulationRender::AddInputData()
-{
-    ENQUEUE_RENDER_COMMAND(FluidSimulationRender_AddInputData)
+    PendingBrushes.Reset();
+
+    if (!Detail.IsValid() || !Detail.HasLivePatches())
+    {
+        return;
+    }
+
+    const int32 NumDetailSubsteps = Detail.GetNumSubsteps(Solver, ShallowWaterSettings, InDeltaTime);
+
+    ENQUEUE_RENDER_COMMAND(FluidSimulationRender_UpdateDetail)
     (
         [
-            SimulationGridSize  = SimulationGridSize,
-            InputData           = PendingFluidInput,
-            CurrentUAV          = SpareVertexBufferUAV
+            DeltaTime            = InDeltaTime,
+            GridField            = Fields[CurrentFieldIndex],
+            NextGridField        = Fields[GetNextFieldIndex()],
+            SimulationGridSize   = SimulationGridSize,
+            FieldOrigin          = FieldOrigin,
+            Activity             = Activity,
+            Detail               = Detail,
+            NumSubsteps          = NumDetailSubsteps,
+            FluidDifusion        = FluidDifusion,
+            FluidViscosity       = FluidViscosity,
+            ProjectionSettings   = ProjectionSettings,
+            Solver               = Solver,
+            ShallowWaterSettings = ShallowWaterSettings,
+            AdvectionSettings    = AdvectionSettings,
+            Brushes              = MoveTemp(DetailBrushes)
         ]
         (FRHICommandListImmediate& RHICmdList)
         {
-            AddInputData_RenderThread(SimulationGridSize, InputData, CurrentUAV, RHICmdList);
+            UpdateDetail_RenderThread(SimulationGridSize, GridField, NextGridField, FieldOrigin, Activity, Detail, NumSubsteps, FluidDifusion, FluidViscosity, DeltaTime, ProjectionSettings, Solver, ShallowWaterSettings, AdvectionSettings, Brushes, RHICmdList);
         }
     );
 
-    PendingFluidInput.Empty();
+    // Each substep writes the next field of the patch ring, the draw interpolates from the last substep
+    Detail.CurrentFieldIndex = (Detail.CurrentFieldIndex + NumDetailSubsteps) % Detail.Fields.Num();
+
+    for (FFluidSimulationDetailPatch& Patch : Detail.Patches)
+    {
+        Patch.bNeedsInit = false;
+    }
 }
 
-void UFluidSimulationRender::DrawToRenderTarget(class UTextureRenderTarget2D* InRenderTarget)
+void UFluidSimulationRender::DrawToRenderTarget(class UTextureRenderTarget2D* InRenderTarget, const int32 InSlice)
 {
-    if (InRenderTarget != nullptr && InRenderTarget->SizeX == SimulationGridSize && InRenderTarget->SizeY == SimulationGridSize)
+    if (Backend == EFluidSimulationBackend::CPU)
+    {
+        if (bIsInit && FApp::CanEverRender() && InRenderTarget != nullptr && InRenderTarget->SizeX == SimulationGridSize && InRenderTarget->SizeY == SimulationGridSize)
+        {
+            TArray<FColor> Colors;
+            CPUSolver->DrawToColorBuffer(Colors, InterpolationAlpha);
+
+            ENQUEUE_RENDER_COMMAND(FluidSimulationRender_DrawCPUToRenderTarget)
+            (
+                [
+                    RenderTarget        = InRenderTarget,
+                    Colors              = MoveTemp(Colors),
+                    SimulationGridSize  = SimulationGridSize
+                ]
+                (FRHICommandListImmediate& RHICmdList)
+                {
+                    DrawCPUToRenderTarget_RenderThread(RenderTarget, SimulationGridSize, Colors, RHICmdList);
+                }
+            );
+        }
+    }
+    else if (bIsInit && InSlice >= 0 && InSlice < NumSlices && InRenderTarget != nullptr)
     {
         ENQUEUE_RENDER_COMMAND(FluidSimulationRender_DrawToRenderTarget)
         (
             [
                 RenderTarget            = InRenderTarget,
-                FluidVertexBuffer       = VertexBuffer,
-                FluidVertexBufferUAV    = VertexBufferUAV,
-                SimulationGridSize      = SimulationGridSize
+                FluidField              = Fields[CurrentFieldIndex],
+                PreviousFluidField      = Fields[GetPreviousFieldIndex()],
+                InterpolationAlpha      = InterpolationAlpha,
+                UpsampleFilter          = UpsampleFilter,
+                Solver                  = Solver,
+                ShallowWaterSettings    = ShallowWaterSettings,
+                SimulationGridSize      = SimulationGridSize,
+                Slice                   = InSlice,
+                FieldOrigin             = FieldOrigin,
+                Detail                  = Detail
             ]
             (FRHICommandListImmediate& RHICmdList)
             {
-                DrawToRenderTarget_RenderThread(RenderTarget, SimulationGridSize, FluidVertexBuffer, FluidVertexBufferUAV, RHICmdList);
+                DrawToRenderTarget_RenderThread(RenderTarget, SimulationGridSize, Slice, FluidField, PreviousFluidField, InterpolationAlpha, UpsampleFilter, Solver, ShallowWaterSettings, FieldOrigin, Detail, RHICmdList);
             }
         );
     }
 }
 
-void UFluidSimulationRender::SetRenderTarget(UTextureRenderTarget2D* InRenderTarget)
+void UFluidSimulationRender::SetRenderTarget(UTextureRenderTarget2D* InRenderTarget, const int32 InSlice)
 {
-    OutputRenderTarget = InRenderTarget;
+    if (InSlice >= 0)
+    {
+        if (InSlice >= OutputRenderTargets.Num())
+        {
+            OutputRenderTargets.SetNumZeroed(InSlice + 1);
+        }
+
+        OutputRenderTargets[InSlice] = InRenderTarget;
+    }
+}
+
+void UFluidSimulationRender::AddVelocityDensity(const FVector& InLocation, const FVector& InPreviousLocation, const FVector& InVelocity, const float InRadius, const float InStrength, const float InFalloff, const int32 InSlice)
+{
+    if (InSlice < 0 || InSlice >= NumSlices)
+    {
+        return;
+    }
+
+    // Locations come in mirrored, [-1, 1] maps to [SimulationGridSize, 0]
+    const float GridSize = static_cast<float>(SimulationGridSize);
+    auto ToGrid = [GridSize](const FVector& InNormalizedLocation)
+    {
+        return FVector2D(GridSize, GridSize) - FVector2D(InNormalizedLocation.X + 1.0f, InNormalizedLocation.Y + 1.0f) * 0.5f * GridSize;
+    };
+
+    FFluidSimulationBrush& Brush = PendingBrushes.AddDefaulted_GetRef();
+    Brush.Center = ToGrid(InLocation);
+    Brush.PreviousCenter = ToGrid(InPreviousLocation);
+    Brush.Velocity = FVector2D(InVelocity.X, InVelocity.Y);
+    Brush.Radius = InRadius * GridSize;
+    Brush.Strength = InStrength;
+    Brush.Falloff = FMath::Max(InFalloff, 0.0f);
+    Brush.Slice = static_cast<uint32>(InSlice);
+
+    if (SliceBrushCounts.IsValidIndex(InSlice))
+    {
+        ++SliceBrushCounts[InSlice];
+    }
 }
 
-void UFluidSimulationRender::AddVelocityDensity(const FVector& InLocation, const FVector& InVelocity, const float InRadius, const float InViscosity)
+bool UFluidSimulationRender::SampleVelocityDensity(const FVector2D& InCoords, FVector2D& OutVelocity, float& OutDensity) const
 {
-    // #TODO : Find a better way to draw the velocities and change it from a square to a circle
+    if (bIsInit && Backend == EFluidSimulationBackend::CPU)
+    {
+        return CPUSolver->Sample(InCoords, OutVelocity, OutDensity);
+    }
 
-    const FVector& Location = ((InLocation + FVector::OneVector) * 0.5f) * static_cast<float>(SimulationGridSize);
-    const float RadiusGridScale = InRadius * static_cast<float>(SimulationGridSize);
+    return false;
+}
 
-    const int32 MinimumX = FMath::Clamp(static_cast<int32>(Location.X - RadiusGridScale), 0, SimulationGridSize);
-    const int32 MinimumY = FMath::Clamp(static_cast<int32>(Location.Y - RadiusGridScale), 0, SimulationGridSize);
-    const int32 MaximumX = FMath::Clamp(static_cast<int32>(Location.X + RadiusGridScale), 0, SimulationGridSize);
-    const int32 MaximumY = FMath::Clamp(static_cast<int32>(Location.Y + RadiusGridScale), 0, SimulationGridSize);
+TFuture<TArray<FFluidSimulationSample>> UFluidSimulationRender::SampleVelocityDensityAsync(TArrayView<const FVector2D> InCoords, const int32 InSlice)
+{
+    if (bIsInit && Backend == EFluidSimulationBackend::GPU && InSlice >= 0 && InSlice < NumSlices)
+    {
+        return Sampler.Enqueue(InCoords, InSlice);
+    }
+
+    TArray<FFluidSimulationSample> Samples;
 
-    for (int i = MinimumX; i < MaximumX; ++i)
+    if (bIsInit && Backend == EFluidSimulationBackend::CPU)
     {
-        for (int j = MinimumY; j < MaximumY; ++j)
+        Samples.SetNum(InCoords.Num());
+
+        for (int32 Index = 0; Index < InCoords.Num(); ++Index)
         {
-            PendingFluidInput.Emplace(FFluidCellInputData(FVector2D(InVelocity.X, InVelocity.Y), FIntPoint(SimulationGridSize - i , SimulationGridSize - j)));
+            FVector2D Velocity = FVector2D::ZeroVector;
+            CPUSolver->Sample(InCoords[Index], Velocity, Samples[Index].Density);
+            Samples[Index].Velocity = FVector(Velocity.X, Velocity.Y, 0.0f);
         }
     }
+
+    TPromise<TArray<FFluidSimulationSample>> Promise;
+    Promise.SetValue(MoveTemp(Samples));
+    return Promise.GetFuture();
 }
 
-void UFluidSimulationRender::AddInputData_RenderThread(const int32 InSimulationGridSize, const TArray<FFluidCellInputData>& InForcesDensityData, const FUnorderedAccessViewRHIRef& InBufferUAV, FRHICommandListImmediate& RHICmdList)
+TFuture<TArray<uint8>> UFluidSimulationRender::CaptureSnapshot(const int32 InSlice)
 {
-    check(IsInRenderingThread());
-    QUICK_SCOPE_CYCLE_COUNTER(STAT_ForcesDencityData_RenderThread);
-    SCOPED_DRAW_EVENT(RHICmdList, ForcesDencityData_RenderThread);
+    FFluidSimulationSnapshotInfo Info;
+    Info.SimulationGridSize = SimulationGridSize;
+    Info.Solver = Solver;
+    Info.TimeAccumulator = TimeAccumulator;
+    Info.SimulationTime = SimulationTime;
+
+    if (bIsInit && Backend == EFluidSimulationBackend::GPU && InSlice >= 0 && InSlice < NumSlices)
+    {
+        // Whole cells read back exactly through the bilinear gather, in the CPU layout the snapshot expects
+        TArray<FVector2D> Coords;
+        Coords.Reserve(SimulationGridSize * SimulationGridSize);
+
+        for (int32 X = 0; X < SimulationGridSize; ++X)
+        {
+            for (int32 Y = 0; Y < SimulationGridSize; ++Y)
+            {
+                Coords.Emplace(X, Y);
+            }
+        }
+
+        return Sampler.Enqueue(Coords, InSlice).Then([Info](TFuture<TArray<FFluidSimulationSample>> InSamples)
+        {
+            const TArray<FFluidSimulationSample> Samples = InSamples.Get();
+            TArray<uint8> Data;
+
+            if (Samples.Num() == Info.SimulationGridSize * Info.SimulationGridSize)
+            {
+                FFluidSimulationPlanes Planes;
+                Planes.Init(Samples.Num());
+
+                for (int32 Index = 0; Index < Samples.Num(); ++Index)
+                {
+                    Planes.VelocityX[Index] = Samples[Index].Velocity.X;
+                    Planes.VelocityY[Index] = Samples[Index].Velocity.Y;
+                    Planes.Density[Index] = Samples[Index].Density;
+                }
+
+                FFluidSimulationSnapshot::Encode(Planes, Info, Data);
+            }
+
+            return Data;
+        });
+    }
+
+    TArray<uint8> Data;
+
+    if (bIsInit && Backend == EFluidSimulationBackend::CPU)
+    {
+        FFluidSimulationSnapshot::Encode(CPUSolver->GetCurrentPlanes(), Info, Data);
+    }
+
+    TPromise<TArray<uint8>> Promise;
+    Promise.SetValue(MoveTemp(Data));
+    return Promise.GetFuture();
+}
+
+bool UFluidSimulationRender::RestoreSnapshot(TArrayView<const uint8> InData, const int32 InSlice)
+{
+    if ((!bIsInit && !PendingInit.IsValid()) || InSlice < 0 || InSlice >= NumSlices)
+    {
+        return false;
+    }
+
+    FFluidSimulationSnapshotInfo Info;
+    if (!FFluidSimulationSnapshot::ReadInfo(InData, Info))
+    {
+        UE_LOG(LogNullVisualEffects, Warning, TEXT("%s: Not a fluid simulation snapshot, or one from an older version."), *GetPathName());
+        return false;
+    }
+
+    // Velocity holds the height with the shallow water solver, the fields do not mean the same
+    if (Info.Solver != Solver)
+    {
+        UE_LOG(LogNullVisualEffects, Warning, TEXT("%s: The fluid simulation snapshot was captured with another solver."), *GetPathName());
+        return false;
+    }
+
+    FFluidSimulationPlanes Planes;
+    if (!FFluidSimulationSnapshot::Decode(InData, SimulationGridSize, Planes) || !SetSliceState(Planes, InSlice))
+    {
+        return false;
+    }
+
+    // The clock is shared by every surface of the simulation, one of them does not get to move it
+    if (NumSlices == 1)
+    {
+        TimeAccumulator = Info.TimeAccumulator;
+        SimulationTime = Info.SimulationTime;
+    }
+
+    return true;
+}
+
+void UFluidSimulationRender::ResetSlice(const int32 InSlice)
+{
+    if ((!bIsInit && !PendingInit.IsValid()) || InSlice < 0 || InSlice >= NumSlices)
+    {
+        return;
+    }
 
-    if (InForcesDensityData.Num() > 0)
+    // Brushes the previous surface left for the next step would stir the still water
+    PendingBrushes.RemoveAll([InSlice](const FFluidSimulationBrush& InBrush) { return InBrush.Slice == static_cast<uint32>(InSlice); });
+    if (SliceBrushCounts.IsValidIndex(InSlice))
     {
-        const uint32 BufferUsage = BUF_Static | BUF_UnorderedAccess | BUF_ShaderResource;
+        SliceBrushCounts[InSlice] = 0;
+    }
+
+    SetRenderTarget(nullptr, InSlice);
+
+    FFluidSimulationPlanes Planes;
+    Planes.Init(SimulationGridSize * SimulationGridSize);
+    SetSliceState(Planes, InSlice);
+}
 
-        TResourceArray<FFluidCellInputData> BufferData(false);
-        for (const FFluidCellInputData& Element : InForcesDensityData)
+bool UFluidSimulationRender::SetSliceState(const FFluidSimulationPlanes& InPlanes, const int32 InSlice)
+{
+    if (Backend == EFluidSimulationBackend::CPU)
+    {
+        if (!CPUSolver->SetState(InPlanes))
         {
-            BufferData.Emplace(Element);
+            return false;
         }
+    }
+    else
+    {
+        const int32 NumCells = SimulationGridSize * SimulationGridSize;
+        TArray<FVector4> Cells;
+        Cells.SetNumUninitialized(NumCells);
+
+        for (int32 Index = 0; Index < NumCells; ++Index)
+        {
+            Cells[Index] = FVector4(InPlanes.VelocityX[Index], InPlanes.VelocityY[Index], InPlanes.Density[Index], 0.0f);
+        }
+
+        ENQUEUE_RENDER_COMMAND(FluidSimulationRender_RestoreFields)
+        (
+            [
+                SimulationGridSize  = SimulationGridSize,
+                Slice               = InSlice,
+                Cells               = MoveTemp(Cells),
+                Fields              = Fields,
+                Activity            = Activity,
+                PendingInit         = PendingInit,
+                FieldOrigin         = FieldOrigin
+            ]
+            (FRHICommandListImmediate& RHICmdList)
+            {
+                // Until the simulation is ready its resources only exist on the render thread, created by the command queued before this one
+                RestoreFields_RenderThread(SimulationGridSize, Slice, Cells, PendingInit.IsValid() ? PendingInit->Fields : Fields, PendingInit.IsValid() ? PendingInit->Activity : Activity, FieldOrigin, RHICmdList);
+            }
+        );
 
-        FRHIResourceCreateInfo CreateInfo(&BufferData);
-        FStructuredBufferRHIRef StructuredBufferRef = RHICreateStructuredBuffer(sizeof(FFluidCellInputData), sizeof(FFluidCellInputData) * BufferData.Num(), BufferUsage, CreateInfo);
-        FUnorderedAccessViewRHIRef BufferUAVRef = RHICreateUnorderedAccessView(StructuredBufferRef, true, false);
+        // The patches hold the replaced state, filled again from the restored grid
+        Detail.ResetPatches();
+    }
+
+    return true;
+}
 
-        FFluidSimulationAddInputCS::FParameters Params;
-        Params.CurrentFluidData = InBufferUAV;
-        Params.SimulationGridSize = InSimulationGridSize;
-        Params.SimulationGridSizeRecip = 1.0f / static_cast<float>(InSimulationGridSize);
-        Params.ForcesDencityData = BufferUAVRef;
+void UFluidSimulationRender::MoveWindow(const FIntPoint& InDelta)
+{
+    if ((!bIsInit && !PendingInit.IsValid()) || InDelta == FIntPoint::ZeroValue)
+    {
+        return;
+    }
+
+    // Brushes and queries waiting for the next step were placed on the old window
+    const FVector2D Offset(-InDelta.X, -InDelta.Y);
+
+    for (FFluidSimulationBrush& Brush : PendingBrushes)
+    {
+        Brush.Center += Offset;
+        Brush.PreviousCenter += Offset;
+    }
 
-        TShaderMapRef<FFluidSimulationAddInputCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel));
-        FIntVector GroupCount = FIntVector(InForcesDensityData.Num(), 1, 1);
-        FComputeShaderUtils::Dispatch(RHICmdList, ComputeShader, Params, GroupCount);
+    if (Backend == EFluidSimulationBackend::CPU)
+    {
+        CPUSolver->Shift(InDelta);
+        return;
     }
+
+    Sampler.Translate(Offset);
+    Detail.Translate(InDelta, SimulationGridSize);
+
+    // The fields stay where they are and the origin moves, the cells leaving the window become the ones entering it
+    FieldOrigin.X = (FieldOrigin.X + InDelta.X % SimulationGridSize + SimulationGridSize) % SimulationGridSize;
+    FieldOrigin.Y = (FieldOrigin.Y + InDelta.Y % SimulationGridSize + SimulationGridSize) % SimulationGridSize;
+
+    ENQUEUE_RENDER_COMMAND(FluidSimulationRender_MoveWindow)
+    (
+        [
+            SimulationGridSize  = SimulationGridSize,
+            NumSlices           = NumSlices,
+            FieldOrigin         = FieldOrigin,
+            Delta               = InDelta,
+            Fields              = Fields,
+            Activity            = Activity,
+            PendingInit         = PendingInit
+        ]
+        (FRHICommandListImmediate& RHICmdList)
+        {
+            MoveWindow_RenderThread(SimulationGridSize, NumSlices, FieldOrigin, Delta, PendingInit.IsValid() ? PendingInit->Fields : Fields, PendingInit.IsValid() ? PendingInit->Activity : Activity, RHICmdList);
+        }
+    );
+}
+
+void UFluidSimulationRender::SetSolver(const EFluidSimulationSolver InSolver)
+{
+    Solver = InSolver;
 }
 
-void UFluidSimulationRender::UpdateFluid_RenderThread(const int32 InSimulationGridSize, const float InFluidDifusion, const float InFluidViscosity, const float InDeltaTime, const FUnorderedAccessViewRHIRef& InCurrentUAV, const FUnorderedAccessViewRHIRef& InPreviousUAV, FRHICommandListImmediate& RHICmdList)
+void UFluidSimulationRender::SetShallowWaterSettings(const FFluidSimulationShallowWaterSettings& InShallowWaterSettings)
+{
+    ShallowWaterSettings = InShallowWaterSettings;
+}
+
+void UFluidSimulationRender::SetAdvectionSettings(const FFluidSimulationAdvectionSettings& InAdvectionSettings)
+{
+    AdvectionSettings = InAdvectionSettings;
+
+    if (CPUSolver.IsValid())
+    {
+        CPUSolver->SetAdvectionSettings(AdvectionSettings);
+    }
+}
+
+void UFluidSimulationRender::SetCPUSettings(const FFluidSimulationCPUSettings& InCPUSettings)
+{
+    CPUSettings = InCPUSettings;
+}
+
+void UFluidSimulationRender::SetProjectionSettings(const FFluidSimulationProjectionSettings& InProjectionSettings)
+{
+    ProjectionSettings = InProjectionSettings;
+}
+
+void UFluidSimulationRender::SetActivitySettings(const FFluidSimulationActivitySettings& InActivitySettings)
+{
+    ActivitySettings = InActivitySettings;
+}
+
+void UFluidSimulationRender::SetDetailSettings(const FFluidSimulationDetailSettings& InDetailSettings)
+{
+    DetailSettings = InDetailSettings;
+}
+
+void UFluidSimulationRender::SetTimestepSettings(const FFluidSimulationTimestepSettings& InTimestepSettings)
+{
+    TimestepSettings = InTimestepSettings;
+}
+
+void UFluidSimulationRender::SetUpsampleFilter(const EFluidSimulationUpsampleFilter InUpsampleFilter)
+{
+    UpsampleFilter = InUpsampleFilter;
+}
+
+void UFluidSimulationRender::SetFieldPrecision(const EFluidSimulationFieldPrecision InFieldPrecision)
+{
+    FieldPrecision = InFieldPrecision;
+}
+
+void UFluidSimulationRender::SetNumFieldBuffers(const int32 InNumFieldBuffers)
+{
+    NumFieldBuffers = FMath::Clamp(InNumFieldBuffers, 2, 3);
+}
+
+void UFluidSimulationRender::SetNumSlices(const int32 InNumSlices)
+{
+    // Packed activity tile coords keep 8 bits for the slice
+    NumSlices = FMath::Clamp(InNumSlices, 1, 256);
+}
+
+void UFluidSimulationRender::SetSampleReadbackLatency(const int32 InSampleReadbackLatency)
+{
+    SampleReadbackLatency = FMath::Clamp(InSampleReadbackLatency, 1, 3);
+}
+
+void UFluidSimulationRender::SetTickedExternally(const bool bInTickedExternally)
+{
+    bTickedExternally = bInTickedExternally;
+}
+
+int32 UFluidSimulationRender::GetNextFieldIndex() const
+{
+    return (CurrentFieldIndex + 1) % Fields.Num();
+}
+
+int32 UFluidSimulationRender::GetPreviousFieldIndex() const
+{
+    return (CurrentFieldIndex + Fields.Num() - 1) % Fields.Num();
+}
+
+FFluidSimulationSolverStats UFluidSimulationRender::GetSolverStats() const
+{
+    if (bIsInit && Backend == EFluidSimulationBackend::CPU)
+    {
+        return CPUSolver->GetStats();
+    }
+
+    FFluidSimulationSolverStats Stats;
+
+    if (bIsInit && Activity.IsValid())
+    {
+        Stats.NumTiles = Activity.GetNumTiles();
+        Stats.NumActiveTiles = Activity.GetNumActiveTiles();
+        Stats.NumActiveCells = FMath::Min(Stats.NumActiveTiles * Activity.TileSize * Activity.TileSize, SimulationGridSize * SimulationGridSize * NumSlices);
+    }
+    else if (bIsInit)
+    {
+        Stats.NumActiveCells = SimulationGridSize * SimulationGridSize * NumSlices;
+    }
+
+    return Stats;
+}
+
+void UFluidSimulationRender::UpdateMemoryStats()
+{
+    MemoryUsage.Release();
+
+    for (const FFluidSimulationField& Field : Fields)
+    {
+        MemoryUsage.Fields += Field.GetAllocatedSize();
+    }
+
+    MemoryUsage.Projection = Projection.GetAllocatedSize();
+    MemoryUsage.Activity = Activity.GetAllocatedSize();
+    MemoryUsage.Detail = Detail.GetAllocatedSize();
+    MemoryUsage.CPU = CPUSolver.IsValid() ? CPUSolver->GetAllocatedSize() : 0;
+    MemoryUsage.Account();
+}
+
+void UFluidSimulationRender::UpdateFluid_RenderThread(const int32 InSimulationGridSize, const int32 InNumSlices, const float InFluidDifusion, const float InFluidViscosity, const float InDeltaTime, const FFluidSimulationField& InCurrentField, const FFluidSimulationField& InPreviousField, const FFluidSimulationProjectionSettings& InProjectionSettings, const FFluidSimulationProjection& InProjection, const TArray<FFluidSimulationField>& InFields, const FFluidSimulationActivity& InActivity, const EFluidSimulationSolver InSolver, const FFluidSimulationShallowWaterSettings& InShallowWaterSettings, const FFluidSimulationAdvectionSettings& InAdvectionSettings, const TArray<FFluidSimulationBrush>& InBrushes, const FIntPoint& InFieldOrigin, FRHICommandListImmediate& RHICmdList)
 {
     check(IsInRenderingThread());
-    QUICK_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationRender_UpdateFluid_RenderThread);
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationRender_UpdateFluid_RenderThread);
     SCOPED_DRAW_EVENT(RHICmdList, FluidSimulationRender_UpdateFluid_RenderThread);
 
-    FFluidSimulationCS::FParameters Params;
-    Params.CurrentFluidData = InCurrentUAV;
-    Params.PreviousFluidData = InPreviousUAV;
-    Params.SimulationGridSize = InSimulationGridSize;
-    Params.SimulationGridSizeRecip = 1.0f / static_cast<float>(InSimulationGridSize);
-    Params.FluidDifusion = InFluidDifusion;
-    Params.FluidViscosity = InFluidViscosity;
-    Params.DeltaTime = InDeltaTime;
+    const FFluidSimulationUploadBuffer::FAllocation Allocation = GFluidSimulationUploadBuffer.Upload_RenderThread(InBrushes);
+
+    FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationRender_UpdateFluid"));
+    const ERDGPassFlags PassFlags = FluidSimulationRender::GetComputePassFlags();
+
+    TArray<FFluidSimulationFieldTextures, TInlineAllocator<3>> Fields;
+    for (const FFluidSimulationField& Field : InFields)
+    {
+        Fields.Add(Field.Register(GraphBuilder));
+    }
+
+    const FFluidSimulationFieldTextures CurrentField = InCurrentField.Register(GraphBuilder);
+    const FFluidSimulationFieldTextures PreviousField = InPreviousField.Register(GraphBuilder);
+    const FRDGBufferSRVRef Brushes = GraphBuilder.CreateSRV(FRDGBufferSRVDesc(GraphBuilder.RegisterExternalBuffer(Allocation.Buffer, TEXT("FluidSimulationUploadBuffer"))));
+
+    // With the projection on, the solver velocity is not the final one and goes through the scratch texture
+    const bool bShallowWater = InSolver == EFluidSimulationSolver::ShallowWater;
+    const EFluidSimulationAdvection Advection = bShallowWater || !InAdvectionSettings.IsEnabled() ? EFluidSimulationAdvection::None : InAdvectionSettings.Scheme;
+    const bool bProject = InProjectionSettings.bEnabled && InProjection.IsValid() && !bShallowWater;
+    const FRDGTextureRef ScratchVelocity = bProject ? GraphBuilder.RegisterExternalTexture(InProjection.ScratchVelocity, TEXT("FluidSimulationScratchVelocity")) : nullptr;
+
+    const int32 ThreadGroupSize = FFluidSimulationCS::GetThreadGroupSize();
+    const bool bActiveTiles = InActivity.IsValid();
+
+    FFluidSimulationActiveTiles ActiveTiles;
+    if (bActiveTiles)
+    {
+        ActiveTiles = InActivity.BuildActiveList_RenderThread(ThreadGroupSize, Fields, ScratchVelocity, Brushes, Allocation, InFieldOrigin, PassFlags, GraphBuilder);
+    }
+
+    FFluidSimulationCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationCS::FParameters>();
+    Params->PreviousVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(PreviousField.Velocity));
+    Params->PreviousDensity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(PreviousField.Density));
+    Params->CurrentVelocity = GraphBuilder.CreateUAV(bProject ? ScratchVelocity : CurrentField.Velocity);
+    Params->CurrentDensity = GraphBuilder.CreateUAV(CurrentField.Density);
+    Params->SimulationGridSize = InSimulationGridSize;
+    Params->SimulationGridSizeRecip = 1.0f / static_cast<float>(InSimulationGridSize);
+    Params->FluidDifusion = InFluidDifusion;
+    Params->FluidViscosity = InFluidViscosity;
+    Params->DeltaTime = InDeltaTime;
+    Params->ActiveTiles = ActiveTiles.ActiveTileList;
+    Params->ActivityTileSize = InActivity.TileSize;
+    Params->Brushes = Brushes;
+    Params->BrushOffset = Allocation.Offset;
+    Params->NumBrushes = Allocation.Num;
+    Params->ShallowWaterStiffness = InDeltaTime > 0.0f ? FMath::Square(InShallowWaterSettings.GetCourantNumber(InDeltaTime)) / InDeltaTime : 0.0f;
+    Params->ShallowWaterDamping = InShallowWaterSettings.GetDampingFactor(InDeltaTime);
+    Params->ShallowWaterBrushDepth = InShallowWaterSettings.BrushDepth;
+    Params->FieldOrigin = InFieldOrigin;
+    Params->FieldSampler = TStaticSamplerState<SF_Bilinear, AM_Wrap, AM_Wrap, AM_Clamp>::GetRHI();
+    Params->AdvectionStep = InAdvectionSettings.GetCellsPerVelocity(InDeltaTime);
+    Params->AdvectionMaxDistance = InAdvectionSettings.GetMaxDistance();
+    Params->IndirectDispatchArgs = ActiveTiles.IndirectArgs;
+
+    FFluidSimulationCS::FPermutationDomain PermutationVector;
+    PermutationVector.Set<FFluidSimulationCS::FThreadGroupSizeDim>(ThreadGroupSize);
+    PermutationVector.Set<FFluidSimulationCS::FActiveTilesDim>(bActiveTiles);
+    PermutationVector.Set<FFluidSimulationCS::FShallowWaterDim>(bShallowWater);
+    PermutationVector.Set<FFluidSimulationCS::FAdvectionDim>(Advection);
+
+    TShaderMapRef<FFluidSimulationCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel), PermutationVector);
+
+    // The projection and activity passes report their own GPU stats
+    {
+        RDG_GPU_STAT_SCOPE(GraphBuilder, FluidSimulationSolve);
+
+        if (bActiveTiles)
+        {
+            // Quiescent tiles are skipped, the list and the dispatch size never leave the GPU
+            FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSimulation ActiveTiles"), PassFlags, ComputeShader, Params, ActiveTiles.IndirectArgs, FFluidSimulationActivity::SolveArgsOffset * sizeof(uint32));
+        }
+        else
+        {
+            // Every surface of the batch in a single dispatch, one group layer per slice
+            FIntVector GroupCount = FComputeShaderUtils::GetGroupCount(FIntVector(InSimulationGridSize, InSimulationGridSize, InNumSlices), FIntVector(ThreadGroupSize, ThreadGroupSize, 1));
+            FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSimulation %dx%dx%d", InSimulationGridSize, InSimulationGridSize, InNumSlices), PassFlags, ComputeShader, Params, GroupCount);
+        }
+    }
+
+    if (bProject)
+    {
+        InProjection.Project_RenderThread(InProjectionSettings, ScratchVelocity, CurrentField.Velocity, InFieldOrigin, InActivity, PassFlags, GraphBuilder);
+    }
+
+    if (bActiveTiles)
+    {
+        InActivity.Measure_RenderThread(ActiveTiles, CurrentField, InFieldOrigin, PassFlags, GraphBuilder);
+    }
+
+    GraphBuilder.Execute();
+}
+
+void UFluidSimulationRender::UpdateDetail_RenderThread(const int32 InSimulationGridSize, const FFluidSimulationField& InGridField, const FFluidSimulationField& InNextGridField, const FIntPoint& InFieldOrigin, const FFluidSimulationActivity& InActivity, const FFluidSimulationDetail& InDetail, const int32 InNumSubsteps, const float InFluidDifusion, const float InFluidViscosity, const float InDeltaTime, const FFluidSimulationProjectionSettings& InProjectionSettings, const EFluidSimulationSolver InSolver, const FFluidSimulationShallowWaterSettings& InShallowWaterSettings, const FFluidSimulationAdvectionSettings& InAdvectionSettings, const TArray<FFluidSimulationBrush>& InBrushes, FRHICommandListImmediate& RHICmdList)
+{
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationRender_UpdateDetail_RenderThread);
+    SCOPED_DRAW_EVENT(RHICmdList, FluidSimulationRender_UpdateDetail_RenderThread);
+
+    if (!InDetail.IsValid() || !InGridField.IsValid() || !InNextGridField.IsValid())
+    {
+        return;
+    }
+
+    const ERDGPassFlags PassFlags = FluidSimulationRender::GetComputePassFlags();
+    const int32 NumSubsteps = FMath::Max(InNumSubsteps, 1);
+    const bool bPlacePatches = InDetail.Patches.ContainsByPredicate([](const FFluidSimulationDetailPatch& InPatch) { return InPatch.IsLive() && InPatch.bNeedsInit; });
+
+    // Waves cross RefinementRatio patch cells per grid cell, the substeps keep them within the Courant limit
+    FFluidSimulationShallowWaterSettings PatchShallowWaterSettings = InShallowWaterSettings;
+    PatchShallowWaterSettings.WaveSpeed *= InDetail.RefinementRatio;
+
+    // Same for the fluid, a unit of velocity moves it across RefinementRatio times more patch cells
+    FFluidSimulationAdvectionSettings PatchAdvectionSettings = InAdvectionSettings;
+    PatchAdvectionSettings.VelocityScale *= InDetail.RefinementRatio;
+    PatchAdvectionSettings.MaxCellsPerStep *= InDetail.RefinementRatio;
 
-    TShaderMapRef<FFluidSimulationCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel));
-    FIntVector GroupCount = FIntVector(InSimulationGridSize * InSimulationGridSize, 1, 1); // Temporary usage of a Raw group count 'InSimulationGridSize * InSimulationGridSize'
-    FComputeShaderUtils::Dispatch(RHICmdList, ComputeShader, Params, GroupCount);
+    const TArray<FFluidSimulationBrush> NoBrushes;
+    const FFluidSimulationActivity NoActivity;
+    int32 FieldIndex = InDetail.CurrentFieldIndex;
+
+    for (int32 Substep = 0; Substep < NumSubsteps; ++Substep)
+    {
+        // The grid state the step started from drives the patch border, patches just placed are filled whole in every field of the ring
+        {
+            FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationRender_ProlongateDetail"));
+            const FFluidSimulationFieldTextures Grid = InGridField.Register(GraphBuilder);
+
+            for (int32 Index = 0; Index < InDetail.Fields.Num(); ++Index)
+            {
+                const bool bBorders = Index == FieldIndex;
+                const bool bPlace = bPlacePatches && Substep == 0;
+
+                if (bBorders || bPlace)
+                {
+                    InDetail.Prolongate_RenderThread(Grid, InSimulationGridSize, InFieldOrigin, InDetail.Fields[Index].Register(GraphBuilder), bBorders, bPlace, PassFlags, GraphBuilder);
+                }
+            }
+
+            GraphBuilder.Execute();
+        }
+
+        // Every patch of the pool is a slice, solved by the same passes as the grid with the brushes of the first substep
+        const int32 NextFieldIndex = InDetail.GetNextFieldIndex(FieldIndex);
+        UpdateFluid_RenderThread(InDetail.PatchGridSize, InDetail.Patches.Num(), InFluidDifusion, InFluidViscosity, InDeltaTime / NumSubsteps, InDetail.Fields[NextFieldIndex], InDetail.Fields[FieldIndex], InProjectionSettings, InDetail.Projection, InDetail.Fields, NoActivity, InSolver, PatchShallowWaterSettings, PatchAdvectionSettings, Substep == 0 ? InBrushes : NoBrushes, FIntPoint::ZeroValue, RHICmdList);
+        FieldIndex = NextFieldIndex;
+    }
+
+    FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationRender_RestrictDetail"));
+    InDetail.Restrict_RenderThread(InDetail.Fields[FieldIndex].Register(GraphBuilder), InSimulationGridSize, InFieldOrigin, InActivity, InNextGridField.Register(GraphBuilder), PassFlags, GraphBuilder);
+    GraphBuilder.Execute();
 }
 
-void UFluidSimulationRender::DrawToRenderTarget_RenderThread(class UTextureRenderTarget2D* InRenderTarget, const int32 InSimulationGridSize, const FVertexBufferRHIRef& InVertexBuffer, const FUnorderedAccessViewRHIRef& InBufferUAV, FRHICommandListImmediate& RHICmdList)
+void UFluidSimulationRender::DrawToRenderTarget_RenderThread(class UTextureRenderTarget2D* InRenderTarget, const int32 InSimulationGridSize, const int32 InSlice, const FFluidSimulationField& InField, const FFluidSimulationField& InPreviousField, const float InInterpolationAlpha, const EFluidSimulationUpsampleFilter InUpsampleFilter, const EFluidSimulationSolver InSolver, const FFluidSimulationShallowWaterSettings& InShallowWaterSettings, const FIntPoint& InFieldOrigin, const FFluidSimulationDetail& InDetail, FRHICommandListImmediate& RHICmdList)
 {
     check(IsInRenderingThread());
-    QUICK_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationRender_DrawToRenderTarget_RenderThread);
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationRender_DrawToRenderTarget_RenderThread);
     SCOPED_DRAW_EVENT(RHICmdList, FluidSimulationRender_UDrawToRenderTarget_RenderThread);
 
+    FTextureRenderTargetResource* const RenderTargetResource = InRenderTarget != nullptr ? InRenderTarget->GetRenderTargetResource() : nullptr;
+
+    if (RenderTargetResource != nullptr && InField.IsValid() && InPreviousField.IsValid())
+    {
+        FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationRender_DrawToRenderTarget"));
+        RDG_GPU_STAT_SCOPE(GraphBuilder, FluidSimulationDraw);
+
+        const FFluidSimulationFieldTextures Field = InField.Register(GraphBuilder);
+        const FFluidSimulationFieldTextures PreviousField = InPreviousField.Register(GraphBuilder);
+        const FRDGTextureRef RenderTarget = GraphBuilder.RegisterExternalTexture(CreateRenderTarget(RenderTargetResource->GetRenderTargetTexture(), TEXT("FluidSimulationOutput")));
+
+        if (RenderTarget->Desc.Extent == FIntPoint(InSimulationGridSize, InSimulationGridSize))
+        {
+            // Targets created with bCanCreateUAV are written in place, any other one goes through a pooled texture and a copy
+            const bool bWriteInPlace = EnumHasAnyFlags(RenderTarget->Desc.Flags, TexCreate_UAV);
+            const FRDGTextureRef Output = bWriteInPlace ? RenderTarget : GraphBuilder.CreateTexture(FRDGTextureDesc::Create2D(RenderTarget->Desc.Extent, RenderTarget->Desc.Format, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV), TEXT("FluidSimulationDrawOutput"));
+
+            FFluidSimulationDrawCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationDrawCS::FParameters>();
+            Params->OutTexture = GraphBuilder.CreateUAV(Output);
+            Params->FluidVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(Field.Velocity));
+            Params->FluidDensity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(Field.Density));
+            Params->PreviousFluidVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(PreviousField.Velocity));
+            Params->PreviousFluidDensity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(PreviousField.Density));
+            Params->InterpolationAlpha = FMath::Clamp(InInterpolationAlpha, 0.0f, 1.0f);
+            Params->SimulationGridSize = InSimulationGridSize;
+            Params->SimulationGridSizeRecip = 1.0f / static_cast<float>(InSimulationGridSize);
+            Params->Slice = InSlice;
+            Params->NormalStrength = InShallowWaterSettings.NormalStrength;
+            Params->FieldOrigin = InFieldOrigin;
+
+            FFluidSimulationDrawCS::FPermutationDomain PermutationVector;
+            PermutationVector.Set<FFluidSimulationDrawCS::FShallowWaterDim>(InSolver == EFluidSimulationSolver::ShallowWater);
+
+            TShaderMapRef<FFluidSimulationDrawCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel), PermutationVector);
+            FIntVector GroupCount = FComputeShaderUtils::GetGroupCount(FIntPoint(InSimulationGridSize, InSimulationGridSize), FFluidSimulationDrawCS::ThreadGroupSize);
+            FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSimulationDraw %dx%d", InSimulationGridSize, InSimulationGridSize), FluidSimulationRender::GetComputePassFlags(), ComputeShader, Params, GroupCount);
+
+            if (!bWriteInPlace)
+            {
+                AddCopyTexturePass(GraphBuilder, Output, RenderTarget, FRHICopyTextureInfo());
+            }
+        }
+        else
+        {
+            // Any other size is rasterized, every pixel filters the fields at its own UV and the patches where they are
+            const bool bDetail = InDetail.IsValid() && InDetail.HasLivePatches();
+
+            FFluidSimulationPS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationPS::FParameters>();
+            Params->FluidVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(Field.Velocity));
+            Params->PreviousFluidVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(PreviousField.Velocity));
+            Params->FieldSampler = TStaticSamplerState<SF_Bilinear, AM_Border, AM_Border, AM_Clamp>::GetRHI();
+            Params->SimulationGridSize = InSimulationGridSize;
+            Params->SimulationGridSizeRecip = 1.0f / static_cast<float>(InSimulationGridSize);
+            Params->Slice = InSlice;
+            Params->InterpolationAlpha = FMath::Clamp(InInterpolationAlpha, 0.0f, 1.0f);
+            Params->NormalStrength = InShallowWaterSettings.NormalStrength;
+            Params->FieldOrigin = InFieldOrigin;
+
+            if (bDetail)
+            {
+                Params->DetailVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InDetail.Fields[InDetail.CurrentFieldIndex].Register(GraphBuilder).Velocity));
+                Params->PreviousDetailVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(InDetail.Fields[InDetail.GetPreviousFieldIndex()].Register(GraphBuilder).Velocity));
+                Params->NumDetailPatches = static_cast<uint32>(InDetail.Patches.Num());
+                Params->DetailGridSize = InDetail.PatchGridSize;
+                Params->DetailRatio = InDetail.RefinementRatio;
+
+                for (int32 Index = 0; Index < FFluidSimulationDetailCS::MaxPatches; ++Index)
+                {
+                    Params->DetailPatches[Index] = InDetail.GetPatchParameters(Index, true, false);
+                }
+            }
+
+            Params->RenderTargets[0] = FRenderTargetBinding(RenderTarget, ERenderTargetLoadAction::ENoAction);
+
+            FFluidSimulationPS::FPermutationDomain PermutationVector;
+            PermutationVector.Set<FFluidSimulationPS::FBicubicDim>(InUpsampleFilter == EFluidSimulationUpsampleFilter::Bicubic);
+            PermutationVector.Set<FFluidSimulationPS::FShallowWaterDim>(InSolver == EFluidSimulationSolver::ShallowWater);
+            PermutationVector.Set<FFluidSimulationPS::FDetailDim>(bDetail);
+
+            FGlobalShaderMap* const ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+            TShaderMapRef<FFluidSimulationVS> VertexShader(ShaderMap);
+            TShaderMapRef<FFluidSimulationPS> PixelShader(ShaderMap, PermutationVector);
+            const FIntPoint Extent = RenderTarget->Desc.Extent;
+
+            GraphBuilder.AddPass
+            (
+                RDG_EVENT_NAME("FluidSimulationUpsample %dx%d -> %dx%d", InSimulationGridSize, InSimulationGridSize, Extent.X, Extent.Y),
+                Params,
+                ERDGPassFlags::Raster,
+                [Params, VertexShader, PixelShader, Extent](FRHICommandList& InRHICmdList)
+                {
+                    InRHICmdList.SetViewport(0.0f, 0.0f, 0.0f, static_cast<float>(Extent.X), static_cast<float>(Extent.Y), 1.0f);
+
+                    FGraphicsPipelineStateInitializer GraphicsPSOInit;
+                    InRHICmdList.ApplyCachedRenderTargets(GraphicsPSOInit);
+                    GraphicsPSOInit.BlendState = TStaticBlendState<>::GetRHI();
+                    GraphicsPSOInit.RasterizerState = TStaticRasterizerState<>::GetRHI();
+                    GraphicsPSOInit.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
+                    GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GEmptyVertexDeclaration.VertexDeclarationRHI;
+                    GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
+                    GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
+                    GraphicsPSOInit.PrimitiveType = PT_TriangleList;
+                    SetGraphicsPipelineState(InRHICmdList, GraphicsPSOInit);
+
+                    SetShaderParameters(InRHICmdList, PixelShader, PixelShader.GetPixelShader(), *Params);
+
+                    // Single triangle covering the target, the vertex shader builds it from the vertex id
+                    InRHICmdList.DrawPrimitive(0, 1, 1);
+                }
+            );
+        }
+
+        // Far away surfaces sample the lower mips instead of aliasing the full resolution one
+        if (RenderTarget->Desc.NumMips > 1)
+        {
+            FGenerateMips::Execute(GraphBuilder, RenderTarget, TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI());
+        }
+
+        GraphBuilder.Execute();
+    }
+}
+
+void UFluidSimulationRender::InitResources_RenderThread(FPendingInit& OutInit, const int32 InSimulationGridSize, const int32 InNumSlices, const int32 InNumFieldBuffers, const EFluidSimulationFieldPrecision InFieldPrecision, const bool bInProjection, const FFluidSimulationActivitySettings& InActivitySettings, const FFluidSimulationDetailSettings& InDetailSettings, const FFluidSimulationField& InSourceField, const int32 InSourceGridSize, const int32 InSourceNumSlices, const FIntPoint& InSourceFieldOrigin, FRHICommandListImmediate& RHICmdList)
+{
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationRender_InitResources_RenderThread);
+
+    // Resources are created uninitialized and cleared on the GPU, no cell is touched on the CPU
+    OutInit.Fields.SetNum(InNumFieldBuffers);
+
+    for (FFluidSimulationField& Field : OutInit.Fields)
+    {
+        Field.Init_RenderThread(InSimulationGridSize, InNumSlices, InFieldPrecision, RHICmdList);
+    }
+
+    // The heightfield has no pressure to solve
+    if (bInProjection)
+    {
+        OutInit.Projection.Init_RenderThread(InSimulationGridSize, InNumSlices, InFieldPrecision, RHICmdList);
+    }
+
+    if (InActivitySettings.bEnabled)
+    {
+        OutInit.Activity.Init_RenderThread(InSimulationGridSize, InNumSlices, InActivitySettings, RHICmdList);
+    }
+
+    if (InDetailSettings.bEnabled)
+    {
+        OutInit.Detail.Init_RenderThread(InDetailSettings, InNumFieldBuffers, InFieldPrecision, bInProjection, RHICmdList);
+    }
+
+    if (!InSourceField.IsValid() || InSourceNumSlices <= 0)
+    {
+        return;
+    }
+
+    FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationRender_Resample"));
+
+    const FFluidSimulationFieldTextures Source = InSourceField.Register(GraphBuilder);
+    const FRDGTextureSRVRef SourceVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(Source.Velocity));
+    const FRDGTextureSRVRef SourceDensity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(Source.Density));
+
+    TShaderMapRef<FFluidSimulationResampleCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel));
+    const FIntVector GroupCount = FComputeShaderUtils::GetGroupCount(FIntVector(InSimulationGridSize, InSimulationGridSize, InSourceNumSlices), FIntVector(FFluidSimulationResampleCS::ThreadGroupSize, FFluidSimulationResampleCS::ThreadGroupSize, 1));
+
+    for (const FFluidSimulationField& Field : OutInit.Fields)
+    {
+        const FFluidSimulationFieldTextures Destination = Field.Register(GraphBuilder);
+
+        FFluidSimulationResampleCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationResampleCS::FParameters>();
+        Params->SourceVelocity = SourceVelocity;
+        Params->SourceDensity = SourceDensity;
+        Params->OutFluidVelocity = GraphBuilder.CreateUAV(Destination.Velocity);
+        Params->OutFluidDensity = GraphBuilder.CreateUAV(Destination.Density);
+        Params->SourceGridSize = InSourceGridSize;
+        Params->SimulationGridSize = InSimulationGridSize;
+        Params->NumSlices = static_cast<uint32>(InSourceNumSlices);
+        Params->SourceFieldOrigin = InSourceFieldOrigin;
+        Params->FieldOrigin = FIntPoint::ZeroValue;
+
+        FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSimulationResample %d -> %d", InSourceGridSize, InSimulationGridSize), ComputeShader, Params, GroupCount);
+    }
+
+    OutInit.Activity.ActivateAll_RenderThread(GraphBuilder);
+
+    GraphBuilder.Execute();
+}
+
+void UFluidSimulationRender::RestoreFields_RenderThread(const int32 InSimulationGridSize, const int32 InSlice, const TArray<FVector4>& InCells, const TArray<FFluidSimulationField>& InFields, const FFluidSimulationActivity& InActivity, const FIntPoint& InFieldOrigin, FRHICommandListImmediate& RHICmdList)
+{
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationRender_RestoreFields_RenderThread);
+
+    FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationRender_RestoreFields"));
+
+    const FRDGBufferRef Cells = CreateStructuredBuffer(GraphBuilder, TEXT("FluidSimulationRestoreCells"), sizeof(FVector4), InCells.Num(), InCells.GetData(), InCells.Num() * sizeof(FVector4));
+    const FRDGBufferSRVRef CellsSRV = GraphBuilder.CreateSRV(Cells);
+
+    TShaderMapRef<FFluidSimulationRestoreCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel));
+    const FIntVector GroupCount = FComputeShaderUtils::GetGroupCount(FIntPoint(InSimulationGridSize, InSimulationGridSize), FFluidSimulationRestoreCS::ThreadGroupSize);
+
+    // Every field of the ring gets the state, so the interpolated draw and the next solve agree
+    for (const FFluidSimulationField& Field : InFields)
+    {
+        if (!Field.IsValid())
+        {
+            continue;
+        }
+
+        const FFluidSimulationFieldTextures Textures = Field.Register(GraphBuilder);
+
+        FFluidSimulationRestoreCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationRestoreCS::FParameters>();
+        Params->RestoreCells = CellsSRV;
+        Params->OutFluidVelocity = GraphBuilder.CreateUAV(Textures.Velocity);
+        Params->OutFluidDensity = GraphBuilder.CreateUAV(Textures.Density);
+        Params->SimulationGridSize = InSimulationGridSize;
+        Params->Slice = static_cast<uint32>(InSlice);
+        Params->FieldOrigin = InFieldOrigin;
+
+        FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSimulationRestore"), ComputeShader, Params, GroupCount);
+    }
+
+    InActivity.ActivateAll_RenderThread(GraphBuilder);
+
+    GraphBuilder.Execute();
+}
+
+void UFluidSimulationRender::MoveWindow_RenderThread(const int32 InSimulationGridSize, const int32 InNumSlices, const FIntPoint& InFieldOrigin, const FIntPoint& InDelta, const TArray<FFluidSimulationField>& InFields, const FFluidSimulationActivity& InActivity, FRHICommandListImmediate& RHICmdList)
+{
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationRender_MoveWindow_RenderThread);
+
+    const int32 GridSize = InSimulationGridSize;
+
+    // Window cells entering the grid, a column strip for X and a row strip for Y, or the whole grid after a jump
+    TArray<FIntRect, TInlineAllocator<2>> Strips;
+
+    if (FMath::Abs(InDelta.X) >= GridSize || FMath::Abs(InDelta.Y) >= GridSize)
+    {
+        Strips.Emplace(0, 0, GridSize, GridSize);
+    }
+    else
+    {
+        if (InDelta.X != 0)
+        {
+            Strips.Emplace(InDelta.X > 0 ? GridSize - InDelta.X : 0, 0, InDelta.X > 0 ? GridSize : -InDelta.X, GridSize);
+        }
+
+        if (InDelta.Y != 0)
+        {
+            Strips.Emplace(0, InDelta.Y > 0 ? GridSize - InDelta.Y : 0, GridSize, InDelta.Y > 0 ? GridSize : -InDelta.Y);
+        }
+    }
+
+    FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationRender_MoveWindow"));
+    TShaderMapRef<FFluidSimulationWindowCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel));
+
+    // Every field of the ring is cleared, the interpolated draw reads the previous one
+    for (const FFluidSimulationField& Field : InFields)
+    {
+        if (!Field.IsValid())
+        {
+            continue;
+        }
+
+        const FFluidSimulationFieldTextures Textures = Field.Register(GraphBuilder);
+
+        for (const FIntRect& Strip : Strips)
+        {
+            FFluidSimulationWindowCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationWindowCS::FParameters>();
+            Params->OutFluidVelocity = GraphBuilder.CreateUAV(Textures.Velocity);
+            Params->OutFluidDensity = GraphBuilder.CreateUAV(Textures.Density);
+            Params->SimulationGridSize = GridSize;
+            Params->NumSlices = static_cast<uint32>(InNumSlices);
+            Params->FieldOrigin = InFieldOrigin;
+            Params->StripOrigin = Strip.Min;
+            Params->StripSize = Strip.Size();
+
+            const FIntVector GroupCount = FComputeShaderUtils::GetGroupCount(FIntVector(Strip.Width(), Strip.Height(), InNumSlices), FIntVector(FFluidSimulationWindowCS::ThreadGroupSize, FFluidSimulationWindowCS::ThreadGroupSize, 1));
+            FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSimulationWindowClear %dx%d", Strip.Width(), Strip.Height()), ComputeShader, Params, GroupCount);
+        }
+    }
+
+    // The tile flags were measured on the old window, the pressure guess is left as is for the V-cycles to correct
+    InActivity.ActivateAll_RenderThread(GraphBuilder);
+
+    GraphBuilder.Execute();
+}
+
+void UFluidSimulationRender::DrawCPUToRenderTarget_RenderThread(class UTextureRenderTarget2D* InRenderTarget, const int32 InSimulationGridSize, const TArray<FColor>& InColors, FRHICommandListImmediate& RHICmdList)
+{
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationRender_DrawCPUToRenderTarget_RenderThread);
+
     if (InRenderTarget != nullptr)
     {
-        // Gets a render target from RenderTargetPool
-        TRefCountPtr<IPooledRenderTarget> ComputeShaderOutput;
-        FPooledRenderTargetDesc ComputeShaderOutputDesc(FPooledRenderTargetDesc::Create2DDesc(FIntPoint(InRenderTarget->SizeX, InRenderTarget->SizeY), InRenderTarget->GetFormat(), FClearValueBinding::None, TexCreate_None, TexCreate_ShaderResource | TexCreate_UAV, false));
-        ComputeShaderOutputDesc.DebugName = TEXT("DrawToRenderTarget");
-        GRenderTargetPool.FindFreeElement(RHICmdList, ComputeShaderOutputDesc, ComputeShaderOutput, TEXT("DrawToRenderTarget"));
-    
-        FFluidSimulationDrawCS::FParameters Params;
-        Params.OutTexture = ComputeShaderOutput.GetReference()->GetRenderTargetItem().UAV;
-        Params.FluidData = InBufferUAV;
-        Params.SimulationGridSize = InSimulationGridSize;
-        Params.SimulationGridSizeRecip = 1.0f / static_cast<float>(InSimulationGridSize);
-    
-        TShaderMapRef<FFluidSimulationDrawCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel));
-        FIntVector GroupCount = FIntVector(InSimulationGridSize * InSimulationGridSize, 1, 1);
-        FComputeShaderUtils::Dispatch(RHICmdList, ComputeShader, Params, GroupCount);
-    
-        RHICmdList.CopyToResolveTarget(ComputeShaderOutput.GetReference()->GetRenderTargetItem().ShaderResourceTexture, InRenderTarget->GetRenderTargetResource()->TextureRHI->GetTexture2D(), FResolveParams());
-    }
-
-    // if (InRenderTarget != nullptr)
-    // {
-    //     if (FTextureRenderTargetResource* const DrawResource = InRenderTarget->GetRenderTargetResource())
-    //     {
-    //         const FTexture2DRHIRef& DrawTarget = DrawResource->GetRenderTargetTexture();
-    // 
-    //         // Create render pass for render target
-    //         FRHIRenderPassInfo RenderPassInfo(DrawTarget, ERenderTargetActions::Clear_Store);
-    //         RHICmdList.BeginRenderPass(RenderPassInfo, TEXT("FluidSimulationDrawToRenderTarget"));
-    //         {
-    //             FIntVector DstSizeXYZ = DrawTarget->GetSizeXYZ();
-    //             RHICmdList.SetViewport(0.0f, 0.0f, 0.0f, DstSizeXYZ.X, DstSizeXYZ.Y, 0.0f);
-    // 
-    //             // Get Shaders from global shader map
-    //             auto ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
-    //             TShaderMapRef<FFluidSimulationVS> VertexShader(ShaderMap);
-    //             TShaderMapRef<FFluidSimulationPS> PixelShader(ShaderMap);
-    // 
-    //             // Create PSO
-    //             FGraphicsPipelineStateInitializer GraphicsPSOInit;
-    //             RHICmdList.ApplyCachedRenderTargets(GraphicsPSOInit);
-    // 
-    //             GraphicsPSOInit.BlendState = TStaticBlendState<CW_RGBA, BO_Add, BF_One, BF_One>::GetRHI();
-    //             GraphicsPSOInit.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
-    //             GraphicsPSOInit.RasterizerState = TStaticRasterizerState<>::GetRHI();
-    //             GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
-    //             GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
-    //             GraphicsPSOInit.PrimitiveType = PT_TriangleStrip;
-    // 
-    //             /*
-    //                 FIndexBufferRHIRef I'll need this :D
-    //                 C:\Program Files (x86)\Epic Games\UE_4.27\Engine\Plugins\Experimental\RemoteSession\Source\RemoteSession\Private\Channels\RemoteSessionARCameraChannel.cpp
-    //                 const int32 NumTriangles = FCircleRasterizeVertexBuffer::NumVertices - 2;
-    // 
-    // 
-    // 
-    //                 From VolumetricFog.cpp :D
-    // 
-    //                 TResourceArray<uint16, INDEXBUFFER_ALIGNMENT> Indices;
-    //                 Indices.Empty(NumTriangles * 3);
-    // 
-    //                 for (int32 TriangleIndex = 0; TriangleIndex < NumTriangles; TriangleIndex++)
-    //                 {
-    //                     int32 LeadingVertexIndex = TriangleIndex + 2;
-    //                     Indices.Add(0);
-    //                     Indices.Add(LeadingVertexIndex - 1);
-    //                     Indices.Add(LeadingVertexIndex);
-    //                 }
-    // 
-    //                 const uint32 Size = Indices.GetResourceDataSize();
-    //                 const uint32 Stride = sizeof(uint16);
-    // 
-    //                 // Create index buffer. Fill buffer with initial data upon creation
-    //                 FRHIResourceCreateInfo CreateInfo(&Indices);
-    //                 IndexBufferRHI = RHICreateIndexBuffer(Stride, Size, BUF_Static, CreateInfo);
-    //             */
-    // 
-    // 
-    //             FVertexDeclarationRHIRef VertexDeclarationRHI = PipelineStateCache::GetOrCreateVertexDeclaration(UFluidSimulationRender::VertexSimulationDataDeclaration);
-    //             GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = VertexDeclarationRHI;
-    //             // Set Pipeline State Object
-    //             SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit);
-    // 
-    //             // Set Shader Parameters
-    //             FFluidSimulationVS::FParameters VSParams;
-    //             FFluidSimulationPS::FParameters PSParams;
-    // 
-    //             SetShaderParameters(RHICmdList, VertexShader, VertexShader.GetVertexShader(), VSParams);
-    //             SetShaderParameters(RHICmdList, PixelShader, PixelShader.GetPixelShader(), PSParams);
-    // 
-    // 
-    //             RHICmdList.SetStreamSource(0, InVertexBuffer, 0);
-    //             RHICmdList.DrawPrimitive(0, 256 * 256, 1);
-    //             // RHICmdList.DrawIndexedPrimitive( ... )
-    //         }
-    // 
-    //         RHICmdList.EndRenderPass();
-    //     }
-    // }
-}
\ No newline at end of file
+        if (FTextureRenderTargetResource* const RenderTargetResource = InRenderTarget->GetRenderTargetResource())
+        {
+            const FUpdateTextureRegion2D Region(0, 0, 0, 0, InSimulationGridSize, InSimulationGridSize);
+            RHIUpdateTexture2D(RenderTargetResource->GetRenderTargetTexture(), 0, Region, InSimulationGridSize * sizeof(FColor), reinterpret_cast<const uint8*>(InColors.GetData()));
+        }
+    }
+}
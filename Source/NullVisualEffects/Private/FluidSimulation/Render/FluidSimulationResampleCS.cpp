@@ -0,0 +1,5 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationResampleCS.h"
+
+IMPLEMENT_GLOBAL_SHADER(FFluidSimulationResampleCS, "/NullVisualEffects/FluidSimulation/FluidSimulationResampleCS.usf", "MainCS", SF_Compute);
\ No newline at end of file
@@ -0,0 +1,5 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationRestoreCS.h"
+
+IMPLEMENT_GLOBAL_SHADER(FFluidSimulationRestoreCS, "/NullVisualEffects/FluidSimulation/FluidSimulationRestoreCS.usf", "MainCS", SF_Compute);
\ No newline at end of file
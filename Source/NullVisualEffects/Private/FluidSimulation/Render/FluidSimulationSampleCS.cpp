@@ -0,0 +1,5 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationSampleCS.h"
+
+IMPLEMENT_GLOBAL_SHADER(FFluidSimulationSampleCS, "/NullVisualEffects/FluidSimulation/FluidSimulationSampleCS.usf", "MainCS", SF_Compute);
\ No newline at end of file
@@ -0,0 +1,221 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationSampler.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "FluidSimulation/Render/FluidSimulationSampleCS.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "RHIGPUReadback.h"
+
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationSampler Update"), STAT_FluidSimulationSampler_Update, STATGROUP_NullVisualEffects);
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationSampler Gather RT"), STAT_FluidSimulationSampler_Gather_RenderThread, STATGROUP_NullVisualEffects);
+
+DECLARE_GPU_STAT_NAMED(FluidSimulationSample, TEXT("Fluid Simulation Sample"));
+
+FFluidSimulationSampler::FFluidSimulationSampler()
+{
+}
+
+FFluidSimulationSampler::~FFluidSimulationSampler()
+{
+    Release();
+}
+
+TFuture<TArray<FFluidSimulationSample>> FFluidSimulationSampler::Enqueue(TArrayView<const FVector2D> InCoords, const int32 InSlice)
+{
+    check(IsInGameThread());
+
+    FQuery& Query = PendingQueries.AddDefaulted_GetRef();
+    Query.First = PendingPoints.Num();
+    Query.Num = InCoords.Num();
+
+    for (const FVector2D& Coords : InCoords)
+    {
+        FFluidSimulationSamplePoint& Point = PendingPoints.AddDefaulted_GetRef();
+        Point.Coords = Coords;
+        Point.Slice = static_cast<uint32>(FMath::Max(InSlice, 0));
+    }
+
+    return Query.Promise.GetFuture();
+}
+
+void FFluidSimulationSampler::Update(const FFluidSimulationField& InField, const int32 InSimulationGridSize, const int32 InLatency, const FIntPoint& InFieldOrigin)
+{
+    check(IsInGameThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationSampler_Update);
+
+    const uint64 Latency = static_cast<uint64>(FMath::Clamp(InLatency, 1, 3));
+
+    for (int32 Index = 0; Index < InFlight.Num();)
+    {
+        FInFlightBatch& Entry = InFlight[Index];
+
+        if (Entry.Batch->bResolved)
+        {
+            Resolve(Entry.Queries, Entry.Batch->Results);
+            InFlight.RemoveAt(Index);
+            continue;
+        }
+
+        // Polling never waits on the GPU, a readback that is not ready yet is polled again next frame
+        if (GFrameCounter - Entry.Batch->SubmitFrame >= Latency)
+        {
+            ENQUEUE_RENDER_COMMAND(FluidSimulationSampler_Poll)
+            (
+                [ Batch = Entry.Batch ]
+                (FRHICommandListImmediate& RHICmdList)
+                {
+                    Poll_RenderThread(*Batch);
+                }
+            );
+        }
+
+        ++Index;
+    }
+
+    if (PendingPoints.Num() == 0)
+    {
+        return;
+    }
+
+    if (!InField.IsValid() || InSimulationGridSize <= 0)
+    {
+        Resolve(PendingQueries, TArrayView<const FVector4>());
+        PendingPoints.Reset();
+        return;
+    }
+
+    INC_DWORD_STAT_BY(STAT_FluidSimulation_SamplePoints, PendingPoints.Num());
+
+    TSharedPtr<FBatch, ESPMode::ThreadSafe> Batch = MakeShared<FBatch, ESPMode::ThreadSafe>();
+    Batch->NumPoints = PendingPoints.Num();
+    Batch->SubmitFrame = GFrameCounter;
+
+    ENQUEUE_RENDER_COMMAND(FluidSimulationSampler_Gather)
+    (
+        [
+            Batch               = Batch,
+            Points              = MoveTemp(PendingPoints),
+            Field               = InField,
+            SimulationGridSize  = InSimulationGridSize,
+            FieldOrigin         = InFieldOrigin
+        ]
+        (FRHICommandListImmediate& RHICmdList)
+        {
+            Gather_RenderThread(*Batch, Points, Field, SimulationGridSize, FieldOrigin, RHICmdList);
+        }
+    );
+
+    FInFlightBatch& Entry = InFlight.AddDefaulted_GetRef();
+    Entry.Batch = Batch;
+    Entry.Queries = MoveTemp(PendingQueries);
+
+    PendingPoints.Reset();
+    PendingQueries.Reset();
+}
+
+void FFluidSimulationSampler::Translate(const FVector2D& InOffset)
+{
+    check(IsInGameThread());
+
+    for (FFluidSimulationSamplePoint& Point : PendingPoints)
+    {
+        Point.Coords += InOffset;
+    }
+}
+
+void FFluidSimulationSampler::Release()
+{
+    // Nobody waits forever on a query, the batches still referenced by render commands are freed by them
+    for (FInFlightBatch& Entry : InFlight)
+    {
+        Resolve(Entry.Queries, TArrayView<const FVector4>());
+    }
+
+    Resolve(PendingQueries, TArrayView<const FVector4>());
+
+    InFlight.Reset();
+    PendingQueries.Reset();
+    PendingPoints.Reset();
+}
+
+void FFluidSimulationSampler::Resolve(TArray<FQuery>& InQueries, TArrayView<const FVector4> InResults)
+{
+    for (FQuery& Query : InQueries)
+    {
+        TArray<FFluidSimulationSample> Samples;
+
+        if (InResults.IsValidIndex(Query.First + Query.Num - 1))
+        {
+            Samples.SetNum(Query.Num);
+
+            for (int32 Index = 0; Index < Query.Num; ++Index)
+            {
+                const FVector4& Result = InResults[Query.First + Index];
+                Samples[Index].Velocity = FVector(Result.X, Result.Y, 0.0f);
+                Samples[Index].Density = Result.Z;
+            }
+        }
+
+        Query.Promise.SetValue(MoveTemp(Samples));
+    }
+
+    InQueries.Reset();
+}
+
+void FFluidSimulationSampler::Gather_RenderThread(FBatch& InBatch, const TArray<FFluidSimulationSamplePoint>& InPoints, const FFluidSimulationField& InField, const int32 InSimulationGridSize, const FIntPoint& InFieldOrigin, FRHICommandListImmediate& RHICmdList)
+{
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationSampler_Gather_RenderThread);
+
+    if (!InField.IsValid() || InPoints.Num() == 0)
+    {
+        InBatch.bResolved = true;
+        return;
+    }
+
+    FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("FluidSimulationSampler_Gather"));
+    RDG_GPU_STAT_SCOPE(GraphBuilder, FluidSimulationSample);
+
+    const uint32 NumPoints = InPoints.Num();
+    const FFluidSimulationFieldTextures Field = InField.Register(GraphBuilder);
+    const FRDGBufferRef Points = CreateStructuredBuffer(GraphBuilder, TEXT("FluidSimulationSamplePoints"), sizeof(FFluidSimulationSamplePoint), NumPoints, InPoints.GetData(), NumPoints * sizeof(FFluidSimulationSamplePoint));
+    const FRDGBufferRef Samples = GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateStructuredDesc(sizeof(FVector4), NumPoints), TEXT("FluidSimulationSamples"));
+
+    FFluidSimulationSampleCS::FParameters* Params = GraphBuilder.AllocParameters<FFluidSimulationSampleCS::FParameters>();
+    Params->SamplePoints = GraphBuilder.CreateSRV(Points);
+    Params->OutSamples = GraphBuilder.CreateUAV(Samples);
+    Params->FluidVelocity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(Field.Velocity));
+    Params->FluidDensity = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::Create(Field.Density));
+    Params->NumSamplePoints = NumPoints;
+    Params->SimulationGridSize = InSimulationGridSize;
+    Params->FieldOrigin = InFieldOrigin;
+
+    TShaderMapRef<FFluidSimulationSampleCS> ComputeShader(GetGlobalShaderMap(GMaxRHIFeatureLevel));
+    FIntVector GroupCount = FComputeShaderUtils::GetGroupCount(static_cast<int32>(NumPoints), FFluidSimulationSampleCS::ThreadGroupSize);
+    FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("FluidSimulationSample %d", NumPoints), ComputeShader, Params, GroupCount);
+
+    InBatch.Readback = MakeUnique<FRHIGPUBufferReadback>(TEXT("FluidSimulationSamples"));
+    AddEnqueueCopyPass(GraphBuilder, InBatch.Readback.Get(), Samples, NumPoints * sizeof(FVector4));
+
+    GraphBuilder.Execute();
+}
+
+void FFluidSimulationSampler::Poll_RenderThread(FBatch& InBatch)
+{
+    check(IsInRenderingThread());
+
+    if (InBatch.bResolved || !InBatch.Readback.IsValid() || !InBatch.Readback->IsReady())
+    {
+        return;
+    }
+
+    const uint32 Size = InBatch.NumPoints * sizeof(FVector4);
+    const FVector4* const Data = static_cast<const FVector4*>(InBatch.Readback->Lock(Size));
+    InBatch.Results.SetNumUninitialized(InBatch.NumPoints);
+    FMemory::Memcpy(InBatch.Results.GetData(), Data, Size);
+    InBatch.Readback->Unlock();
+    InBatch.Readback.Reset();
+
+    InBatch.bResolved = true;
+}
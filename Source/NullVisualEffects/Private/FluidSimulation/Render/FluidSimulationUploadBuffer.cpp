@@ -0,0 +1,85 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationUploadBuffer.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "RenderGraphUtils.h"
+#include "RHICommandList.h"
+
+DECLARE_CYCLE_STAT(TEXT("FluidSimulationUploadBuffer Upload RT"), STAT_FluidSimulationUploadBuffer_Upload_RenderThread, STATGROUP_NullVisualEffects);
+
+TGlobalResource<FFluidSimulationUploadBuffer> GFluidSimulationUploadBuffer;
+
+namespace FluidSimulationUploadBuffer
+{
+    /** Records allocated on first use */
+    static constexpr uint32 MinCapacity = 64;
+}
+
+FFluidSimulationUploadBuffer::FFluidSimulationUploadBuffer()
+    : Head(0)
+{
+}
+
+void FFluidSimulationUploadBuffer::ReleaseRHI()
+{
+    DEC_MEMORY_STAT_BY(STAT_FluidSimulation_UploadMemory, Capacity.GetValue() * sizeof(FFluidSimulationBrush));
+
+    Buffer.SafeRelease();
+    Head = 0;
+    Capacity.Set(0);
+}
+
+FFluidSimulationUploadBuffer::FAllocation FFluidSimulationUploadBuffer::Upload_RenderThread(TArrayView<const FFluidSimulationBrush> InBrushes)
+{
+    check(IsInRenderingThread());
+    FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(STAT_FluidSimulationUploadBuffer_Upload_RenderThread);
+
+    const uint32 NumBrushes = InBrushes.Num();
+
+    if (!Buffer.IsValid() || NumBrushes > static_cast<uint32>(Capacity.GetValue()))
+    {
+        Grow_RenderThread(NumBrushes);
+    }
+
+    // Wrap around, the lock is ordered with the passes that read the previous slices
+    if (Head + NumBrushes > static_cast<uint32>(Capacity.GetValue()))
+    {
+        Head = 0;
+    }
+
+    FAllocation Allocation;
+    Allocation.Buffer = Buffer;
+    Allocation.Offset = Head;
+    Allocation.Num = NumBrushes;
+
+    if (NumBrushes > 0)
+    {
+        const uint32 Size = NumBrushes * sizeof(FFluidSimulationBrush);
+
+        void* const Data = RHILockStructuredBuffer(Buffer->GetStructuredBufferRHI(), Head * sizeof(FFluidSimulationBrush), Size, RLM_WriteOnly);
+        FMemory::Memcpy(Data, InBrushes.GetData(), Size);
+        RHIUnlockStructuredBuffer(Buffer->GetStructuredBufferRHI());
+
+        Head += NumBrushes;
+        BytesUploaded.Add(Size);
+    }
+
+    return Allocation;
+}
+
+void FFluidSimulationUploadBuffer::Grow_RenderThread(const uint32 InMinCapacity)
+{
+    const uint32 NewCapacity = FMath::RoundUpToPowerOfTwo(FMath::Max(InMinCapacity, FluidSimulationUploadBuffer::MinCapacity));
+
+    FRDGBufferDesc Desc = FRDGBufferDesc::CreateStructuredDesc(sizeof(FFluidSimulationBrush), NewCapacity);
+    Desc.Usage = BUF_Static | BUF_ShaderResource;
+
+    Buffer = AllocatePooledBuffer(Desc, TEXT("FluidSimulationUploadBuffer"));
+    Head = 0;
+
+    DEC_MEMORY_STAT_BY(STAT_FluidSimulation_UploadMemory, Capacity.GetValue() * sizeof(FFluidSimulationBrush));
+    INC_MEMORY_STAT_BY(STAT_FluidSimulation_UploadMemory, NewCapacity * sizeof(FFluidSimulationBrush));
+
+    Capacity.Set(NewCapacity);
+    NumReallocations.Increment();
+}
\ No newline at end of file
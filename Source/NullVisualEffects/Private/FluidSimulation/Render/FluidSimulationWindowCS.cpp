@@ -0,0 +1,5 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#include "FluidSimulation/Render/FluidSimulationWindowCS.h"
+
+IMPLEMENT_GLOBAL_SHADER(FFluidSimulationWindowCS, "/NullVisualEffects/FluidSimulation/FluidSimulationWindowCS.usf", "MainCS", SF_Compute);
\ No newline at end of file
@@ -6,6 +6,8 @@
 
 #define LOCTEXT_NAMESPACE "FNullVisualEffectsModule"
 
+DEFINE_LOG_CATEGORY(LogNullVisualEffects);
+
 void FNullVisualEffectsModule::StartupModule()
 {
     const FString ShaderDirectory = FPaths::Combine(FPaths::ProjectPluginsDir(), TEXT("NullVisualEffects/Shaders/Private"));
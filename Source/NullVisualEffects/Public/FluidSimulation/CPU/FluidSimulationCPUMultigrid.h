@@ -0,0 +1,94 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FluidSimulation/CPU/FluidSimulationCPUPlanes.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
+
+/**
+ * Geometric multigrid pressure projection for the CPU solver.
+ *
+ * Same scheme as FluidSimulationProjectionCS.usf: the velocity divergence is the
+ * right hand side of a Poisson equation solved with V-cycles over a grid pyramid
+ * (red-black Gauss-Seidel smoothing, 2x2 restriction, bilinear prolongation),
+ * then the pressure gradient is subtracted from the velocity.
+ * Pressure outside the grid is zero and the finest pressure is kept between steps
+ * as the initial guess of the next one.
+ * With a tile list, only the cells of the listed tiles feed the divergence and get the gradient,
+ * the other tiles are at rest and must stay untouched.
+ */
+class NULLVISUALEFFECTS_API FFluidSimulationCPUMultigrid
+{
+public:
+
+    /** Constructor */
+    FFluidSimulationCPUMultigrid();
+
+    /** Destructor */
+    ~FFluidSimulationCPUMultigrid();
+
+public:
+
+    /** Builds the grid pyramid */
+    void Init(const int32 InSimulationGridSize, const bool bInMultithreaded);
+
+    /** Releases the grid pyramid */
+    void Release();
+
+    /**
+     * Makes the velocity divergence free, returns the V-cycles run.
+     * InTileListed flags the InTileSize tiles to project, stored at TileX * NumTilesPerSide + TileY, every cell is projected when empty.
+     */
+    int32 Project(const FFluidSimulationProjectionSettings& InSettings, FFluidSimulationPlane& InOutVelocityX, FFluidSimulationPlane& InOutVelocityY, float& OutResidual, TArrayView<const uint8> InTileListed = TArrayView<const uint8>(), const int32 InTileSize = 0);
+
+    /** Returns the bytes held by the grid pyramid */
+    SIZE_T GetAllocatedSize() const;
+
+private:
+
+    /** Single level of the grid pyramid */
+    struct FLevel
+    {
+        /** Cells per side */
+        int32 Size;
+
+        /** Squared cell size in finest grid cells */
+        float CellSizeSquared;
+
+        /** Pressure, or pressure correction on coarse levels */
+        FFluidSimulationPlane Pressure;
+
+        /** Right hand side, divergence on the finest level and restricted residual on coarse ones */
+        FFluidSimulationPlane RightHandSide;
+
+        /** Residual of the last evaluation */
+        FFluidSimulationPlane Residual;
+    };
+
+    /** Runs a V-cycle starting at InLevelIndex */
+    void VCycle(const int32 InLevelIndex, const int32 InSmoothingIterations);
+
+    /** Red-black Gauss-Seidel sweeps */
+    void Smooth(FLevel& InOutLevel, const int32 InIterations) const;
+
+    /** Updates the level residual, returns its largest absolute value */
+    float ComputeResidual(FLevel& InOutLevel) const;
+
+    /** Restricts the fine residual into the coarse right hand side and clears the coarse pressure */
+    void Restrict(const FLevel& InFine, FLevel& OutCoarse) const;
+
+    /** Adds the bilinear interpolated coarse correction to the fine pressure */
+    void Prolongate(const FLevel& InCoarse, FLevel& InOutFine) const;
+
+    /** Runs InFunction for every row of a level */
+    void ForEachRow(const int32 InNumRows, TFunctionRef<void(int32)> InFunction) const;
+
+private:
+
+    /** Grid pyramid, finest first */
+    TArray<FLevel> Levels;
+
+    /** Spreads the rows across the task graph worker threads */
+    bool bMultithreaded;
+};
@@ -0,0 +1,45 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Single float plane of the simulation grid, aligned so rows can be streamed through vector registers */
+typedef TArray<float, TAlignedHeapAllocator<16>> FFluidSimulationPlane;
+
+/** Structure of arrays representation of the simulation grid */
+struct FFluidSimulationPlanes
+{
+public:
+
+    /** Velocity X component */
+    FFluidSimulationPlane VelocityX;
+
+    /** Velocity Y component */
+    FFluidSimulationPlane VelocityY;
+
+    /** Density */
+    FFluidSimulationPlane Density;
+
+    /** Resizes every plane to the grid and zeroes it */
+    void Init(const int32 InNumCells)
+    {
+        VelocityX.SetNumZeroed(InNumCells);
+        VelocityY.SetNumZeroed(InNumCells);
+        Density.SetNumZeroed(InNumCells);
+    }
+
+    /** Releases every plane */
+    void Release()
+    {
+        VelocityX.Empty();
+        VelocityY.Empty();
+        Density.Empty();
+    }
+
+    /** Returns the bytes held by the planes */
+    SIZE_T GetAllocatedSize() const
+    {
+        return VelocityX.GetAllocatedSize() + VelocityY.GetAllocatedSize() + Density.GetAllocatedSize();
+    }
+};
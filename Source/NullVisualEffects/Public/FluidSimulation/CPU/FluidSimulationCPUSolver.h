@@ -0,0 +1,207 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FluidSimulation/CPU/FluidSimulationCPUMultigrid.h"
+#include "FluidSimulation/CPU/FluidSimulationCPUPlanes.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
+
+struct FFluidSimulationBrush;
+
+/**
+ * CPU implementation of the fluid solver.
+ *
+ * Mirrors the compute shader passes (FluidSimulationCS.usf and friends) step by step
+ * so it can run where there is no RHI (-nullrhi, dedicated servers) and act as a reference
+ * for validating the GPU path. Cell (X, Y) is texel (X, Y) of the GPU fields and is
+ * stored at Index = X * SimulationGridSize + Y, so every X "row" is contiguous in memory and the
+ * stencil kernels run along it with VectorRegister (SSE on x86, NEON on ARM).
+ *
+ * The grid is split in square tiles that are solved in parallel on the task graph.
+ * Every pass reads the previous state and writes the current one, so the 1 cell halo
+ * around a tile is read straight from the shared source plane and the end of each
+ * ParallelFor is the only synchronization point between tiles.
+ *
+ * The state is rounded to the storage precision of the GPU fields after every step,
+ * so the reduced precision modes can be compared against the 32 bit one on any machine.
+ *
+ * With advection on, the Navier-Stokes solver first moves the state of every solved tile along the velocity,
+ * four cells at a time with the bilinear corners gathered into vector registers, then splats the brushes on it.
+ *
+ * The shallow water solver replaces the diffuse and project steps with a single damped
+ * wave equation pass, the height lives in VelocityX and its vertical speed in VelocityY.
+ *
+ * With activity tracking on, tiles are the activity tile size and only the tiles
+ * with moving fluid or new input, dilated by one tile, are solved. A tile leaving
+ * the active list is cleared in every state so skipping it stays exact.
+ */
+class NULLVISUALEFFECTS_API FFluidSimulationCPUSolver
+{
+public:
+
+    /** Constructor */
+    FFluidSimulationCPUSolver();
+
+    /** Destructor */
+    ~FFluidSimulationCPUSolver();
+
+public:
+
+    /** Allocates and clears the grid */
+    void Init(const int32 InSimulationGridSize, const FFluidSimulationCPUSettings& InSettings = FFluidSimulationCPUSettings(), const FFluidSimulationProjectionSettings& InProjectionSettings = FFluidSimulationProjectionSettings(), const FFluidSimulationActivitySettings& InActivitySettings = FFluidSimulationActivitySettings(), const EFluidSimulationFieldPrecision InPrecision = EFluidSimulationFieldPrecision::Full, const EFluidSimulationSolver InSolver = EFluidSimulationSolver::NavierStokes, const FFluidSimulationShallowWaterSettings& InShallowWaterSettings = FFluidSimulationShallowWaterSettings(), const FFluidSimulationAdvectionSettings& InAdvectionSettings = FFluidSimulationAdvectionSettings());
+
+    /** Releases the grid */
+    void Release();
+
+    /** Sets the advection settings, applied on the next step */
+    void SetAdvectionSettings(const FFluidSimulationAdvectionSettings& InAdvectionSettings) { AdvectionSettings = InAdvectionSettings; }
+
+    /** Runs a full simulation step, same order as UFluidSimulationRender::Tick on the GPU */
+    void Step(const TArray<FFluidSimulationBrush>& InBrushes, const float InFluidDifusion, const float InFluidViscosity, const float InDeltaTime);
+
+    /** Bilinear sample of the current state, InCoords in grid cells, the shallow water solver returns the height and its vertical speed as the velocity */
+    bool Sample(const FVector2D& InCoords, FVector2D& OutVelocity, float& OutDensity) const;
+
+    /**
+     * Writes the state with the same encoding as FluidSimulationDrawCS.usf,
+     * interpolated from the state solved by the step before the last one (0) to the one the last step solved (1).
+     */
+    void DrawToColorBuffer(TArray<FColor>& OutColors, const float InInterpolationAlpha = 1.0f) const;
+
+    /** Replaces every state with InPlanes, a grid of the same size, every tile is solved on the next step */
+    bool SetState(const FFluidSimulationPlanes& InPlanes);
+
+    /**
+     * Moves the grid by InDelta cells over the fluid, cell (X, Y) takes the state of cell (X + InDelta.X, Y + InDelta.Y)
+     * and the cells entering the grid are still water. The planes are shifted in place, the GPU fields wrap around instead.
+     */
+    void Shift(const FIntPoint& InDelta);
+
+    /** Returns the current state */
+    const FFluidSimulationPlanes& GetCurrentPlanes() const { return Current; }
+
+    /** Returns the simulation grid size */
+    int32 GetSimulationGridSize() const { return SimulationGridSize; }
+
+    /** Returns true if the grid is allocated */
+    bool IsInit() const { return SimulationGridSize > 0; }
+
+    /** Returns the timings of the last step */
+    const FFluidSimulationSolverStats& GetStats() const { return Stats; }
+
+    /** Returns the bytes held by the state planes, the pressure pyramid and the tiles */
+    SIZE_T GetAllocatedSize() const;
+
+private:
+
+    /** Runs InFunction for every tile, on the worker threads when multithreading is enabled */
+    void ForEachTile(TFunctionRef<void(const FIntRect&)> InFunction) const;
+
+    /** Runs InFunction for every tile of the active list */
+    void ForEachActiveTile(TFunctionRef<void(const FIntRect&)> InFunction) const;
+
+    /** Builds the active list from the tile activity dilated by one tile, clears the tiles leaving it */
+    void UpdateActiveTiles();
+
+    /** Flags the active tiles that still hold fluid above the activity threshold */
+    void MeasureActivity();
+
+    /** Zeroes a tile in every state */
+    void ClearTile(const FIntRect& InTile);
+
+    /** Copies the active tiles of the previous state to the solved state before the brushes and the advection change it */
+    void KeepSolvedState();
+
+    /** Flags the tiles the brushes touch as active, before UpdateActiveTiles */
+    void WakeInputTiles(const TArray<FFluidSimulationBrush>& InBrushes);
+
+    /** Splats the brushes into the previous state, tile by tile */
+    void AddInputData(const TArray<FFluidSimulationBrush>& InBrushes);
+
+    /** Advects the previous state of the active tiles along its velocity, the result becomes the previous state */
+    void Advect(const float InDeltaTime);
+
+    /** Advects the [InBegin, InEnd) span of one row into the current state */
+    void AdvectRow(const int32 InRow, const int32 InBegin, const int32 InEnd, const float InCellsPerVelocity, const float InMaxDistance);
+
+    /** Diffuses the previous state into the current state */
+    void UpdateFluid(const float InFluidDifusion, const float InFluidViscosity, const float InDeltaTime);
+
+    /** Diffuses the [InBegin, InEnd) span of one row of a single plane */
+    void DiffuseRow(const int32 InRow, const int32 InBegin, const int32 InEnd, const float InDiffusionRate, const FFluidSimulationPlane& InSource, FFluidSimulationPlane& OutDestination) const;
+
+    /** Integrates the damped wave equation from the previous heightfield into the current one */
+    void UpdateShallowWater(const float InDeltaTime);
+
+    /** Integrates the [InBegin, InEnd) span of one row of the heightfield */
+    void ShallowWaterRow(const int32 InRow, const int32 InBegin, const int32 InEnd, const float InStiffness, const float InDampingFactor, const float InDeltaTime);
+
+    /** Makes the current velocity divergence free */
+    void Project();
+
+    /** Rounds the current state of the active tiles to the storage precision */
+    void QuantizeState();
+
+    /** Returns a row of the plane, or a row of zeros when outside the grid */
+    const float* GetRow(const FFluidSimulationPlane& InPlane, const int32 InRow) const;
+
+private:
+
+    /** Simulation grid size */
+    int32 SimulationGridSize;
+
+    /** Solver settings */
+    FFluidSimulationCPUSettings Settings;
+
+    /** Equations the solver integrates */
+    EFluidSimulationSolver Solver;
+
+    /** Shallow water solver settings */
+    FFluidSimulationShallowWaterSettings ShallowWaterSettings;
+
+    /** Advection settings */
+    FFluidSimulationAdvectionSettings AdvectionSettings;
+
+    /** Pressure projection settings */
+    FFluidSimulationProjectionSettings ProjectionSettings;
+
+    /** Pressure projection */
+    FFluidSimulationCPUMultigrid Multigrid;
+
+    /** Activity tracking settings */
+    FFluidSimulationActivitySettings ActivitySettings;
+
+    /** Storage precision the state is rounded to */
+    EFluidSimulationFieldPrecision Precision;
+
+    /** Tiles covering the grid, X range in Min.X/Max.X and Y range in Min.Y/Max.Y, stored at TileX * NumTilesPerSide + TileY */
+    TArray<FIntRect> Tiles;
+
+    /** Tiles per grid side */
+    int32 NumTilesPerSide;
+
+    /** Per tile, set by input and by MeasureActivity */
+    TArray<uint8> TileActivity;
+
+    /** Per tile, set while the tile is in the active list */
+    TArray<uint8> TileListed;
+
+    /** Indices of the tiles solved by the step, every tile when activity tracking is off */
+    TArray<int32> ActiveTiles;
+
+    /** Timings of the last step */
+    FFluidSimulationSolverStats Stats;
+
+    /** State written by the last step */
+    FFluidSimulationPlanes Current;
+
+    /** State read by the next step, the step splats and advects into it */
+    FFluidSimulationPlanes Previous;
+
+    /** State solved by the step before the last one, the start of the draw interpolation */
+    FFluidSimulationPlanes Solved;
+
+    /** Row of zeros used as the out of grid neighbour */
+    FFluidSimulationPlane ZeroRow;
+};
@@ -4,6 +4,8 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Async/Future.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
 #include "FluidSimulationActor.generated.h"
 
 UCLASS(BlueprintType)
@@ -24,6 +26,7 @@ public:
     //~ Begin AActor interface
     virtual void BeginPlay() override;
     virtual void EndPlay(const EEndPlayReason::Type EndPlayReason);
+    virtual void Tick(float DeltaSeconds) override;
     //~ End AActor interface
 
 public:
@@ -32,23 +35,169 @@ public:
     UFUNCTION(CallInEditor, Category = "FluidSimulation")
     void InitResources();
 
-    /** Registers body */
-    void RegisterBody(const FVector& InCurrentLocation, const FVector& InPreviousLocation, const FVector& InVelocity, const float InRadius, const float InStrength);
+    /** Copies the simulation settings of the surface to a render object, before its Init */
+    void ApplySimulationSettings(class UFluidSimulationRender* InRender) const;
+
+    /**
+     * Binds the surface to the slice of a simulation, creating its render target.
+     * The warm start snapshot is restored into the slice, call it right after the Init of the simulation.
+     * A null simulation detaches the surface.
+     */
+    void SetSimulation(class UFluidSimulationRender* InRender, const int32 InSlice);
+
+    /**
+     * Caches the actor bounds used to map world locations to the grid.
+     * Water surfaces are static, call it again after moving or scaling one at runtime. Sliding window surfaces keep them up to date.
+     */
+    void UpdateCachedBounds();
+
+    /** Returns the simulation the surface lives in, null until it is created */
+    class UFluidSimulationRender* GetSimulation() const { return FluidSimulationRender; }
+
+    /** Returns the cached bounds of the surface */
+    const FBox& GetCachedBounds() const { return CachedBounds; }
+
+    /** Registers body, the brush sweeps from the previous location to the current one */
+    void RegisterBody(const FVector& InCurrentLocation, const FVector& InPreviousLocation, const FVector& InVelocity, const float InRadius, const float InStrength, const float InFalloff = 1.0f);
 
     /** */
     UFUNCTION(CallInEditor, Category = "FluidSimulation")
     void Draw();
 
+    /** 
+     * Samples the fluid velocity and density at a world location.
+     * Only available while the CPU backend is in use, returns false otherwise.
+     */
+    UFUNCTION(BlueprintCallable, Category = "FluidSimulation")
+    bool SampleFluid(const FVector& InWorldLocation, FVector& OutVelocity, float& OutDensity) const;
+
+    /**
+     * Samples the fluid velocity and density at every world location, results are in the same order.
+     * Works with both backends, the CPU one resolves the future immediately. On the GPU the queries of
+     * every surface sharing the simulation are gathered by a single dispatch per frame and read back
+     * SampleReadbackLatency frames later or as soon as the GPU is done, without stalling.
+     * The future resolves on the game thread, with no samples if the simulation goes away first
+     * or the surface bounds are not known yet.
+     */
+    TFuture<TArray<FFluidSimulationSample>> QueryFluid(TArrayView<const FVector> InWorldLocations) const;
+
+    /** Same as QueryFluid, InCallback is called on the game thread with the samples */
+    void QueryFluid(TArrayView<const FVector> InWorldLocations, TFunction<void(const TArray<FFluidSimulationSample>&)> InCallback) const;
+
+    /**
+     * Captures the state of the surface as a snapshot blob, for save games.
+     * Resolves on the game thread, a few frames later on the GPU, empty without a simulation.
+     */
+    TFuture<TArray<uint8>> CaptureSnapshot() const;
+
+    /** Replaces the state of the surface with a snapshot blob, resampled to the grid size of the surface */
+    bool RestoreSnapshot(TArrayView<const uint8> InData);
+
+    /** Captures the state of the surface and writes it to a file once read back */
+    UFUNCTION(BlueprintCallable, Category = "FluidSimulation")
+    void SaveSnapshotToFile(const FString& InFilename) const;
+
+    /** Restores the state of the surface from a snapshot file, decoded straight from the mapped file */
+    UFUNCTION(BlueprintCallable, Category = "FluidSimulation")
+    bool RestoreSnapshotFromFile(const FString& InFilename);
+
+    /** Captures the running simulation into WarmStartSnapshot, the asset is filled once the state is read back */
+    UFUNCTION(CallInEditor, Category = "FluidSimulation")
+    void CaptureWarmStartSnapshot();
+
+    /** Returns the timings of the last simulation step, the stats cover the whole batch when the surface is managed */
+    UFUNCTION(BlueprintCallable, Category = "FluidSimulation")
+    FFluidSimulationSolverStats GetSolverStats() const;
+
+    /** Returns true if the manager solves the surface in a batch, false once InitResources gave it a simulation of its own */
+    bool IsBatchedWithManager() const { return bBatchWithManager && !bStandaloneSimulation; }
+
+    /** Returns the batching stats of the surface, empty when it is not managed */
+    UFUNCTION(BlueprintCallable, Category = "FluidSimulation")
+    FFluidSimulationSurfaceStats GetSurfaceStats() const;
+
 public:
 
     /**  */
     UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
     int32 SimulationGridSize;
 
-    /**  */
-    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Render")
+    /** Where the simulation is solved, GPU falls back to CPU when there is no RHI */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    EFluidSimulationBackend SimulationBackend;
+
+    /** Equations the simulation solves, shallow water trades the swirls for ripples and wakes at a fraction of the cost */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    EFluidSimulationSolver Solver;
+
+    /** Shallow water solver settings, used by both backends */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation", meta = (EditCondition = "Solver == EFluidSimulationSolver::ShallowWater"))
+    FFluidSimulationShallowWaterSettings ShallowWaterSettings;
+
+    /** Moves the fluid along its velocity, used by both backends */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation", meta = (EditCondition = "Solver == EFluidSimulationSolver::NavierStokes"))
+    FFluidSimulationAdvectionSettings AdvectionSettings;
+
+    /** CPU backend settings */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    FFluidSimulationCPUSettings CPUSettings;
+
+    /** Multigrid pressure projection settings, used by both backends */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    FFluidSimulationProjectionSettings ProjectionSettings;
+
+    /** Skips the quiescent tiles of the grid, used by both backends */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    FFluidSimulationActivitySettings ActivitySettings;
+
+    /** Fine patches around the bodies, GPU backend only. Draw into a render target larger than the grid to see them */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    FFluidSimulationDetailSettings DetailSettings;
+
+    /** Simulation clock, used by both backends */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    FFluidSimulationTimestepSettings TimestepSettings;
+
+    /** Storage precision of the simulation fields, the CPU backend rounds its state the same way */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    EFluidSimulationFieldPrecision FieldPrecision;
+
+    /** GPU fields in the ping-pong ring, 3 decouples drawing from the next solve */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation", meta = (ClampMin = "2", ClampMax = "3"))
+    int32 FieldBufferCount;
+
+    /** Moves the grid with a focus point, the surface is never batched with others as every surface of a simulation moves together */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    FFluidSimulationSlidingWindowSettings SlidingWindowSettings;
+
+    /** Actor the sliding window follows, the camera of the first player when null */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation|Simulation", meta = (EditCondition = "SlidingWindowSettings.bEnabled"))
+    AActor* SlidingWindowFocus;
+
+    /** Lets the fluid simulation manager solve the surface together with other compatible ones */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    bool bBatchWithManager;
+
+    /** Size of the GPU render target, the simulation is upsampled when larger than the grid. The CPU backend draws at the grid size */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Render", meta = (ClampMin = "0"))
     int32 RenderTargetSize;
 
+    /** Filter upsampling the simulation into the render target */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Render")
+    EFluidSimulationUpsampleFilter UpsampleFilter;
+
+    /** Frames a GPU sample query is left in flight before its readback is polled, more frames make sure the GPU is done */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation", meta = (ClampMin = "1", ClampMax = "3"))
+    int32 SampleReadbackLatency;
+
+    /** Pre-simulated state restored when the simulation starts, see CaptureWarmStartSnapshot */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Simulation")
+    class UFluidSimulationSnapshotAsset* WarmStartSnapshot;
+
+    /** Gives the render target a mip chain, regenerated after every draw */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation|Render")
+    bool bGenerateMips;
+
     /**  */
     UPROPERTY(EditAnywhere, Category = "FluidSimulation|Material")
     class UStaticMesh* DefaultStaticMesh;
@@ -65,6 +214,17 @@ public:
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
     class UStaticMeshComponent* StaticMeshComponent;
 
+private:
+
+    /** Maps a world location to the grid cells of the surface, returns false without valid bounds */
+    bool WorldToGridCoords(const FVector& InWorldLocation, FVector2D& OutGridCoords) const;
+
+    /** Returns the location the sliding window follows, false when there is none */
+    bool GetSlidingWindowFocus(FVector& OutLocation) const;
+
+    /** Snaps the sliding window around the focus, moves the surface and the simulation with it */
+    void UpdateSlidingWindow();
+
 private:
 
     /** Fluid simulation render target */
@@ -78,4 +238,23 @@ private:
     /**  */
     UPROPERTY(Transient)
     class UFluidSimulationRender* FluidSimulationRender;
+
+    /** Slice of the simulation the surface lives in */
+    int32 SimulationSlice;
+
+    /** Actor bounds, cached as the surface is static */
+    FBox CachedBounds;
+
+    /** World cell of the first grid cell of the sliding window, in cells of SlidingWindowCellSize */
+    FIntPoint SlidingWindowCell;
+
+    /** World size of a grid cell, set once the window is placed, 0 before */
+    float SlidingWindowCellSize;
+
+    /** Set by InitResources, the surface runs its own simulation whatever bBatchWithManager says */
+    bool bStandaloneSimulation;
+
+    /** Manager solving the surface, null when it runs its own simulation */
+    UPROPERTY(Transient)
+    class AFluidSimulationManagerActor* Manager;
 };
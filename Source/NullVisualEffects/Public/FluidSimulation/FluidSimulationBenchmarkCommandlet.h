@@ -0,0 +1,81 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
+#include "FluidSimulationBenchmarkCommandlet.generated.h"
+
+/**
+ * Headless benchmark of the fluid solver.
+ *
+ * Runs fixed scripted scenarios, every combination of grid size, body count and brush radius
+ * on each requested backend, and writes the results as JSON so regressions can be diffed between builds.
+ * Bodies orbit on seeded random paths, so every run of a scenario feeds the solver the same input.
+ * GPU scenarios are skipped when there is no RHI, run with -nullrhi for a CPU only pass.
+ *
+ * UE4Editor-Cmd <Project> -run=FluidSimulationBenchmark
+ *     [-Backends=CPU,GPU] [-GridSizes=128,256,512,1024,2048] [-Bodies=0,10,100,1000] [-Radii=0.01,0.05]
+ *     [-Steps=60] [-Warmup=5] [-Solver=NavierStokes|ShallowWater] [-Advection=None|SemiLagrangian|MacCormack] [-Activity] [-NoProjection] [-Seed=0] [-Output=<File.json>]
+ */
+UCLASS()
+class NULLVISUALEFFECTS_API UFluidSimulationBenchmarkCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Constructor */
+    UFluidSimulationBenchmarkCommandlet();
+
+    //~ Begin UCommandlet interface
+    virtual int32 Main(const FString& Params) override;
+    //~ End UCommandlet interface
+
+private:
+
+    /** Single benchmarked configuration */
+    struct FScenario
+    {
+        /** Backend requested for the scenario */
+        EFluidSimulationBackend Backend = EFluidSimulationBackend::CPU;
+
+        /** Simulation grid size */
+        int32 GridSize = 0;
+
+        /** Bodies stirring the surface */
+        int32 NumBodies = 0;
+
+        /** Brush radius relative to the grid size */
+        float BrushRadius = 0.0f;
+    };
+
+    /** Shared settings of every scenario */
+    struct FSuiteSettings
+    {
+        /** Measured steps per scenario */
+        int32 NumSteps = 60;
+
+        /** Steps run before measuring, lets the pools and the upload ring settle */
+        int32 NumWarmupSteps = 5;
+
+        /** Seed of the body paths */
+        int32 Seed = 0;
+
+        /** Equations solved */
+        EFluidSimulationSolver Solver = EFluidSimulationSolver::NavierStokes;
+
+        /** Advection settings of the solver */
+        FFluidSimulationAdvectionSettings AdvectionSettings;
+
+        /** Projection settings of the solver */
+        FFluidSimulationProjectionSettings ProjectionSettings;
+
+        /** Activity settings of the solver */
+        FFluidSimulationActivitySettings ActivitySettings;
+    };
+
+    /** Runs a scenario and returns its results */
+    TSharedPtr<class FJsonObject> RunScenario(const FScenario& InScenario, const FSuiteSettings& InSettings) const;
+};
\ No newline at end of file
@@ -24,41 +24,26 @@ public:
 
     //~ Begin USceneComponent interface
     virtual void BeginPlay() override;
-    virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
     virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
     //~ End USceneComponent interface
 
-private:
-
-    UFUNCTION()
-    void ComponentBeginOverlap(class UPrimitiveComponent* InOverlappedComp, class AActor* InOtherActor, class UPrimitiveComponent* InOtherComp, int32 InOtherBodyIndex, bool InFromSweep, const FHitResult& InSweepResult);
-
-    UFUNCTION()
-    void ComponentEndOverlap(class UPrimitiveComponent* InOverlappedComp, class AActor* InOtherActor, class UPrimitiveComponent* InOtherComp, int32 InOtherBodyIndex);
-
 public:
 
+    /** Brush is only sent once the body moved further than this since the last one */
     UPROPERTY(EditAnywhere, Category = "FluidSimulation")
     float MinimumUpdateDistance;
 
     UPROPERTY(EditAnywhere, Category = "FluidSimulation")
     float Strength;
 
-private:
-
-    /** Current location */
-    FVector CurrentLocation;
+    /** Falloff exponent of the brush from its center to its radius, 0 is a hard disc */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float Falloff;
 
-    /** Previous location */
-    FVector PreviousLocation;
-
-    /**
-     * Second previous location.
-     * In some cases in the future might be needed for sake of accuracy
-     */
-    FVector SecondPreviousLocation;
+private:
 
-    /**  */
-    class AFluidSimulationActor* CurrentUpdateActor;
+    /** Manager gathering the body, the body is registered for its whole play */
+    UPROPERTY(Transient)
+    class AFluidSimulationManagerActor* Manager;
 
 };
\ No newline at end of file
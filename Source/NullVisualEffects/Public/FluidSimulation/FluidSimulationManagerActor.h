@@ -1,3 +1,200 @@
 // Copyright (C) Ronaldo Veloso. All Rights Reserved.
 
 #pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
+#include "FluidSimulationManagerActor.generated.h"
+
+/**
+ * Owns the simulation of every registered fluid surface of a world.
+ *
+ * Surfaces with compatible settings (grid size, backend, precision, solver settings)
+ * are packed as slices of a single simulation, so each solver pass runs once for the
+ * whole batch instead of once per surface. Batches are updated on the next tick after
+ * a surface registers or unregisters, a new surface takes a free slice of a compatible batch
+ * or grows it, and the surfaces already simulating keep their slice and their state.
+ *
+ * Batches update at a rate picked from their screen size, distance and visibility,
+ * round-robin under a per frame budget, and hidden or far away ones go dormant.
+ *
+ * Bodies register once as well, the manager gathers all of them in a single pass and
+ * finds the surfaces they touch through a uniform grid over the cached surface bounds.
+ */
+UCLASS(NotPlaceable, Transient)
+class NULLVISUALEFFECTS_API AFluidSimulationManagerActor : public AActor
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Constructor */
+    AFluidSimulationManagerActor();
+
+    /** Destructor */
+    ~AFluidSimulationManagerActor();
+
+public:
+
+    //~ Begin AActor interface
+    virtual void Tick(float DeltaSeconds) override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    //~ End AActor interface
+
+public:
+
+    /** Returns the manager of InWorld, spawns it if there is none yet */
+    static AFluidSimulationManagerActor* FindOrSpawn(UWorld* InWorld);
+
+    /** Adds a surface, it is batched on the next tick if it allows it and receives the gathered bodies */
+    void RegisterSurface(class AFluidSimulationActor* InSurface);
+
+    /** Removes a surface and detaches it from its batch */
+    void UnregisterSurface(class AFluidSimulationActor* InSurface);
+
+    /** Routes the bodies to the new bounds of a surface that moved, on the next tick */
+    void NotifySurfaceMoved(class AFluidSimulationActor* InSurface);
+
+    /** Adds a body, its brushes are gathered every BodyUpdateInterval */
+    void RegisterBody(class UFluidSimulationBodyComponent* InBody);
+
+    /** Removes a body */
+    void UnregisterBody(class UFluidSimulationBodyComponent* InBody);
+
+    /** Returns the stats of a registered surface */
+    UFUNCTION(BlueprintCallable, Category = "FluidSimulation")
+    FFluidSimulationSurfaceStats GetSurfaceStats(const class AFluidSimulationActor* InSurface) const;
+
+    /** Returns the aggregate stats of every batch */
+    UFUNCTION(BlueprintCallable, Category = "FluidSimulation")
+    FFluidSimulationManagerStats GetManagerStats() const;
+
+public:
+
+    /** Maximum surfaces packed in a single batch */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation", meta = (ClampMin = "1", ClampMax = "256"))
+    int32 MaxSurfacesPerBatch;
+
+    /** Update rate policy of the batches */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation")
+    FFluidSimulationLODSettings LODSettings;
+
+    /** Seconds between two body gathers */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float BodyUpdateInterval;
+
+    /** Side of the broadphase grid cells, in world units */
+    UPROPERTY(EditAnywhere, Category = "FluidSimulation", meta = (ClampMin = "100.0"))
+    float BroadphaseCellSize;
+
+private:
+
+    /** Registered bodies, stored as a structure of arrays so the gather walks contiguous memory */
+    struct FBodies
+    {
+        /** Body components */
+        TArray<TWeakObjectPtr<class UFluidSimulationBodyComponent>> Components;
+
+        /** Locations read by the last gather */
+        TArray<FVector> Locations;
+
+        /** Locations of the last brush sent, brushes sweep from there */
+        TArray<FVector> PreviousLocations;
+
+        /** Scaled sphere radii read by the last gather */
+        TArray<float> Radii;
+
+        /** Adds a body starting at InLocation */
+        void Add(class UFluidSimulationBodyComponent* InBody, const FVector& InLocation);
+
+        /** Removes the body at InIndex, the last body takes its place */
+        void RemoveAtSwap(const int32 InIndex);
+
+        /** Removes every body */
+        void Reset();
+
+        /** Returns the number of bodies */
+        int32 Num() const { return Components.Num(); }
+    };
+
+    /** Surfaces solved by a single simulation, one slice each */
+    struct FBatch
+    {
+        /** Surfaces indexed by slice, null for a free slice */
+        TArray<TWeakObjectPtr<class AFluidSimulationActor>> Surfaces;
+
+        /** Surface running its own simulation, the manager only schedules it */
+        bool bStandalone = false;
+
+        /** Game thread time of the last update, in milliseconds */
+        float TickMs = 0.0f;
+
+        /** Frames between two updates, 0 while dormant */
+        int32 UpdateInterval = 1;
+
+        /** Frames since the last update */
+        int32 FramesSinceUpdate = 0;
+
+        /** Time elapsed since the last update, in seconds */
+        float PendingDeltaTime = 0.0f;
+    };
+
+    /** Frees the slices of the removed surfaces and packs the new ones, only the touched batches are resized */
+    void RebuildBatches();
+
+    /** Detaches every surface and drops the batches */
+    void ReleaseBatches();
+
+    /** Picks the update interval of every batch from the views */
+    void UpdateBatchLODs();
+
+    /** Updates the due batches round-robin within the frame budget */
+    void UpdateBatches(const float InDeltaSeconds);
+
+    /** Rebuilds the broadphase grid from the cached surface bounds */
+    void RebuildBroadphase();
+
+    /** Reads every body transform and sends the brushes to the surfaces they touch */
+    void GatherBodies();
+
+    /** Returns the broadphase cell containing InLocation */
+    FIntPoint GetBroadphaseCell(const FVector& InLocation) const;
+
+    /** Returns true if both surfaces can share a simulation */
+    static bool CanShareBatch(const class AFluidSimulationActor* InSurface, const class AFluidSimulationActor* InOtherSurface);
+
+private:
+
+    /** Registered surfaces */
+    UPROPERTY(Transient)
+    TArray<class AFluidSimulationActor*> Surfaces;
+
+    /** Simulation of every batch, indexed like Batches */
+    UPROPERTY(Transient)
+    TArray<class UFluidSimulationRender*> BatchRenders;
+
+    /** Batches of the registered surfaces */
+    TArray<FBatch> Batches;
+
+    /** Batched surfaces changed since the last rebuild */
+    bool bBatchesDirty;
+
+    /** Surfaces changed since the last broadphase rebuild */
+    bool bBroadphaseDirty;
+
+    /** Registered bodies */
+    FBodies Bodies;
+
+    /** Uniform grid broadphase, surface indices per cell */
+    TMap<FIntPoint, TArray<int32>> BroadphaseCells;
+
+    /** Seconds since the last body gather */
+    float BodyUpdateAccumulator;
+
+    /** Batch the next round-robin update starts from */
+    int32 NextBatchIndex;
+
+    /** Batches updated by the last tick */
+    int32 NumUpdatedBatches;
+};
\ No newline at end of file
@@ -0,0 +1,91 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FluidSimulation/CPU/FluidSimulationCPUPlanes.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/** State stored next to the fields of a snapshot */
+struct FFluidSimulationSnapshotInfo
+{
+    /** Grid size the fields were captured at */
+    int32 SimulationGridSize = 0;
+
+    /** Equations the captured state belongs to */
+    EFluidSimulationSolver Solver = EFluidSimulationSolver::NavierStokes;
+
+    /** Frame time not yet consumed by a fixed step, in seconds */
+    float TimeAccumulator = 0.0f;
+
+    /** Time simulated since the start of the simulation, in seconds */
+    double SimulationTime = 0.0;
+};
+
+/**
+ * Compact encoding of the state of a single surface.
+ *
+ * The blob is a fixed header followed by the payload. The grid is split in square tiles and every
+ * tile stores the range of each field, velocity is quantized to 16 bits and density to 8 bits inside
+ * that range, so still water is all zeros. The payload is LZ4 compressed unless it does not shrink.
+ * The blob is plain data with no pointers, it decodes straight from a memory mapped file or from
+ * the bytes of a UFluidSimulationSnapshotAsset without an intermediate copy.
+ * Cells are stored in the CPU solver layout, Index = X * SimulationGridSize + Y.
+ */
+struct NULLVISUALEFFECTS_API FFluidSimulationSnapshot
+{
+public:
+
+    /** Cells per snapshot tile side */
+    static constexpr int32 TileSize = 16;
+
+    /** Largest grid a snapshot holds, the largest 2D texture of the RHIs. Keeps every size of the blob within 32 bits */
+    static constexpr int32 MaxSimulationGridSize = 16384;
+
+    /** Encodes InPlanes, a InInfo.SimulationGridSize grid, into OutData */
+    static void Encode(const FFluidSimulationPlanes& InPlanes, const FFluidSimulationSnapshotInfo& InInfo, TArray<uint8>& OutData, const bool bInCompress = true);
+
+    /** Reads the header of InData, returns false if it is not a snapshot or its payload does not fit in InData */
+    static bool ReadInfo(TArrayView<const uint8> InData, FFluidSimulationSnapshotInfo& OutInfo);
+
+    /**
+     * Decodes InData into OutPlanes, a InSimulationGridSize grid.
+     * A snapshot captured at another grid size is resampled bilinearly.
+     */
+    static bool Decode(TArrayView<const uint8> InData, const int32 InSimulationGridSize, FFluidSimulationPlanes& OutPlanes, FFluidSimulationSnapshotInfo* OutInfo = nullptr);
+
+    /** Writes InData to a file */
+    static bool SaveToFile(TArrayView<const uint8> InData, const FString& InFilename);
+};
+
+/** Snapshot file mapped in memory, the view stays valid as long as the object lives */
+class NULLVISUALEFFECTS_API FFluidSimulationMappedSnapshot
+{
+public:
+
+    /** Constructor */
+    FFluidSimulationMappedSnapshot();
+
+    /** Destructor */
+    ~FFluidSimulationMappedSnapshot();
+
+    /** Maps a snapshot file, falls back to reading it when the platform cannot map files */
+    bool Open(const FString& InFilename);
+
+    /** Returns the bytes of the snapshot */
+    TArrayView<const uint8> GetData() const;
+
+private:
+
+    /** Mapped file */
+    TUniquePtr<IMappedFileHandle> Handle;
+
+    /** Mapped region covering the whole file */
+    TUniquePtr<IMappedFileRegion> Region;
+
+    /** File contents when it could not be mapped */
+    TArray<uint8> FallbackData;
+};
@@ -0,0 +1,54 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "FluidSimulationSnapshotAsset.generated.h"
+
+/**
+ * Pre-simulated state of a surface, saved with the level.
+ * Holds a FFluidSimulationSnapshot blob restored when the simulation starts so the water does not
+ * spin up from still on every load. Filled from a running surface with AFluidSimulationActor::CaptureWarmStartSnapshot.
+ */
+UCLASS(BlueprintType)
+class NULLVISUALEFFECTS_API UFluidSimulationSnapshotAsset : public UDataAsset
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Constructor */
+    UFluidSimulationSnapshotAsset();
+
+public:
+
+    /** Replaces the snapshot and refreshes the info shown in the editor */
+    void SetData(TArray<uint8>&& InData);
+
+    /** Returns the snapshot blob */
+    TArrayView<const uint8> GetData() const { return Data; }
+
+    /** Returns true if the asset holds a snapshot */
+    bool HasData() const { return Data.Num() > 0; }
+
+public:
+
+    /** Grid size the snapshot was captured at, other sizes are resampled on restore */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 SimulationGridSize;
+
+    /** Seconds the surface was simulated before the capture */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float SimulationTime;
+
+    /** Size of the encoded snapshot, in bytes */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 DataSize;
+
+private:
+
+    /** Encoded snapshot */
+    UPROPERTY()
+    TArray<uint8> Data;
+};
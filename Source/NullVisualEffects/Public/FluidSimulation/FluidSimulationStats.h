@@ -0,0 +1,86 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Trace/Trace.h"
+
+/**
+ * Profiling of the fluid simulations.
+ *
+ * `stat NullVisualEffects` lists the game and render thread timers of every pass,
+ * `stat Fluid` the per frame counters and the memory held by the simulations.
+ * GPU passes are timed by `stat GPU` and ProfileGPU.
+ * Unreal Insights captures the pass timers on the FluidSimulation trace channel, -trace=cpu,FluidSimulation.
+ */
+
+/** Timers of every pass */
+DECLARE_STATS_GROUP(TEXT("NullVisualEffects"), STATGROUP_NullVisualEffects, STATCAT_Advanced);
+
+/** Counters and memory */
+DECLARE_STATS_GROUP(TEXT("Fluid"), STATGROUP_Fluid, STATCAT_Advanced);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Surfaces"), STAT_FluidSimulation_Surfaces, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Batches"), STAT_FluidSimulation_Batches, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bodies"), STAT_FluidSimulation_Bodies, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Steps"), STAT_FluidSimulation_Steps, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Input Records"), STAT_FluidSimulation_InputRecords, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Active Cells"), STAT_FluidSimulation_ActiveCells, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sample Points"), STAT_FluidSimulation_SamplePoints, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Field Buffers"), STAT_FluidSimulation_FieldMemory, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Projection Buffers"), STAT_FluidSimulation_ProjectionMemory, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Activity Buffers"), STAT_FluidSimulation_ActivityMemory, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Detail Patches"), STAT_FluidSimulation_DetailMemory, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Upload Ring"), STAT_FluidSimulation_UploadMemory, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("CPU Planes"), STAT_FluidSimulation_CPUMemory, STATGROUP_Fluid, NULLVISUALEFFECTS_API);
+
+/** Trace channel of the pass timers */
+UE_TRACE_CHANNEL_EXTERN(FluidSimulationChannel, NULLVISUALEFFECTS_API);
+
+/** Cycle stat scope that Unreal Insights also captures on the FluidSimulation channel */
+#define FLUID_SIMULATION_SCOPE_CYCLE_COUNTER(Stat) \
+    SCOPE_CYCLE_COUNTER(Stat); \
+    TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Stat, FluidSimulationChannel)
+
+/** Bytes a simulation holds, accounted in the memory stats */
+struct FFluidSimulationMemoryUsage
+{
+    /** Ring of field texture arrays */
+    uint64 Fields = 0;
+
+    /** Pressure and scratch velocity texture arrays */
+    uint64 Projection = 0;
+
+    /** Activity tile buffers */
+    uint64 Activity = 0;
+
+    /** Detail patch fields and projection */
+    uint64 Detail = 0;
+
+    /** CPU solver planes */
+    uint64 CPU = 0;
+
+    /** Adds the usage to the memory stats */
+    void Account() const
+    {
+        INC_MEMORY_STAT_BY(STAT_FluidSimulation_FieldMemory, Fields);
+        INC_MEMORY_STAT_BY(STAT_FluidSimulation_ProjectionMemory, Projection);
+        INC_MEMORY_STAT_BY(STAT_FluidSimulation_ActivityMemory, Activity);
+        INC_MEMORY_STAT_BY(STAT_FluidSimulation_DetailMemory, Detail);
+        INC_MEMORY_STAT_BY(STAT_FluidSimulation_CPUMemory, CPU);
+    }
+
+    /** Removes the usage from the memory stats and clears it */
+    void Release()
+    {
+        DEC_MEMORY_STAT_BY(STAT_FluidSimulation_FieldMemory, Fields);
+        DEC_MEMORY_STAT_BY(STAT_FluidSimulation_ProjectionMemory, Projection);
+        DEC_MEMORY_STAT_BY(STAT_FluidSimulation_ActivityMemory, Activity);
+        DEC_MEMORY_STAT_BY(STAT_FluidSimulation_DetailMemory, Detail);
+        DEC_MEMORY_STAT_BY(STAT_FluidSimulation_CPUMemory, CPU);
+        *this = FFluidSimulationMemoryUsage();
+    }
+};
\ No newline at end of file
@@ -0,0 +1,129 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RHIResources.h"
+#include "RenderGraphResources.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "FluidSimulation/Render/FluidSimulationField.h"
+#include "FluidSimulation/Render/FluidSimulationUploadBuffer.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
+
+class FRHIGPUBufferReadback;
+
+/** Activity buffers of the current graph, built by FFluidSimulationActivity::BuildActiveList_RenderThread */
+struct FFluidSimulationActiveTiles
+{
+    /** Dispatch arguments of the indirect passes */
+    FRDGBufferRef IndirectArgs = nullptr;
+
+    /** Packed coords of the tiles solved this step */
+    FRDGBufferSRVRef ActiveTileList = nullptr;
+
+    /** Per tile, set by the measure pass */
+    FRDGBufferRef TileActivity = nullptr;
+};
+
+/**
+ * GPU activity tracking, same scheme as FFluidSimulationCPUSolver.
+ *
+ * Each tile holds an activity flag set by the measure pass. The build pass dilates
+ * the flags by one tile, adds the tiles near a brush and appends the active tiles to a list,
+ * and the solver is dispatched indirectly over that list. Tiles leaving the list
+ * are cleared in every field so skipping them stays exact.
+ * Only the per tile flags outlive a step, the lists and the dispatch arguments are transient graph buffers.
+ * The active tile count is read back a few frames late for the stats.
+ */
+struct NULLVISUALEFFECTS_API FFluidSimulationActivity
+{
+public:
+
+    /** Offsets of the dispatch arguments in IndirectArgs, in uints, must match FluidSimulationActivityCS.usf */
+    enum FArgs
+    {
+        /** Solver dispatch, one group row per active tile */
+        SolveArgsOffset = 0,
+
+        /** Measure dispatch, one group per active tile */
+        MeasureArgsOffset = 3,
+
+        /** Clear dispatch, one group per retired tile */
+        ClearArgsOffset = 6,
+
+        /** Total uints */
+        NumArgs = 9
+    };
+
+    /** Cells per activity tile side */
+    int32 TileSize = 0;
+
+    /** Tiles per grid side */
+    int32 NumTilesPerSide = 0;
+
+    /** Simulation grid size */
+    int32 SimulationGridSize = 0;
+
+    /** Surfaces tracked together, one per texture array slice */
+    int32 NumSlices = 1;
+
+    /** Activity threshold */
+    float Threshold = 0.0f;
+
+    /** Per tile, set by the measure pass */
+    TRefCountPtr<FRDGPooledBuffer> TileActivity;
+
+    /** Per tile, set while the tile is in the active list */
+    TRefCountPtr<FRDGPooledBuffer> TileListed;
+
+public:
+
+    /** Creates and clears the activity buffers, render thread only */
+    void Init_RenderThread(const int32 InSimulationGridSize, const int32 InNumSlices, const FFluidSimulationActivitySettings& InSettings, FRHICommandListImmediate& RHICmdList);
+
+    /** Releases the activity buffers */
+    void SafeRelease();
+
+    /** Returns true if the activity buffers are created */
+    bool IsValid() const { return TileActivity.IsValid() && TileListed.IsValid(); }
+
+    /** Returns the bytes held by the per tile buffers */
+    uint64 GetAllocatedSize() const;
+
+    /**
+     * Rebuilds the active list and clears the retired tiles in InFields and InScratchVelocity, render thread only.
+     * InSolveThreadGroupSize is the thread group side of the solver dispatched over the list, tiles under
+     * the brushes about to be splatted are activated. Tiles are in window cells, InFieldOrigin is the wrap around of the fields.
+     */
+    FFluidSimulationActiveTiles BuildActiveList_RenderThread(const int32 InSolveThreadGroupSize, TArrayView<const FFluidSimulationFieldTextures> InFields, FRDGTextureRef InScratchVelocity, FRDGBufferSRVRef InBrushes, const FFluidSimulationUploadBuffer::FAllocation& InAllocation, const FIntPoint& InFieldOrigin, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const;
+
+    /** Flags the active tiles of InField still above the threshold and reads the active tile count back, render thread only */
+    void Measure_RenderThread(const FFluidSimulationActiveTiles& InActiveTiles, const FFluidSimulationFieldTextures& InField, const FIntPoint& InFieldOrigin, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const;
+
+    /** Flags every tile as active so a state written outside of the solver gets solved and measured, render thread only */
+    void ActivateAll_RenderThread(FRDGBuilder& GraphBuilder) const;
+
+    /** Returns the last active tile count read back */
+    int32 GetNumActiveTiles() const;
+
+    /** Returns the total tile count of every slice */
+    int32 GetNumTiles() const { return NumTilesPerSide * NumTilesPerSide * NumSlices; }
+
+private:
+
+    /** Readback of the active tile count, shared by every copy of the struct */
+    struct FReadback
+    {
+        /** Readback of the solve dispatch arguments */
+        TUniquePtr<FRHIGPUBufferReadback> Readback;
+
+        /** A copy is in flight */
+        bool bPending = false;
+
+        /** Last active tile count read back */
+        FThreadSafeCounter NumActiveTiles;
+    };
+
+    /** Active tile count readback */
+    TSharedPtr<FReadback, ESPMode::ThreadSafe> ActiveTileCount;
+};
\ No newline at end of file
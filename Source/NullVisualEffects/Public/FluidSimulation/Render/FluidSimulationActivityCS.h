@@ -0,0 +1,70 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "GlobalShader.h"
+#include "ShaderCompilerCore.h"
+#include "ShaderParameterMacros.h"
+#include "ShaderParameterStruct.h"
+#include "ShaderPermutation.h"
+
+/** Passes of the activity tracking, must match FluidSimulationActivityCS.usf */
+enum class EFluidSimulationActivityPass : uint8
+{
+    ResetArgs,
+    BuildList,
+    Measure,
+    ClearRetired,
+    MAX
+};
+
+class FFluidSimulationActivityCS : public FGlobalShader
+{
+public:
+
+    DECLARE_GLOBAL_SHADER(FFluidSimulationActivityCS);
+    SHADER_USE_PARAMETER_STRUCT(FFluidSimulationActivityCS, FGlobalShader);
+
+    /** Thread group side */
+    static constexpr int32 ThreadGroupSize = 8;
+
+    class FPassDim : SHADER_PERMUTATION_ENUM_CLASS("ACTIVITY_PASS", EFluidSimulationActivityPass);
+    using FPermutationDomain = TShaderPermutationDomain<FPassDim>;
+
+    BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+        SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, IndirectArgs)
+        SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, TileActivity)
+        SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, TileListed)
+        SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, ActiveTileList)
+        SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, RetiredTileList)
+        SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint>, TileList)
+        SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<FFluidSimulationBrush>, Brushes)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, FieldVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float>, FieldDensity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float2>, OutputVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float>, OutputDensity)
+        SHADER_PARAMETER(uint32, SimulationGridSize)
+        SHADER_PARAMETER(uint32, ActivityTileSize)
+        SHADER_PARAMETER(uint32, NumTilesPerSide)
+        SHADER_PARAMETER(uint32, NumSolveBlocks)
+        SHADER_PARAMETER(float, Threshold)
+        SHADER_PARAMETER(uint32, BrushOffset)
+        SHADER_PARAMETER(uint32, NumBrushes)
+        SHADER_PARAMETER(FIntPoint, FieldOrigin)
+        RDG_BUFFER_ACCESS(IndirectDispatchArgs, ERHIAccess::IndirectArgs)
+    END_SHADER_PARAMETER_STRUCT()
+
+public:
+
+    static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& InParameters)
+    {
+        return IsFeatureLevelSupported(InParameters.Platform, ERHIFeatureLevel::SM5);
+    }
+
+    static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+    {
+        FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+        OutEnvironment.CompilerFlags.Add(CFLAG_StandardOptimization);
+        OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), ThreadGroupSize);
+    }
+};
\ No newline at end of file
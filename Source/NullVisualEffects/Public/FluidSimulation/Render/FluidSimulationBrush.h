@@ -0,0 +1,72 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Compact input record, one per body and tick, rasterized by the solver.
+ *
+ * The brush covers the capsule swept from PreviousCenter to Center. Cells inside it move
+ * towards Velocity * Strength by Weight = (1 - Distance / Radius) ^ Falloff, overlapping
+ * brushes are blended by their weights so the result does not depend on their order.
+ * Layout must match FluidSimulationBrush in FluidSimulationCommon.usf.
+ */
+struct FFluidSimulationBrush
+{
+public:
+
+    /** Current center, in grid cells */
+    FVector2D Center;
+
+    /** Center on the previous tick, in grid cells */
+    FVector2D PreviousCenter;
+
+    /** Velocity written at full weight */
+    FVector2D Velocity;
+
+    /** Radius, in grid cells */
+    float Radius;
+
+    /** Velocity scale */
+    float Strength;
+
+    /** Falloff exponent, 0 is a hard disc */
+    float Falloff;
+
+    /** Slice of the surface in the field texture arrays, the CPU solver only has slice 0 */
+    uint32 Slice;
+
+    /** Constructor */
+    FFluidSimulationBrush()
+        : Center(FVector2D::ZeroVector)
+        , PreviousCenter(FVector2D::ZeroVector)
+        , Velocity(FVector2D::ZeroVector)
+        , Radius(0.0f)
+        , Strength(1.0f)
+        , Falloff(1.0f)
+        , Slice(0)
+    {}
+
+    /** Returns the cells covered by the brush, Max exclusive and clamped to the grid */
+    FIntRect GetCellBounds(const int32 InSimulationGridSize) const
+    {
+        const FVector2D Min = FVector2D(FMath::Min(Center.X, PreviousCenter.X), FMath::Min(Center.Y, PreviousCenter.Y)) - FVector2D(Radius, Radius);
+        const FVector2D Max = FVector2D(FMath::Max(Center.X, PreviousCenter.X), FMath::Max(Center.Y, PreviousCenter.Y)) + FVector2D(Radius, Radius);
+
+        return FIntRect(
+            FMath::Clamp(FMath::FloorToInt(Min.X), 0, InSimulationGridSize), FMath::Clamp(FMath::FloorToInt(Min.Y), 0, InSimulationGridSize),
+            FMath::Clamp(FMath::CeilToInt(Max.X), 0, InSimulationGridSize), FMath::Clamp(FMath::CeilToInt(Max.Y), 0, InSimulationGridSize));
+    }
+
+    /** Returns the weight of the brush at a point, in grid cells, matches GetBrushWeight in FluidSimulationCommon.usf */
+    float GetWeight(const FVector2D& InPoint) const
+    {
+        const FVector2D Segment = Center - PreviousCenter;
+        const float SegmentSizeSquared = Segment.SizeSquared();
+        const float Alpha = SegmentSizeSquared > SMALL_NUMBER ? FMath::Clamp(FVector2D::DotProduct(InPoint - PreviousCenter, Segment) / SegmentSizeSquared, 0.0f, 1.0f) : 0.0f;
+        const float Distance = FVector2D::Distance(InPoint, PreviousCenter + Segment * Alpha);
+
+        return Distance < Radius ? FMath::Pow(1.0f - Distance / Radius, Falloff) : 0.0f;
+    }
+};
\ No newline at end of file
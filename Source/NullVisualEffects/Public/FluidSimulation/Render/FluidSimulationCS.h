@@ -6,6 +6,7 @@
 #include "ShaderCompilerCore.h"
 #include "ShaderParameterMacros.h"
 #include "ShaderParameterStruct.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
 
 class FFluidSimulationCS : public FGlobalShader
 {
@@ -14,20 +15,56 @@ public:
     DECLARE_GLOBAL_SHADER(FFluidSimulationCS);
     SHADER_USE_PARAMETER_STRUCT(FFluidSimulationCS, FGlobalShader);
 
+    /** Thread group side, each group loads a (size + 2)^2 tile with its halo in groupshared memory */
+    class FThreadGroupSizeDim : SHADER_PERMUTATION_SPARSE_INT("THREADGROUP_SIZE", 8, 16);
+
+    /** Indirect dispatch over the active tile list of FFluidSimulationActivity */
+    class FActiveTilesDim : SHADER_PERMUTATION_BOOL("ACTIVE_TILES");
+
+    /** Damped wave equation on a heightfield instead of the diffusion, see EFluidSimulationSolver */
+    class FShallowWaterDim : SHADER_PERMUTATION_BOOL("SHALLOW_WATER");
+
+    /** Advects the tile and its halo as it is loaded, see EFluidSimulationAdvection */
+    class FAdvectionDim : SHADER_PERMUTATION_ENUM_CLASS("ADVECTION", EFluidSimulationAdvection);
+
+    using FPermutationDomain = TShaderPermutationDomain<FThreadGroupSizeDim, FActiveTilesDim, FShallowWaterDim, FAdvectionDim>;
+
     BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-        SHADER_PARAMETER_UAV(RWBuffer<float>, CurrentFluidData)
-        SHADER_PARAMETER_UAV(RWBuffer<float>, PreviousFluidData)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, PreviousVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float>, PreviousDensity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float2>, CurrentVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float>, CurrentDensity)
         SHADER_PARAMETER(int32, SimulationGridSize)
         SHADER_PARAMETER(float, SimulationGridSizeRecip)
         SHADER_PARAMETER(float, FluidDifusion)
         SHADER_PARAMETER(float, FluidViscosity)
         SHADER_PARAMETER(float, DeltaTime)
+        SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint>, ActiveTiles)
+        SHADER_PARAMETER(uint32, ActivityTileSize)
+        SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<FFluidSimulationBrush>, Brushes)
+        SHADER_PARAMETER(uint32, BrushOffset)
+        SHADER_PARAMETER(uint32, NumBrushes)
+        SHADER_PARAMETER(float, ShallowWaterStiffness)
+        SHADER_PARAMETER(float, ShallowWaterDamping)
+        SHADER_PARAMETER(float, ShallowWaterBrushDepth)
+        SHADER_PARAMETER(FIntPoint, FieldOrigin)
+        SHADER_PARAMETER_SAMPLER(SamplerState, FieldSampler)
+        SHADER_PARAMETER(float, AdvectionStep)
+        SHADER_PARAMETER(float, AdvectionMaxDistance)
+        RDG_BUFFER_ACCESS(IndirectDispatchArgs, ERHIAccess::IndirectArgs)
     END_SHADER_PARAMETER_STRUCT()
 
 public:
 
     static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& InParameters)
     {
+        // The heightfield has no velocity to advect
+        FPermutationDomain PermutationVector(InParameters.PermutationId);
+        if (PermutationVector.Get<FShallowWaterDim>() && PermutationVector.Get<FAdvectionDim>() != EFluidSimulationAdvection::None)
+        {
+            return false;
+        }
+
         return IsFeatureLevelSupported(InParameters.Platform, ERHIFeatureLevel::SM5);
     }
 
@@ -35,6 +72,8 @@ public:
     {
         FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
         OutEnvironment.CompilerFlags.Add(CFLAG_StandardOptimization);
-        OutEnvironment.SetDefine(TEXT("CG_SIZE_X"), 32);
     }
+
+    /** Returns the thread group side selected by r.FluidSimulation.ThreadGroupSize, render thread only */
+    static int32 GetThreadGroupSize();
 };
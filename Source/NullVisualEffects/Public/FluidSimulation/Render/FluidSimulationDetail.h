@@ -0,0 +1,125 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RHIResources.h"
+#include "RenderGraphResources.h"
+#include "FluidSimulation/Render/FluidSimulationBrush.h"
+#include "FluidSimulation/Render/FluidSimulationField.h"
+#include "FluidSimulation/Render/FluidSimulationProjection.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
+
+struct FFluidSimulationActivity;
+
+/** Fine patch of the detail level */
+struct FFluidSimulationDetailPatch
+{
+    /** Grid cell of the first patch cell, in window cells */
+    FIntPoint Origin = FIntPoint::ZeroValue;
+
+    /** Slice of the surface the patch refines */
+    int32 Slice = 0;
+
+    /** Seconds left before the patch is freed, 0 when it is free */
+    float Lifetime = 0.0f;
+
+    /** Placed since the last step, every cell is filled from the grid before it is solved */
+    bool bNeedsInit = false;
+
+    /** Returns true if the patch refines the grid */
+    bool IsLive() const { return Lifetime > 0.0f; }
+};
+
+/**
+ * GPU detail level, a pool of fine patches solved on top of the grid.
+ *
+ * Every patch is a slice of its own ring of field texture arrays, PatchGridSize cells wide and
+ * covering PatchGridSize / RefinementRatio grid cells. Patches are placed on the game thread around
+ * the brushes and freed once no body moved through them for a while.
+ * Each step the grid is solved first, its previous state is bilinearly prolongated into the outer ring
+ * of grid cells of every patch, the patches are solved by the regular solver with the brushes moved to
+ * patch cells, and the inner patch cells are box restricted back into the grid cells they cover.
+ * Patches are never wrapped, a move of the sliding window moves them and frees the ones leaving it.
+ */
+struct NULLVISUALEFFECTS_API FFluidSimulationDetail
+{
+public:
+
+    /** Cells per patch side */
+    int32 PatchGridSize = 0;
+
+    /** Patch cells per grid cell side */
+    int32 RefinementRatio = 1;
+
+    /** Ring of patch fields, one slice per patch */
+    TArray<FFluidSimulationField> Fields;
+
+    /** Ring index of the field holding the latest patch state */
+    int32 CurrentFieldIndex = 0;
+
+    /** Pressure projection of the patches, only valid when the grid is projected */
+    FFluidSimulationProjection Projection;
+
+    /** Pool of patches, one per slice of the fields */
+    TArray<FFluidSimulationDetailPatch> Patches;
+
+public:
+
+    /** Creates and clears the patch resources, render thread only */
+    void Init_RenderThread(const FFluidSimulationDetailSettings& InSettings, const int32 InNumFieldBuffers, const EFluidSimulationFieldPrecision InFieldPrecision, const bool bInProjection, FRHICommandListImmediate& RHICmdList);
+
+    /** Releases the patch resources */
+    void SafeRelease();
+
+    /** Returns true if the patch resources are created */
+    bool IsValid() const { return Fields.Num() > 0 && Patches.Num() > 0; }
+
+    /** Returns the bytes held by the patch resources */
+    uint64 GetAllocatedSize() const;
+
+    /** Returns the grid cells a patch covers per side */
+    int32 GetPatchCoarseSize() const { return PatchGridSize / RefinementRatio; }
+
+    /** Returns true if any patch refines the grid */
+    bool HasLivePatches() const;
+
+    /** Returns the ring index of the field after InFieldIndex */
+    int32 GetNextFieldIndex(const int32 InFieldIndex) const { return (InFieldIndex + 1) % Fields.Num(); }
+
+    /** Returns the ring index of the field before the current one */
+    int32 GetPreviousFieldIndex() const { return (CurrentFieldIndex + Fields.Num() - 1) % Fields.Num(); }
+
+    /**
+     * Ages the patches by InDeltaTime and places one around every brush not already well inside a patch of its surface, game thread.
+     * Brushes are in grid cells, patches stay inside the InSimulationGridSize grid. Bodies past the pool are only solved by the grid.
+     */
+    void UpdatePatches(TArrayView<const FFluidSimulationBrush> InBrushes, const int32 InSimulationGridSize, const float InLifetime, const float InDeltaTime);
+
+    /** Appends the brushes overlapping a live patch to OutBrushes, moved to patch cells and to the slice of the patch */
+    void GetPatchBrushes(TArrayView<const FFluidSimulationBrush> InBrushes, TArray<FFluidSimulationBrush>& OutBrushes) const;
+
+    /** Moves the patches by -InDelta grid cells with the sliding window, the ones leaving the InSimulationGridSize grid are freed */
+    void Translate(const FIntPoint& InDelta, const int32 InSimulationGridSize);
+
+    /** Fills every live patch from the grid again on the next step, after the grid state was replaced */
+    void ResetPatches();
+
+    /** Returns the substeps the patches take per grid step, shallow water waves cross RefinementRatio times more patch cells than grid ones */
+    int32 GetNumSubsteps(const EFluidSimulationSolver InSolver, const FFluidSimulationShallowWaterSettings& InShallowWaterSettings, const float InDeltaTime) const;
+
+    /** Packs a patch for the shaders, flagged for its border when live with bInBorders and for every cell when being placed with bInPlace */
+    FIntVector4 GetPatchParameters(const int32 InIndex, const bool bInBorders, const bool bInPlace) const;
+
+    /**
+     * Prolongates InGrid, wrapped at InFieldOrigin, into the patches of InField, render thread only.
+     * bInBorders fills the border of every live patch and bInPlace every cell of the patches being placed.
+     */
+    void Prolongate_RenderThread(const FFluidSimulationFieldTextures& InGrid, const int32 InSimulationGridSize, const FIntPoint& InFieldOrigin, const FFluidSimulationFieldTextures& InField, const bool bInBorders, const bool bInPlace, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const;
+
+    /**
+     * Restricts the inner cells of every live patch of InField into InOutGrid, wrapped at InFieldOrigin, render thread only.
+     * With a valid InActivity only the grid tiles solved this step are written.
+     */
+    void Restrict_RenderThread(const FFluidSimulationFieldTextures& InField, const int32 InSimulationGridSize, const FIntPoint& InFieldOrigin, const FFluidSimulationActivity& InActivity, const FFluidSimulationFieldTextures& InOutGrid, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const;
+};
@@ -0,0 +1,87 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "GlobalShader.h"
+#include "ShaderCompilerCore.h"
+#include "ShaderParameterMacros.h"
+#include "ShaderParameterStruct.h"
+#include "ShaderPermutation.h"
+
+/** Passes coupling the detail patches with the grid, must match FluidSimulationDetailCS.usf */
+enum class EFluidSimulationDetailPass : uint8
+{
+    Prolongate,
+    Restrict,
+    MAX
+};
+
+class FFluidSimulationDetailCS : public FGlobalShader
+{
+public:
+
+    DECLARE_GLOBAL_SHADER(FFluidSimulationDetailCS);
+    SHADER_USE_PARAMETER_STRUCT(FFluidSimulationDetailCS, FGlobalShader);
+
+    /** Thread group side */
+    static constexpr int32 ThreadGroupSize = 8;
+
+    /** Patches in the pool at most, must match FFluidSimulationDetailSettings::GetMaxPatches */
+    static constexpr int32 MaxPatches = 16;
+
+    /** Patch flags packed in W of the patch parameters */
+    enum FPatchFlags
+    {
+        /** The patch refines the grid */
+        PatchLive = 1,
+
+        /** Every cell of the patch is prolongated, not only its border */
+        PatchFull = 2,
+    };
+
+    class FPassDim : SHADER_PERMUTATION_ENUM_CLASS("DETAIL_PASS", EFluidSimulationDetailPass);
+
+    /** Restricts only into the grid tiles solved this step, see FFluidSimulationActivity */
+    class FActiveTilesDim : SHADER_PERMUTATION_BOOL("ACTIVE_TILES");
+
+    using FPermutationDomain = TShaderPermutationDomain<FPassDim, FActiveTilesDim>;
+
+    BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, SourceVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float>, SourceDensity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float2>, OutFluidVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float>, OutFluidDensity)
+        SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint>, TileListed)
+        SHADER_PARAMETER_ARRAY(FIntVector4, Patches, [MaxPatches])
+        SHADER_PARAMETER(int32, SimulationGridSize)
+        SHADER_PARAMETER(FIntPoint, FieldOrigin)
+        SHADER_PARAMETER(int32, PatchGridSize)
+        SHADER_PARAMETER(int32, RefinementRatio)
+        SHADER_PARAMETER(uint32, ActivityTileSize)
+        SHADER_PARAMETER(uint32, NumTilesPerSide)
+    END_SHADER_PARAMETER_STRUCT()
+
+public:
+
+    static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& InParameters)
+    {
+        // Only the restriction writes into the grid tiles
+        FPermutationDomain PermutationVector(InParameters.PermutationId);
+        if (PermutationVector.Get<FActiveTilesDim>() && PermutationVector.Get<FPassDim>() != EFluidSimulationDetailPass::Restrict)
+        {
+            return false;
+        }
+
+        return IsFeatureLevelSupported(InParameters.Platform, ERHIFeatureLevel::SM5);
+    }
+
+    static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+    {
+        FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+        OutEnvironment.CompilerFlags.Add(CFLAG_StandardOptimization);
+        OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), ThreadGroupSize);
+        OutEnvironment.SetDefine(TEXT("MAX_DETAIL_PATCHES"), MaxPatches);
+        OutEnvironment.SetDefine(TEXT("DETAIL_PATCH_LIVE"), static_cast<int32>(PatchLive));
+        OutEnvironment.SetDefine(TEXT("DETAIL_PATCH_FULL"), static_cast<int32>(PatchFull));
+    }
+};
@@ -14,11 +14,26 @@ public:
     DECLARE_GLOBAL_SHADER(FFluidSimulationDrawCS);
     SHADER_USE_PARAMETER_STRUCT(FFluidSimulationDrawCS, FGlobalShader);
 
+    /** Thread group side */
+    static constexpr int32 ThreadGroupSize = 8;
+
+    /** Draws the shallow water heightfield as a normal map */
+    class FShallowWaterDim : SHADER_PERMUTATION_BOOL("SHALLOW_WATER");
+
+    using FPermutationDomain = TShaderPermutationDomain<FShallowWaterDim>;
+
     BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-        SHADER_PARAMETER_UAV(RWTexture2D<float>, OutTexture)
-        SHADER_PARAMETER_UAV(RWBuffer<float>, FluidData)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, OutTexture)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, FluidVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float>, FluidDensity)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, PreviousFluidVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float>, PreviousFluidDensity)
+        SHADER_PARAMETER(float, InterpolationAlpha)
         SHADER_PARAMETER(int32, SimulationGridSize)
         SHADER_PARAMETER(float, SimulationGridSizeRecip)
+        SHADER_PARAMETER(uint32, Slice)
+        SHADER_PARAMETER(float, NormalStrength)
+        SHADER_PARAMETER(FIntPoint, FieldOrigin)
     END_SHADER_PARAMETER_STRUCT()
 
 public:
@@ -32,5 +47,6 @@ public:
     {
         FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
         OutEnvironment.CompilerFlags.Add(CFLAG_StandardOptimization);
+        OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), ThreadGroupSize);
     }
 };
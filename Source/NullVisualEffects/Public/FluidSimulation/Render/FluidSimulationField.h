@@ -0,0 +1,68 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RHIResources.h"
+#include "RenderGraphResources.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
+
+class FRDGBuilder;
+
+/** Field textures registered in a render graph */
+struct FFluidSimulationFieldTextures
+{
+    /** Velocity texture */
+    FRDGTextureRef Velocity = nullptr;
+
+    /** Density texture */
+    FRDGTextureRef Density = nullptr;
+};
+
+/**
+ * GPU storage of the simulation state.
+ *
+ * Velocity and density live in separate texture arrays so each pass only touches the
+ * fields it needs, cell coords are the texel coords and are never stored. Each slice
+ * holds one surface, so a batch of same sized surfaces is solved by single dispatches.
+ * Passes read through SRVs and write through UAVs, so no typed UAV loads
+ * of multi channel formats are required.
+ * The textures are pooled and registered in the render graph of every step,
+ * which tracks their state so no pass transitions them by hand.
+ */
+struct NULLVISUALEFFECTS_API FFluidSimulationField
+{
+public:
+
+    /** Velocity texture */
+    TRefCountPtr<IPooledRenderTarget> Velocity;
+
+    /** Density texture */
+    TRefCountPtr<IPooledRenderTarget> Density;
+
+public:
+
+    /** Creates and clears the field textures with InNumSlices surfaces, render thread only */
+    void Init_RenderThread(const int32 InSimulationGridSize, const int32 InNumSlices, const EFluidSimulationFieldPrecision InPrecision, FRHICommandListImmediate& RHICmdList);
+
+    /** Releases the field textures */
+    void SafeRelease();
+
+    /** Returns true if the field textures are created */
+    bool IsValid() const { return Velocity.IsValid() && Density.IsValid(); }
+
+    /** Returns the bytes held by the field textures */
+    uint64 GetAllocatedSize() const;
+
+    /** Registers the field textures in GraphBuilder */
+    FFluidSimulationFieldTextures Register(FRDGBuilder& GraphBuilder) const;
+
+    /** Creates a single field texture array in GraphBuilder */
+    static FRDGTextureRef CreateTexture(FRDGBuilder& GraphBuilder, const int32 InSize, const int32 InNumSlices, const EPixelFormat InFormat, const TCHAR* InDebugName);
+
+    /** Returns the velocity pixel format for a precision */
+    static EPixelFormat GetVelocityFormat(const EFluidSimulationFieldPrecision InPrecision);
+
+    /** Returns the density pixel format for a precision */
+    static EPixelFormat GetDensityFormat(const EFluidSimulationFieldPrecision InPrecision);
+};
\ No newline at end of file
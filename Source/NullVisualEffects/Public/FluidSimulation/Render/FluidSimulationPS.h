@@ -6,8 +6,9 @@
 #include "ShaderCompilerCore.h"
 #include "ShaderParameterMacros.h"
 #include "ShaderParameterStruct.h"
+#include "FluidSimulation/Render/FluidSimulationDetailCS.h"
 
-/** Particle simulation draw vertex shader implementation */
+/** Fluid simulation draw pixel shader, upsamples the fields into targets of any size */
 class FFluidSimulationPS : public FGlobalShader
 {
 public:
@@ -15,7 +16,34 @@ public:
     DECLARE_GLOBAL_SHADER(FFluidSimulationPS);
     SHADER_USE_PARAMETER_STRUCT(FFluidSimulationPS, FGlobalShader);
 
+    /** Catmull-Rom filter over 4x4 cells instead of the hardware bilinear one */
+    class FBicubicDim : SHADER_PERMUTATION_BOOL("BICUBIC");
+
+    /** Draws the shallow water heightfield as a normal map */
+    class FShallowWaterDim : SHADER_PERMUTATION_BOOL("SHALLOW_WATER");
+
+    /** Composites the detail patches over the grid, see FFluidSimulationDetail */
+    class FDetailDim : SHADER_PERMUTATION_BOOL("DETAIL");
+
+    using FPermutationDomain = TShaderPermutationDomain<FBicubicDim, FShallowWaterDim, FDetailDim>;
+
     BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, FluidVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, PreviousFluidVelocity)
+        SHADER_PARAMETER_SAMPLER(SamplerState, FieldSampler)
+        SHADER_PARAMETER(int32, SimulationGridSize)
+        SHADER_PARAMETER(float, SimulationGridSizeRecip)
+        SHADER_PARAMETER(uint32, Slice)
+        SHADER_PARAMETER(float, InterpolationAlpha)
+        SHADER_PARAMETER(float, NormalStrength)
+        SHADER_PARAMETER(FIntPoint, FieldOrigin)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, DetailVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, PreviousDetailVelocity)
+        SHADER_PARAMETER_ARRAY(FIntVector4, DetailPatches, [FFluidSimulationDetailCS::MaxPatches])
+        SHADER_PARAMETER(uint32, NumDetailPatches)
+        SHADER_PARAMETER(int32, DetailGridSize)
+        SHADER_PARAMETER(int32, DetailRatio)
+        RENDER_TARGET_BINDING_SLOTS()
     END_SHADER_PARAMETER_STRUCT()
 
 public:
@@ -27,6 +55,9 @@ public:
 
     static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
     {
+        FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+        OutEnvironment.CompilerFlags.Add(CFLAG_StandardOptimization);
+        OutEnvironment.SetDefine(TEXT("MAX_DETAIL_PATCHES"), FFluidSimulationDetailCS::MaxPatches);
     }
 
 };
\ No newline at end of file
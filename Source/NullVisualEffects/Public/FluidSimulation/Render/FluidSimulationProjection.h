@@ -0,0 +1,91 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RHIResources.h"
+#include "RenderGraphResources.h"
+#include "FluidSimulation/Render/FluidSimulationField.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
+
+struct FFluidSimulationActivity;
+
+/**
+ * GPU resources and passes of the multigrid pressure projection.
+ *
+ * Same scheme as FFluidSimulationCPUMultigrid. Only the finest pressure, kept as the
+ * initial guess of the next step, and the scratch velocity outlive a step. The right hand
+ * sides, residuals and coarse pressures are fully rewritten by every V-cycle so they are
+ * transient graph textures, pooled and aliased by the render graph.
+ * The solver writes its velocity into ScratchVelocity and the projection writes the
+ * divergence free velocity into the output field.
+ * There is no readback, so every step runs the configured number of V-cycles.
+ */
+struct NULLVISUALEFFECTS_API FFluidSimulationProjection
+{
+public:
+
+    /** Single level of the grid pyramid */
+    struct FLevel
+    {
+        /** Cells per side */
+        int32 Size = 0;
+
+        /** Squared cell size in finest grid cells */
+        float CellSizeSquared = 1.0f;
+    };
+
+    /** Grid pyramid, finest first */
+    TArray<FLevel> Levels;
+
+    /** Surfaces solved together, one per texture array slice */
+    int32 NumSlices = 1;
+
+    /** Finest level pressure */
+    TRefCountPtr<IPooledRenderTarget> Pressure;
+
+    /** Velocity written by the solver before it is projected */
+    TRefCountPtr<IPooledRenderTarget> ScratchVelocity;
+
+public:
+
+    /** Creates and clears the persistent textures, render thread only */
+    void Init_RenderThread(const int32 InSimulationGridSize, const int32 InNumSlices, const EFluidSimulationFieldPrecision InPrecision, FRHICommandListImmediate& RHICmdList);
+
+    /** Releases the persistent textures */
+    void SafeRelease();
+
+    /** Returns true if the persistent textures are created */
+    bool IsValid() const { return Levels.Num() > 0 && Pressure.IsValid() && ScratchVelocity.IsValid(); }
+
+    /** Returns the bytes held by the persistent textures, the transient ones belong to the graph pool */
+    uint64 GetAllocatedSize() const;
+
+    /**
+     * Adds the passes projecting InScratchVelocity into InOutputVelocity, render thread only.
+     * InFieldOrigin is the wrap around of the velocity textures, the pressure pyramid is never wrapped.
+     * With a valid InActivity only the tiles listed this step feed the divergence and get the gradient.
+     */
+    void Project_RenderThread(const FFluidSimulationProjectionSettings& InSettings, FRDGTextureRef InScratchVelocity, FRDGTextureRef InOutputVelocity, const FIntPoint& InFieldOrigin, const FFluidSimulationActivity& InActivity, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const;
+
+private:
+
+    /** Level textures of the current graph */
+    struct FLevelTextures
+    {
+        /** Pressure, or pressure correction on coarse levels */
+        FRDGTextureRef Pressure = nullptr;
+
+        /** Right hand side, divergence on the finest level and restricted residual on coarse ones */
+        FRDGTextureRef RightHandSide = nullptr;
+
+        /** Residual of the last evaluation */
+        FRDGTextureRef Residual = nullptr;
+    };
+
+    /** Adds a V-cycle starting at InLevelIndex */
+    void VCycle_RenderThread(TArrayView<const FLevelTextures> InTextures, const int32 InLevelIndex, const int32 InSmoothingIterations, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const;
+
+    /** Adds red-black Gauss-Seidel sweeps */
+    void Smooth_RenderThread(const FLevel& InLevel, const FLevelTextures& InTextures, const int32 InIterations, const ERDGPassFlags InPassFlags, FRDGBuilder& GraphBuilder) const;
+};
\ No newline at end of file
@@ -0,0 +1,78 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "GlobalShader.h"
+#include "ShaderCompilerCore.h"
+#include "ShaderParameterMacros.h"
+#include "ShaderParameterStruct.h"
+#include "ShaderPermutation.h"
+
+/** Passes of the multigrid pressure projection, must match FluidSimulationProjectionCS.usf */
+enum class EFluidSimulationProjectionPass : uint8
+{
+    Divergence,
+    Smooth,
+    Residual,
+    Restrict,
+    Prolongate,
+    SubtractGradient,
+    MAX
+};
+
+class FFluidSimulationProjectionCS : public FGlobalShader
+{
+public:
+
+    DECLARE_GLOBAL_SHADER(FFluidSimulationProjectionCS);
+    SHADER_USE_PARAMETER_STRUCT(FFluidSimulationProjectionCS, FGlobalShader);
+
+    /** Thread group side */
+    static constexpr int32 ThreadGroupSize = 8;
+
+    class FPassDim : SHADER_PERMUTATION_ENUM_CLASS("PROJECTION_PASS", EFluidSimulationProjectionPass);
+
+    /** Projects only the tiles solved this step, see FFluidSimulationActivity */
+    class FActiveTilesDim : SHADER_PERMUTATION_BOOL("ACTIVE_TILES");
+
+    using FPermutationDomain = TShaderPermutationDomain<FPassDim, FActiveTilesDim>;
+
+    BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, InputVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float2>, OutputVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float>, Pressure)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float>, SourcePressure)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float>, SourceField)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float>, OutputField)
+        SHADER_PARAMETER(int32, LevelSize)
+        SHADER_PARAMETER(int32, SourceLevelSize)
+        SHADER_PARAMETER(float, CellSizeSquared)
+        SHADER_PARAMETER(int32, Color)
+        SHADER_PARAMETER(FIntPoint, FieldOrigin)
+        SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint>, TileListed)
+        SHADER_PARAMETER(uint32, ActivityTileSize)
+        SHADER_PARAMETER(uint32, NumTilesPerSide)
+    END_SHADER_PARAMETER_STRUCT()
+
+public:
+
+    static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& InParameters)
+    {
+        // Only the passes reading or writing the velocity follow the tiles, the pressure is solved over the whole grid
+        FPermutationDomain PermutationVector(InParameters.PermutationId);
+        const EFluidSimulationProjectionPass Pass = PermutationVector.Get<FPassDim>();
+        if (PermutationVector.Get<FActiveTilesDim>() && Pass != EFluidSimulationProjectionPass::Divergence && Pass != EFluidSimulationProjectionPass::SubtractGradient)
+        {
+            return false;
+        }
+
+        return IsFeatureLevelSupported(InParameters.Platform, ERHIFeatureLevel::SM5);
+    }
+
+    static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+    {
+        FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+        OutEnvironment.CompilerFlags.Add(CFLAG_StandardOptimization);
+        OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), ThreadGroupSize);
+    }
+};
\ No newline at end of file
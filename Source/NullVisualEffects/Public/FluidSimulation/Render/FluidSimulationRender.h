@@ -4,63 +4,19 @@
 
 #include "CoreMinimal.h"
 #include "RHIResources.h"
+#include "FluidSimulation/FluidSimulationStats.h"
+#include "FluidSimulation/CPU/FluidSimulationCPUSolver.h"
+#include "FluidSimulation/Render/FluidSimulationActivity.h"
+#include "FluidSimulation/Render/FluidSimulationBrush.h"
+#include "FluidSimulation/Render/FluidSimulationDetail.h"
+#include "FluidSimulation/Render/FluidSimulationField.h"
+#include "FluidSimulation/Render/FluidSimulationProjection.h"
+#include "FluidSimulation/Render/FluidSimulationSampler.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
 #include "FluidSimulationRender.generated.h"
 
-struct FFluidSimulationVertex
-{
-public:
-
-    /** Vertex coords */
-    FVector2D Coords;
-
-    /** Velocity */
-    FVector2D Velocity;
-
-    /** Density */
-    float Density;
-
-    /** Constructor */
-    FFluidSimulationVertex()
-        : Coords(FVector2D::ZeroVector)
-        , Velocity(FVector2D::ZeroVector)
-        , Density(0.0f)
-    {}
-
-    /** Constructor */
-    FFluidSimulationVertex
-    (
-        const FVector2D& InCoords,
-        const FVector2D& InVelocity,
-        const float InDensity
-    )
-        : Coords(InCoords)
-        , Velocity(InVelocity)
-        , Density(InDensity)
-    {}
-};
-
-struct FFluidCellInputData
-{
-public:
-
-    /** Add velocity */
-    FVector2D Velocity;
-
-    /** Add cell */
-    FIntPoint Cell;
-
-    /** Constructor */
-    FFluidCellInputData()
-        : Velocity(FVector2D::ZeroVector)
-        , Cell(FIntPoint::ZeroValue)
-    {}
-
-    /** Constructor */
-    FFluidCellInputData(const FVector2D& InVelocity, const FIntPoint& InCell)
-        : Velocity(InVelocity)
-        , Cell(InCell)
-    {}
-};
+/** Broadcast once the simulation resources exist and the surface starts simulating */
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnFluidSimulationReady, class UFluidSimulationRender*);
 
 UCLASS()
 class NULLVISUALEFFECTS_API UFluidSimulationRender : public UObject, public FTickableGameObject
@@ -90,48 +46,241 @@ public:
 
 public:
 
-    /** Init render object */
-    bool Init(const int32 InSimulationGridSize);
+    /**
+     * Init render object, returns false for an empty grid.
+     * Never waits on the render thread. The GPU resources are created and cleared there and the simulation
+     * becomes ready a frame or two later, brushes and snapshots received in between are kept for its first step.
+     * With bInPreserveState a simulation already running on the same backend is resampled to the new grid
+     * instead of starting from still water.
+     */
+    bool Init(const int32 InSimulationGridSize, const EFluidSimulationBackend InBackend = EFluidSimulationBackend::GPU, const bool bInPreserveState = false);
+
+    /** Returns true once the resources created by Init exist and the simulation steps */
+    bool IsReady() const { return bIsInit; }
+
+    /** Blocks until the simulation is ready, for tools and tests only */
+    void WaitUntilReady();
+
+    /** Broadcast when the GPU resources are picked up, check IsReady first as the CPU backend is ready when Init returns */
+    FOnFluidSimulationReady& OnReady() { return ReadyEvent; }
+
+    /** 
+     * Draws the current simulation state onto a Render Target.
+     * Targets the size of the grid are written by a compute shader, in place when created with bCanCreateUAV
+     * and through a copy otherwise. Any other size is rasterized with the upsample filter.
+     * Targets with mips get them regenerated after the draw.
+     * InSlice selects the surface when several share the simulation.
+     * The CPU backend only draws targets the size of the grid.
+     */
+    void DrawToRenderTarget(class UTextureRenderTarget2D* InRenderTarget, const int32 InSlice = 0);
+
+    /** Sets the output render target of a surface */
+    void SetRenderTarget(class UTextureRenderTarget2D* InRenderTarget, const int32 InSlice = 0);
+
+    /**
+     * Enqueues a brush for the next step, locations are normalized to [-1, 1] and
+     * InRadius is relative to the grid size. The brush sweeps from the previous location to the current one.
+     * InSlice selects the surface when several share the simulation.
+     */
+    void AddVelocityDensity(const FVector& InLocation, const FVector& InPreviousLocation, const FVector& InVelocity, const float InRadius, const float InStrength, const float InFalloff = 1.0f, const int32 InSlice = 0);
 
     /** 
-     * Draws the current simulation state onto a Render Target,
-     * for now I'll be using a compute shader to draw the result
-     * so it's easier to visualize results.
-     * 
-     * #TODO 
-     * Further in the future will use Vertex and Pixel shader so
-     * it's possible to draw in bigger Render Targets.
+     * Samples the simulation at InCoords, in grid cells.
+     * With the shallow water solver OutVelocity holds the height in X and its vertical speed in Y.
+     * Only the CPU backend keeps the state on this side, returns false otherwise.
+     */
+    bool SampleVelocityDensity(const FVector2D& InCoords, FVector2D& OutVelocity, float& OutDensity) const;
+
+    /**
+     * Samples the simulation at every InCoords, in grid cells, of a surface.
+     * The CPU backend resolves the future immediately. On the GPU every query of a frame is gathered
+     * by a single dispatch after the steps and read back without stalling, the future is resolved
+     * on the game thread once the readback latency has passed and the GPU is done.
+     * Queries resolve with no samples when the simulation is released or not initialized.
+     */
+    TFuture<TArray<FFluidSimulationSample>> SampleVelocityDensityAsync(TArrayView<const FVector2D> InCoords, const int32 InSlice = 0);
+
+    /**
+     * Captures the state of a surface as a FFluidSimulationSnapshot blob.
+     * The CPU backend resolves the future immediately, the GPU one reads every cell back through
+     * the sampler and resolves it on the game thread a few frames later. Resolves empty on failure.
+     */
+    TFuture<TArray<uint8>> CaptureSnapshot(const int32 InSlice = 0);
+
+    /**
+     * Replaces the state of a surface with a snapshot, resampled when captured at another grid size.
+     * The simulation clock is restored too when the surface is alone, a shared clock keeps running.
+     * Call it after Init, returns false if the snapshot does not fit the simulation.
+     */
+    bool RestoreSnapshot(TArrayView<const uint8> InData, const int32 InSlice = 0);
+
+    /**
+     * Returns a surface to still water and drops its render target and pending brushes,
+     * for a slice handed over to another surface. The other slices and the clock are left alone.
+     */
+    void ResetSlice(const int32 InSlice);
+
+    /**
+     * Moves the grid by InDelta cells over the fluid, for a fixed size window following a focus point.
+     * Cell (X, Y) takes the state of cell (X + InDelta.X, Y + InDelta.Y) and the cells entering the window are still water.
+     * The GPU fields are addressed with wrap around, only the exposed rows and columns are cleared and nothing is copied.
+     * Brushes and sample queries not solved yet are moved with the fluid. Every surface of the simulation moves together.
+     */
+    void MoveWindow(const FIntPoint& InDelta);
+
+    /** Returns the texel of the GPU fields holding cell (0, 0), moved by MoveWindow */
+    const FIntPoint& GetFieldOrigin() const { return FieldOrigin; }
+
+    /** Returns the time simulated since Init or the last snapshot restored on a single surface simulation, in seconds */
+    double GetSimulationTime() const { return SimulationTime; }
+
+    /** Sets the frames a GPU sample readback is left alone before it is polled, 1 to 3 */
+    void SetSampleReadbackLatency(const int32 InSampleReadbackLatency);
+
+    /** Returns the backend actually in use, GPU requests fall back to CPU when there is no RHI */
+    EFluidSimulationBackend GetBackend() const { return Backend; }
+
+    /** Sets the equations the simulation solves, applied on the next Init */
+    void SetSolver(const EFluidSimulationSolver InSolver);
+
+    /** Returns the equations the simulation solves */
+    EFluidSimulationSolver GetSolver() const { return Solver; }
+
+    /** Sets the shallow water solver settings, applied on the next Init */
+    void SetShallowWaterSettings(const FFluidSimulationShallowWaterSettings& InShallowWaterSettings);
+
+    /** Sets the advection settings, applied on the next step, the shallow water solver ignores them */
+    void SetAdvectionSettings(const FFluidSimulationAdvectionSettings& InAdvectionSettings);
+
+    /** Sets the CPU solver settings, applied on the next Init */
+    void SetCPUSettings(const FFluidSimulationCPUSettings& InCPUSettings);
+
+    /** Sets the pressure projection settings, applied on the next Init */
+    void SetProjectionSettings(const FFluidSimulationProjectionSettings& InProjectionSettings);
+
+    /** Sets the activity tracking settings, applied on the next Init */
+    void SetActivitySettings(const FFluidSimulationActivitySettings& InActivitySettings);
+
+    /**
+     * Sets the detail level settings, applied on the next Init.
+     * Only the GPU backend refines the grid, and only draws into targets larger than the grid show the patches.
+     */
+    void SetDetailSettings(const FFluidSimulationDetailSettings& InDetailSettings);
+
+    /** Sets the simulation clock settings, the accumulator restarts on the next Init */
+    void SetTimestepSettings(const FFluidSimulationTimestepSettings& InTimestepSettings);
+
+    /** Returns the interpolation between the last two steps the next draw uses */
+    float GetInterpolationAlpha() const { return InterpolationAlpha; }
+
+    /** Sets the filter drawing into targets larger than the grid */
+    void SetUpsampleFilter(const EFluidSimulationUpsampleFilter InUpsampleFilter);
+
+    /** Sets the field storage precision, applied on the next Init, the CPU backend rounds its state the same way */
+    void SetFieldPrecision(const EFluidSimulationFieldPrecision InFieldPrecision);
+
+    /**
+     * Sets how many fields the GPU ring holds, applied on the next Init.
+     * 2 is enough for the solver, 3 keeps the field being drawn out of the way of the next solve.
      */
-    void DrawToRenderTarget(class UTextureRenderTarget2D* InRenderTarget);
+    void SetNumFieldBuffers(const int32 InNumFieldBuffers);
 
-    /** Sets the output render target */
-    void SetRenderTarget(class UTextureRenderTarget2D* InRenderTarget);
+    /**
+     * Sets how many same sized surfaces share the simulation, applied on the next Init.
+     * Each surface is a slice of the field texture arrays and every pass covers all of them in one dispatch.
+     * The CPU backend always solves a single surface.
+     */
+    void SetNumSlices(const int32 InNumSlices);
 
-    /** Enqueues data to be added to  */
-    void AddVelocityDensity(const FVector& InLocation, const FVector& InVelocity, const float InRadius, const float InViscosity);
+    /** Returns the surfaces sharing the simulation */
+    int32 GetNumSlices() const { return NumSlices; }
+
+    /** Returns the brushes a surface received for the last step */
+    int32 GetNumBrushes(const int32 InSlice) const { return LastSliceBrushCounts.IsValidIndex(InSlice) ? LastSliceBrushCounts[InSlice] : 0; }
+
+    /** Stops the self tick, the owner calls Tick instead */
+    void SetTickedExternally(const bool bInTickedExternally);
+
+    /**
+     * Gathers the queued sample points and resolves the readbacks the GPU is done with, called by Tick.
+     * An owner ticking the simulation externally calls it on the frames it skips the step, so queries never wait for the next step.
+     */
+    void UpdateSampler();
+
+    /** Returns the stats of the last simulation step, only the CPU backend is timed for now, the GPU only reports the active tiles */
+    FFluidSimulationSolverStats GetSolverStats() const;
 
 private:
 
     /** Updates the fluid */
     void UpdateFluid(const float InDeltaTime);
 
-    /** Add input data */
-    void AddInputData();
+    /** Returns the ring index of the field the next solve writes */
+    int32 GetNextFieldIndex() const;
+
+    /** Returns the ring index of the field the last solve read */
+    int32 GetPreviousFieldIndex() const;
+
+    /** Replaces the memory accounted for the simulation with what it holds now */
+    void UpdateMemoryStats();
+
+    /** Takes the GPU resources created by Init once the render thread is done with them */
+    void UpdateInitState();
+
+    /** Replaces the state of a surface with InPlanes, a grid of the simulation size */
+    bool SetSliceState(const FFluidSimulationPlanes& InPlanes, const int32 InSlice);
 
 private:
 
-    /** Add input forces and density render thread implementation */
-    static void AddInputData_RenderThread(const int32 InSimulationGridSize, const TArray<FFluidCellInputData>& InForcesDensityData, const FUnorderedAccessViewRHIRef& InBufferUAV, FRHICommandListImmediate& RHICmdList);
+    /** GPU resources created by Init on the render thread, handed to the game thread once InitFence completes */
+    struct FPendingInit
+    {
+        /** Ring of simulation fields */
+        TArray<FFluidSimulationField> Fields;
+
+        /** Pressure projection resources */
+        FFluidSimulationProjection Projection;
+
+        /** Activity tracking resources */
+        FFluidSimulationActivity Activity;
+
+        /** Detail patch resources */
+        FFluidSimulationDetail Detail;
+    };
+
+private:
 
     /** Update fluid render thread implementation */
-    static void UpdateFluid_RenderThread(const int32 InSimulationGridSize, const float InFluidDifusion, const float InFluidViscosity, const float InDeltaTime, const FUnorderedAccessViewRHIRef& InCurrentUAV, const FUnorderedAccessViewRHIRef& InPreviousUAV, FRHICommandListImmediate& RHICmdList);
+    static void UpdateFluid_RenderThread(const int32 InSimulationGridSize, const int32 InNumSlices, const float InFluidDifusion, const float InFluidViscosity, const float InDeltaTime, const FFluidSimulationField& InCurrentField, const FFluidSimulationField& InPreviousField, const FFluidSimulationProjectionSettings& InProjectionSettings, const FFluidSimulationProjection& InProjection, const TArray<FFluidSimulationField>& InFields, const FFluidSimulationActivity& InActivity, const EFluidSimulationSolver InSolver, const FFluidSimulationShallowWaterSettings& InShallowWaterSettings, const FFluidSimulationAdvectionSettings& InAdvectionSettings, const TArray<FFluidSimulationBrush>& InBrushes, const FIntPoint& InFieldOrigin, FRHICommandListImmediate& RHICmdList);
+
+    /**
+     * Steps the detail patches after the grid went from InGridField to InNextGridField, render thread implementation.
+     * The patches take InNumSubsteps solver steps driven by InGridField on their border and are restricted into InNextGridField.
+     */
+    static void UpdateDetail_RenderThread(const int32 InSimulationGridSize, const FFluidSimulationField& InGridField, const FFluidSimulationField& InNextGridField, const FIntPoint& InFieldOrigin, const FFluidSimulationActivity& InActivity, const FFluidSimulationDetail& InDetail, const int32 InNumSubsteps, const float InFluidDifusion, const float InFluidViscosity, const float InDeltaTime, const FFluidSimulationProjectionSettings& InProjectionSettings, const EFluidSimulationSolver InSolver, const FFluidSimulationShallowWaterSettings& InShallowWaterSettings, const FFluidSimulationAdvectionSettings& InAdvectionSettings, const TArray<FFluidSimulationBrush>& InBrushes, FRHICommandListImmediate& RHICmdList);
 
-    /** Draw to render target render thread implementation */
-    static void DrawToRenderTarget_RenderThread(class UTextureRenderTarget2D* InRenderTarget, const int32 InSimulationGridSize, const FVertexBufferRHIRef& InVertexBuffer, const FUnorderedAccessViewRHIRef& InBufferUAV, FRHICommandListImmediate& RHICmdList);
+    /** Draw to render target render thread implementation, the live patches of InDetail are composited by the upsampling draw */
+    static void DrawToRenderTarget_RenderThread(class UTextureRenderTarget2D* InRenderTarget, const int32 InSimulationGridSize, const int32 InSlice, const FFluidSimulationField& InField, const FFluidSimulationField& InPreviousField, const float InInterpolationAlpha, const EFluidSimulationUpsampleFilter InUpsampleFilter, const EFluidSimulationSolver InSolver, const FFluidSimulationShallowWaterSettings& InShallowWaterSettings, const FIntPoint& InFieldOrigin, const FFluidSimulationDetail& InDetail, FRHICommandListImmediate& RHICmdList);
+
+    /**
+     * Creates the GPU resources of Init, render thread implementation.
+     * A valid InSourceField, InSourceGridSize cells wide with InSourceNumSlices surfaces and wrapped at InSourceFieldOrigin,
+     * is resampled into every new field. The new fields are not wrapped. The detail patches are created when InDetailSettings is enabled.
+     */
+    static void InitResources_RenderThread(FPendingInit& OutInit, const int32 InSimulationGridSize, const int32 InNumSlices, const int32 InNumFieldBuffers, const EFluidSimulationFieldPrecision InFieldPrecision, const bool bInProjection, const FFluidSimulationActivitySettings& InActivitySettings, const FFluidSimulationDetailSettings& InDetailSettings, const FFluidSimulationField& InSourceField, const int32 InSourceGridSize, const int32 InSourceNumSlices, const FIntPoint& InSourceFieldOrigin, FRHICommandListImmediate& RHICmdList);
+
+    /** Writes InCells, X-major, into a slice of every field of the ring and activates every tile, render thread implementation */
+    static void RestoreFields_RenderThread(const int32 InSimulationGridSize, const int32 InSlice, const TArray<FVector4>& InCells, const TArray<FFluidSimulationField>& InFields, const FFluidSimulationActivity& InActivity, const FIntPoint& InFieldOrigin, FRHICommandListImmediate& RHICmdList);
+
+    /** Clears the cells InDelta exposed in every field of the ring, already wrapped at InFieldOrigin, and activates every tile, render thread implementation */
+    static void MoveWindow_RenderThread(const int32 InSimulationGridSize, const int32 InNumSlices, const FIntPoint& InFieldOrigin, const FIntPoint& InDelta, const TArray<FFluidSimulationField>& InFields, const FFluidSimulationActivity& InActivity, FRHICommandListImmediate& RHICmdList);
+
+    /** Uploads the CPU solver output to the render target render thread implementation */
+    static void DrawCPUToRenderTarget_RenderThread(class UTextureRenderTarget2D* InRenderTarget, const int32 InSimulationGridSize, const TArray<FColor>& InColors, FRHICommandListImmediate& RHICmdList);
 
 protected:
 
-    /** Is the render init */
+    /** The simulation resources exist and it steps */
     bool bIsInit;
 
     /** Fluid difusion */
@@ -140,35 +289,114 @@ protected:
     /** Fluid viscosity */
     float FluidViscosity;
 
-    /** Output render target */
-    class UTextureRenderTarget2D* OutputRenderTarget;
+    /** Output render target of every surface, indexed by slice */
+    TArray<class UTextureRenderTarget2D*> OutputRenderTargets;
 
 private:
 
-    /** Pending fluid input data to add */
-    TArray<FFluidCellInputData> PendingFluidInput;
+    /** Brushes enqueued for the next step */
+    TArray<FFluidSimulationBrush> PendingBrushes;
 
     /** Simulation grid size */
     int32 SimulationGridSize;
 
-    /** Vertex buffer */
-    FVertexBufferRHIRef VertexBuffer; 
+    /** Backend in use */
+    EFluidSimulationBackend Backend;
+
+    /** Equations the simulation solves */
+    EFluidSimulationSolver Solver;
 
-    /** Vertex buffer unordered access view */
-    FUnorderedAccessViewRHIRef VertexBufferUAV;
+    /** Shallow water solver settings, shared by both backends */
+    FFluidSimulationShallowWaterSettings ShallowWaterSettings;
 
-    /** Spare vertex buffer */
-    FVertexBufferRHIRef SpareVertexBuffer;
+    /** Advection settings, shared by both backends */
+    FFluidSimulationAdvectionSettings AdvectionSettings;
 
-    /** Spare vertex buffer unordered access view */
-    FUnorderedAccessViewRHIRef SpareVertexBufferUAV;
+    /** CPU solver settings */
+    FFluidSimulationCPUSettings CPUSettings;
+
+    /** Pressure projection settings, shared by both backends */
+    FFluidSimulationProjectionSettings ProjectionSettings;
+
+    /** Activity tracking settings, shared by both backends */
+    FFluidSimulationActivitySettings ActivitySettings;
+
+    /** Detail level settings, GPU backend only */
+    FFluidSimulationDetailSettings DetailSettings;
+
+    /** Simulation clock settings, shared by both backends */
+    FFluidSimulationTimestepSettings TimestepSettings;
+
+    /** Frame time not yet consumed by a fixed step, in seconds */
+    float TimeAccumulator;
+
+    /** Time simulated since Init, in seconds */
+    double SimulationTime;
+
+    /** Interpolation between the last two steps, 1 draws the latest one */
+    float InterpolationAlpha;
+
+    /** Filter drawing into targets larger than the grid */
+    EFluidSimulationUpsampleFilter UpsampleFilter;
+
+    /** CPU solver, only valid with the CPU backend */
+    TUniquePtr<FFluidSimulationCPUSolver> CPUSolver;
+
+    /** Field storage precision */
+    EFluidSimulationFieldPrecision FieldPrecision;
+
+    /** Number of fields in the ring */
+    int32 NumFieldBuffers;
+
+    /** Surfaces sharing the simulation */
+    int32 NumSlices;
+
+    /** Brushes enqueued per surface for the next step */
+    TArray<int32> SliceBrushCounts;
+
+    /** Brushes per surface of the last step */
+    TArray<int32> LastSliceBrushCounts;
+
+    /** The owner ticks the simulation */
+    bool bTickedExternally;
+
+    /** Ring of simulation fields, each solve reads the current one and writes the next */
+    TArray<FFluidSimulationField> Fields;
+
+    /** Ring index of the field holding the latest state */
+    int32 CurrentFieldIndex;
+
+    /** Texel of the fields holding cell (0, 0), every field of the ring wraps the same way */
+    FIntPoint FieldOrigin;
+
+    /** GPU pressure projection resources, only valid with the GPU backend and the projection enabled */
+    FFluidSimulationProjection Projection;
+
+    /** GPU activity tracking resources, only valid with the GPU backend and activity tracking enabled */
+    FFluidSimulationActivity Activity;
+
+    /** GPU detail patches, only valid with the GPU backend and the detail level enabled */
+    FFluidSimulationDetail Detail;
+
+    /** Bytes accounted in the memory stats */
+    FFluidSimulationMemoryUsage MemoryUsage;
+
+    /** Batched GPU sampling of the fields */
+    FFluidSimulationSampler Sampler;
+
+    /** Frames a GPU sample readback is left alone before it is polled */
+    int32 SampleReadbackLatency;
 
     /** Render command fence */
     FRenderCommandFence RenderFence;
 
-public:
+    /** GPU resources being created, null once the simulation is ready */
+    TSharedPtr<FPendingInit, ESPMode::ThreadSafe> PendingInit;
+
+    /** Completes once the render thread created PendingInit */
+    FRenderCommandFence InitFence;
 
-    /** Fluid simulation vertex data declaration */
-    static const FVertexDeclarationElementList VertexSimulationDataDeclaration;
+    /** Broadcast when the simulation becomes ready */
+    FOnFluidSimulationReady ReadyEvent;
 
 };
\ No newline at end of file
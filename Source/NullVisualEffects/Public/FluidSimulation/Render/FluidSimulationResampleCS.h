@@ -0,0 +1,45 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "GlobalShader.h"
+#include "ShaderCompilerCore.h"
+#include "ShaderParameterMacros.h"
+#include "ShaderParameterStruct.h"
+
+class FFluidSimulationResampleCS : public FGlobalShader
+{
+public:
+
+    DECLARE_GLOBAL_SHADER(FFluidSimulationResampleCS);
+    SHADER_USE_PARAMETER_STRUCT(FFluidSimulationResampleCS, FGlobalShader);
+
+    /** Cells per thread group side */
+    static constexpr int32 ThreadGroupSize = 8;
+
+    BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, SourceVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float>, SourceDensity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float2>, OutFluidVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float>, OutFluidDensity)
+        SHADER_PARAMETER(int32, SourceGridSize)
+        SHADER_PARAMETER(int32, SimulationGridSize)
+        SHADER_PARAMETER(uint32, NumSlices)
+        SHADER_PARAMETER(FIntPoint, SourceFieldOrigin)
+        SHADER_PARAMETER(FIntPoint, FieldOrigin)
+    END_SHADER_PARAMETER_STRUCT()
+
+public:
+
+    static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& InParameters)
+    {
+        return IsFeatureLevelSupported(InParameters.Platform, ERHIFeatureLevel::SM5);
+    }
+
+    static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+    {
+        FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+        OutEnvironment.CompilerFlags.Add(CFLAG_StandardOptimization);
+        OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), ThreadGroupSize);
+    }
+};
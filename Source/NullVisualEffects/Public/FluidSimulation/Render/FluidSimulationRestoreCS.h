@@ -2,24 +2,28 @@
 
 #pragma once
 
-#include "FluidSimulation/Render/FluidSimulationRender.h"
 #include "GlobalShader.h"
 #include "ShaderCompilerCore.h"
 #include "ShaderParameterMacros.h"
 #include "ShaderParameterStruct.h"
 
-class FFluidSimulationAddInputCS : public FGlobalShader
+class FFluidSimulationRestoreCS : public FGlobalShader
 {
 public:
 
-    DECLARE_GLOBAL_SHADER(FFluidSimulationAddInputCS);
-    SHADER_USE_PARAMETER_STRUCT(FFluidSimulationAddInputCS, FGlobalShader);
+    DECLARE_GLOBAL_SHADER(FFluidSimulationRestoreCS);
+    SHADER_USE_PARAMETER_STRUCT(FFluidSimulationRestoreCS, FGlobalShader);
+
+    /** Cells per thread group side */
+    static constexpr int32 ThreadGroupSize = 8;
 
     BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-        SHADER_PARAMETER_UAV(RWBuffer<float>, CurrentFluidData)
-        SHADER_PARAMETER_UAV(RWStructuredBuffer<FFluidCellInputData>, ForcesDencityData)
+        SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<float4>, RestoreCells)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float2>, OutFluidVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float>, OutFluidDensity)
         SHADER_PARAMETER(int32, SimulationGridSize)
-        SHADER_PARAMETER(float, SimulationGridSizeRecip)
+        SHADER_PARAMETER(uint32, Slice)
+        SHADER_PARAMETER(FIntPoint, FieldOrigin)
     END_SHADER_PARAMETER_STRUCT()
 
 public:
@@ -32,5 +36,7 @@ public:
     static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
     {
         FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+        OutEnvironment.CompilerFlags.Add(CFLAG_StandardOptimization);
+        OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), ThreadGroupSize);
     }
 };
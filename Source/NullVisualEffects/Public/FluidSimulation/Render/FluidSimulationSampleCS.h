@@ -0,0 +1,43 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "GlobalShader.h"
+#include "ShaderCompilerCore.h"
+#include "ShaderParameterMacros.h"
+#include "ShaderParameterStruct.h"
+
+class FFluidSimulationSampleCS : public FGlobalShader
+{
+public:
+
+    DECLARE_GLOBAL_SHADER(FFluidSimulationSampleCS);
+    SHADER_USE_PARAMETER_STRUCT(FFluidSimulationSampleCS, FGlobalShader);
+
+    /** Points per thread group */
+    static constexpr int32 ThreadGroupSize = 64;
+
+    BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+        SHADER_PARAMETER_RDG_BUFFER_SRV(StructuredBuffer<FluidSimulationSamplePoint>, SamplePoints)
+        SHADER_PARAMETER_RDG_BUFFER_UAV(RWStructuredBuffer<float4>, OutSamples)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float2>, FluidVelocity)
+        SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2DArray<float>, FluidDensity)
+        SHADER_PARAMETER(uint32, NumSamplePoints)
+        SHADER_PARAMETER(int32, SimulationGridSize)
+        SHADER_PARAMETER(FIntPoint, FieldOrigin)
+    END_SHADER_PARAMETER_STRUCT()
+
+public:
+
+    static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& InParameters)
+    {
+        return IsFeatureLevelSupported(InParameters.Platform, ERHIFeatureLevel::SM5);
+    }
+
+    static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+    {
+        FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+        OutEnvironment.CompilerFlags.Add(CFLAG_StandardOptimization);
+        OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), ThreadGroupSize);
+    }
+};
@@ -0,0 +1,131 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "HAL/ThreadSafeBool.h"
+#include "FluidSimulation/Render/FluidSimulationField.h"
+#include "Library/NullVisualEffectsTypeLibrary.h"
+
+class FRHIGPUBufferReadback;
+
+/** Point gathered by the sample pass, layout must match FluidSimulationSamplePoint in FluidSimulationSampleCS.usf */
+struct FFluidSimulationSamplePoint
+{
+    /** Location, in grid cells */
+    FVector2D Coords;
+
+    /** Slice of the surface in the field texture arrays */
+    uint32 Slice = 0;
+
+    /** Keeps the stride at 16 bytes */
+    uint32 Padding = 0;
+};
+
+/**
+ * Batched asynchronous sampling of the GPU fields.
+ *
+ * Queries only queue their points, every point queued during a frame is gathered from the
+ * latest field by a single dispatch and copied into one FRHIGPUBufferReadback. The readback
+ * is left alone for the configured latency and then polled without blocking until the GPU is
+ * done with it, the queries of the batch are resolved on the game thread on the next update.
+ * Game thread only, the render thread side lives in the batches.
+ */
+class NULLVISUALEFFECTS_API FFluidSimulationSampler
+{
+public:
+
+    /** Constructor */
+    FFluidSimulationSampler();
+
+    /** Destructor */
+    ~FFluidSimulationSampler();
+
+public:
+
+    /** Queues points of a surface for the next gather, InCoords in grid cells */
+    TFuture<TArray<FFluidSimulationSample>> Enqueue(TArrayView<const FVector2D> InCoords, const int32 InSlice);
+
+    /**
+     * Resolves the batches read back and gathers the queued points from InField.
+     * InLatency is the frames a readback is left alone before it is polled, InFieldOrigin the wrap around of the field.
+     */
+    void Update(const FFluidSimulationField& InField, const int32 InSimulationGridSize, const int32 InLatency, const FIntPoint& InFieldOrigin = FIntPoint::ZeroValue);
+
+    /** Moves the points waiting for the next gather by InOffset grid cells, used when the grid moves under them */
+    void Translate(const FVector2D& InOffset);
+
+    /** Resolves the pending queries with empty results and drops the batches in flight */
+    void Release();
+
+    /** Returns the points waiting for the next gather */
+    int32 GetNumPendingPoints() const { return PendingPoints.Num(); }
+
+    /** Returns the batches waiting for their readback */
+    int32 GetNumBatchesInFlight() const { return InFlight.Num(); }
+
+private:
+
+    /** Points of a single Enqueue */
+    struct FQuery
+    {
+        /** Resolved with the samples of the query */
+        TPromise<TArray<FFluidSimulationSample>> Promise;
+
+        /** First point of the query in its batch */
+        int32 First = 0;
+
+        /** Points of the query */
+        int32 Num = 0;
+    };
+
+    /** Points gathered by a single dispatch, shared with the render thread */
+    struct FBatch
+    {
+        /** Readback of the gathered samples, render thread only */
+        TUniquePtr<FRHIGPUBufferReadback> Readback;
+
+        /** Gathered samples, velocity in XY and density in Z, written by the render thread before bResolved is set */
+        TArray<FVector4> Results;
+
+        /** Points in the batch */
+        int32 NumPoints = 0;
+
+        /** Game thread frame the batch was submitted on */
+        uint64 SubmitFrame = 0;
+
+        /** Results are ready to be read on the game thread */
+        FThreadSafeBool bResolved;
+    };
+
+    /** Batch waiting for its readback */
+    struct FInFlightBatch
+    {
+        /** Render thread side */
+        TSharedPtr<FBatch, ESPMode::ThreadSafe> Batch;
+
+        /** Queries resolved by the batch */
+        TArray<FQuery> Queries;
+    };
+
+    /** Fulfills InQueries from InResults */
+    static void Resolve(TArray<FQuery>& InQueries, TArrayView<const FVector4> InResults);
+
+    /** Gathers InPoints from InField and queues the copy into the readback of InBatch, render thread only */
+    static void Gather_RenderThread(FBatch& InBatch, const TArray<FFluidSimulationSamplePoint>& InPoints, const FFluidSimulationField& InField, const int32 InSimulationGridSize, const FIntPoint& InFieldOrigin, FRHICommandListImmediate& RHICmdList);
+
+    /** Copies the samples out of the readback of InBatch once the GPU is done with it, render thread only */
+    static void Poll_RenderThread(FBatch& InBatch);
+
+private:
+
+    /** Points queued for the next gather */
+    TArray<FFluidSimulationSamplePoint> PendingPoints;
+
+    /** Queries of the queued points */
+    TArray<FQuery> PendingQueries;
+
+    /** Batches waiting for their readback, oldest first */
+    TArray<FInFlightBatch> InFlight;
+};
@@ -0,0 +1,87 @@
+// Copyright (C) Ronaldo Veloso. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RenderResource.h"
+#include "RHIResources.h"
+#include "RenderGraphResources.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "HAL/ThreadSafeCounter64.h"
+#include "FluidSimulation/Render/FluidSimulationBrush.h"
+
+/**
+ * Upload ring for the brushes of every UFluidSimulationRender.
+ *
+ * A single persistent structured buffer, sub-allocated per step and wrapped around
+ * when full, so no RHI resource is created in steady state. The buffer only grows,
+ * to the next power of two that fits the request, and the shaders index it with
+ * the offset of their allocation.
+ * The buffer comes from the render graph buffer pool and each step registers it in its graph.
+ * Render thread only.
+ */
+class NULLVISUALEFFECTS_API FFluidSimulationUploadBuffer : public FRenderResource
+{
+public:
+
+    /** Slice of the ring holding the records of one step */
+    struct FAllocation
+    {
+        /** Whole ring buffer, to register in the graph reading the slice */
+        TRefCountPtr<FRDGPooledBuffer> Buffer;
+
+        /** First record of the slice */
+        uint32 Offset = 0;
+
+        /** Records in the slice */
+        uint32 Num = 0;
+    };
+
+public:
+
+    /** Constructor */
+    FFluidSimulationUploadBuffer();
+
+    //~ Begin FRenderResource interface
+    virtual void ReleaseRHI() override;
+    //~ End FRenderResource interface
+
+public:
+
+    /** Copies InBrushes into the ring and returns where they landed */
+    FAllocation Upload_RenderThread(TArrayView<const FFluidSimulationBrush> InBrushes);
+
+    /** Returns the bytes uploaded since startup */
+    uint64 GetBytesUploaded() const { return static_cast<uint64>(BytesUploaded.GetValue()); }
+
+    /** Returns the times the ring was reallocated */
+    int32 GetNumReallocations() const { return NumReallocations.GetValue(); }
+
+    /** Returns the ring capacity in records */
+    int32 GetCapacity() const { return Capacity.GetValue(); }
+
+private:
+
+    /** Replaces the ring with one of at least InMinCapacity records */
+    void Grow_RenderThread(const uint32 InMinCapacity);
+
+private:
+
+    /** Ring buffer */
+    TRefCountPtr<FRDGPooledBuffer> Buffer;
+
+    /** Next free record */
+    uint32 Head;
+
+    /** Records in the ring, read from any thread */
+    FThreadSafeCounter Capacity;
+
+    /** Bytes uploaded since startup, read from any thread */
+    FThreadSafeCounter64 BytesUploaded;
+
+    /** Reallocations since startup, read from any thread */
+    FThreadSafeCounter NumReallocations;
+};
+
+/** Upload ring shared by every fluid simulation */
+extern NULLVISUALEFFECTS_API TGlobalResource<FFluidSimulationUploadBuffer> GFluidSimulationUploadBuffer;
\ No newline at end of file
@@ -7,7 +7,7 @@
 #include "ShaderParameterMacros.h"
 #include "ShaderParameterStruct.h"
 
-/** Particle simulation draw vertex shader implementation */
+/** Fluid simulation draw vertex shader, a single triangle covering the target */
 class FFluidSimulationVS : public FGlobalShader
 {
 public:
@@ -27,6 +27,7 @@ public:
 
     static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
     {
+        FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
     }
 
 };
\ No newline at end of file
@@ -10,14 +10,4 @@ class NULLVISUALEFFECTS_API UNullVisualEffectsFunctionLibrary : public UBlueprin
 {
     GENERATED_BODY()
 
-public:
-
-    /** Copies a vertex buffer */
-    static void CopyVertexBuffer(const FVertexBufferRHIRef InSourceBuffer, const FVertexBufferRHIRef InDestinationBuffer);
-
-private:
-
-    /** Copies a vertex buffer render thread implementation */
-    static void CopyVertexBuffer_RenderThread(const FVertexBufferRHIRef InSourceBuffer, const FVertexBufferRHIRef InDestinationBuffer, FRHICommandListImmediate& RHICmdList);
-
 };
\ No newline at end of file
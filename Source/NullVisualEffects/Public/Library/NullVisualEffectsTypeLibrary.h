@@ -1,3 +1,596 @@
 // Copyright (C) Ronaldo Veloso. All Rights Reserved.
 
 #pragma once
+
+#include "CoreMinimal.h"
+#include "NullVisualEffectsTypeLibrary.generated.h"
+
+/** Where the fluid simulation is solved */
+UENUM(BlueprintType)
+enum class EFluidSimulationBackend : uint8
+{
+    /** Compute shaders, the default path */
+    GPU,
+
+    /** Reference solver on the game thread, works without an RHI (-nullrhi, dedicated servers) */
+    CPU,
+};
+
+/** CPU solver settings */
+USTRUCT(BlueprintType)
+struct FFluidSimulationCPUSettings
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Cells per tile side, tiles are the unit of work handed to the worker threads */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "8", UIMin = "8"))
+    int32 TileSize;
+
+    /** Spreads the tiles across the task graph worker threads */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation")
+    bool bMultithreaded;
+
+    /** Constructor */
+    FFluidSimulationCPUSettings()
+        : TileSize(64)
+        , bMultithreaded(true)
+    {}
+};
+
+/** Pressure projection settings, keeps the velocity field incompressible */
+USTRUCT(BlueprintType)
+struct FFluidSimulationProjectionSettings
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Runs the projection after the diffuse step */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation")
+    bool bEnabled;
+
+    /** Maximum multigrid V-cycles per step */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "1", UIMin = "1", UIMax = "8"))
+    int32 NumCycles;
+
+    /** Red-black Gauss-Seidel sweeps before and after each coarse grid correction */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "1", UIMin = "1", UIMax = "8"))
+    int32 NumSmoothingIterations;
+
+    /** Cycling stops once the largest residual falls below this, CPU backend only */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float ResidualTolerance;
+
+    /** Constructor */
+    FFluidSimulationProjectionSettings()
+        : bEnabled(true)
+        , NumCycles(2)
+        , NumSmoothingIterations(2)
+        , ResidualTolerance(0.0001f)
+    {}
+};
+
+/** Scheme moving the fluid along its own velocity, Navier-Stokes solver only */
+UENUM(BlueprintType)
+enum class EFluidSimulationAdvection : uint8
+{
+    /** The velocity only diffuses */
+    None,
+
+    /** Every cell traces its velocity back over the step and takes the bilinear sample found there, stable but smears the detail */
+    SemiLagrangian,
+
+    /**
+     * Semi-Lagrangian step corrected by half the error of a round trip trace, clamped to the sampled cells.
+     * Second order, keeps the detail of a grid twice as fine for five traces per cell instead of one.
+     */
+    MacCormack,
+
+    MAX UMETA(Hidden)
+};
+
+/** Advection settings, shared by both backends */
+USTRUCT(BlueprintType)
+struct FFluidSimulationAdvectionSettings
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Scheme moving the fluid */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation")
+    EFluidSimulationAdvection Scheme;
+
+    /** Grid cells per second the fluid moves for a unit of velocity, brush velocities are in world units */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float VelocityScale;
+
+    /** Longest trace per step, in cells, kept within the activity tile so the dilated active list covers where the fluid goes */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.5", ClampMax = "16.0"))
+    float MaxCellsPerStep;
+
+    /** Constructor */
+    FFluidSimulationAdvectionSettings()
+        : Scheme(EFluidSimulationAdvection::None)
+        , VelocityScale(0.1f)
+        , MaxCellsPerStep(4.0f)
+    {}
+
+    /** Returns true if the fluid is advected */
+    bool IsEnabled() const { return Scheme == EFluidSimulationAdvection::SemiLagrangian || Scheme == EFluidSimulationAdvection::MacCormack; }
+
+    /** Returns the cells a unit of velocity moves the fluid over InDeltaTime */
+    float GetCellsPerVelocity(const float InDeltaTime) const { return FMath::Max(VelocityScale, 0.0f) * InDeltaTime; }
+
+    /** Returns the longest trace per step, in cells */
+    float GetMaxDistance() const { return FMath::Max(MaxCellsPerStep, 0.5f); }
+};
+
+/** Activity tracking settings, quiescent tiles of the grid are not solved */
+USTRUCT(BlueprintType)
+struct FFluidSimulationActivitySettings
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Only solves the tiles with moving fluid or new input, plus their neighbours */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation")
+    bool bEnabled;
+
+    /** Cells per activity tile side, 16 or 32 */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "16", ClampMax = "32"))
+    int32 TileSize;
+
+    /** A tile stays active while any velocity component or density is above this */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float Threshold;
+
+    /** Constructor */
+    FFluidSimulationActivitySettings()
+        : bEnabled(false)
+        , TileSize(32)
+        , Threshold(0.001f)
+    {}
+
+    /** Returns TileSize snapped to a supported size */
+    int32 GetTileSize() const { return TileSize >= 32 ? 32 : 16; }
+};
+
+/** Simulation clock settings, a fixed step keeps the solver independent from the frame rate */
+USTRUCT(BlueprintType)
+struct FFluidSimulationTimestepSettings
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Steps the solver at StepRate, running as many substeps as the frame time covers */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation")
+    bool bFixedTimestep;
+
+    /** Solver steps per second */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "1.0", UIMin = "10.0", UIMax = "120.0"))
+    float StepRate;
+
+    /** Maximum substeps per frame, the simulation slows down past it instead of falling further behind */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "1", UIMin = "1", UIMax = "8"))
+    int32 MaxSubsteps;
+
+    /** Draws the state interpolated between the last two steps by the time left in the accumulator */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation")
+    bool bInterpolate;
+
+    /** Constructor */
+    FFluidSimulationTimestepSettings()
+        : bFixedTimestep(true)
+        , StepRate(60.0f)
+        , MaxSubsteps(4)
+        , bInterpolate(true)
+    {}
+
+    /** Returns the duration of a step, in seconds */
+    float GetStepSeconds() const { return 1.0f / FMath::Max(StepRate, 1.0f); }
+};
+
+/** Sliding window settings, a fixed size grid follows a focus point over an unbounded water surface */
+USTRUCT(BlueprintType)
+struct FFluidSimulationSlidingWindowSettings
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Keeps the grid centered on the focus point, the fluid stays where it is in the world and the surface moves over it */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation")
+    bool bEnabled;
+
+    /** Cells the window moves at once, 0 uses the activity tile size as every move wakes up all the tiles */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0"))
+    int32 SnapCells;
+
+    /** Constructor */
+    FFluidSimulationSlidingWindowSettings()
+        : bEnabled(false)
+        , SnapCells(0)
+    {}
+
+    /** Returns the cells the window moves at once */
+    int32 GetSnapCells(const FFluidSimulationActivitySettings& InActivitySettings) const
+    {
+        return SnapCells > 0 ? SnapCells : (InActivitySettings.bEnabled ? InActivitySettings.GetTileSize() : 1);
+    }
+};
+
+/** Equations the fluid simulation solves */
+UENUM(BlueprintType)
+enum class EFluidSimulationSolver : uint8
+{
+    /** Diffused and projected 2D velocity, the default */
+    NavierStokes,
+
+    /**
+     * Damped wave equation on a heightfield, ripples and wakes in a single pass per step.
+     * The velocity field holds the height in X and its vertical speed in Y, and the draw writes a normal map.
+     */
+    ShallowWater,
+};
+
+/** Shallow water solver settings */
+USTRUCT(BlueprintType)
+struct FFluidSimulationShallowWaterSettings
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Wave speed in cells per second, clamped per step so a wave never crosses more than 0.7 cells */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0", UIMax = "60.0"))
+    float WaveSpeed;
+
+    /** Fraction of the vertical speed lost per second */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0", UIMax = "10.0"))
+    float Damping;
+
+    /** Height the brushes press the surface down to, scaled by their strength */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float BrushDepth;
+
+    /** Scale of the height slopes in the drawn normal map */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float NormalStrength;
+
+    /** Constructor */
+    FFluidSimulationShallowWaterSettings()
+        : WaveSpeed(30.0f)
+        , Damping(0.5f)
+        , BrushDepth(0.25f)
+        , NormalStrength(4.0f)
+    {}
+
+    /** Returns the wave speed times the step, in cells, within the stability limit of the explicit integration */
+    float GetCourantNumber(const float InDeltaTime) const { return FMath::Min(WaveSpeed * InDeltaTime, 0.7f); }
+
+    /** Returns the multiplier applied to the vertical speed every step */
+    float GetDampingFactor(const float InDeltaTime) const { return FMath::Max(1.0f - Damping * InDeltaTime, 0.0f); }
+};
+
+/**
+ * Detail level settings, GPU backend only.
+ * A small pool of fine patches refines the grid where bodies move, each patch is solved at RefinementRatio
+ * times the grid resolution, driven by the grid on its border and written back into the cells it covers.
+ */
+USTRUCT(BlueprintType)
+struct FFluidSimulationDetailSettings
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Spawns fine patches around the bodies */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation")
+    bool bEnabled;
+
+    /** Cells per patch side, rounded up to a multiple of 8 */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "32", ClampMax = "512"))
+    int32 PatchGridSize;
+
+    /** Patch cells per grid cell side, 2, 4 or 8 */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "2", ClampMax = "8"))
+    int32 RefinementRatio;
+
+    /** Patches shared by every surface of the simulation, bodies past it are only solved by the grid */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "1", ClampMax = "16"))
+    int32 MaxPatches;
+
+    /** Seconds a patch outlives the last body moving through it */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float PatchLifetime;
+
+    /** Constructor */
+    FFluidSimulationDetailSettings()
+        : bEnabled(false)
+        , PatchGridSize(128)
+        , RefinementRatio(8)
+        , MaxPatches(4)
+        , PatchLifetime(2.0f)
+    {}
+
+    /** Returns PatchGridSize snapped to a supported size */
+    int32 GetPatchGridSize() const { return FMath::DivideAndRoundUp(FMath::Clamp(PatchGridSize, 32, 512), 8) * 8; }
+
+    /** Returns RefinementRatio snapped to a supported ratio */
+    int32 GetRefinementRatio() const { return RefinementRatio >= 8 ? 8 : (RefinementRatio >= 4 ? 4 : 2); }
+
+    /** Returns MaxPatches within the supported range */
+    int32 GetMaxPatches() const { return FMath::Clamp(MaxPatches, 1, 16); }
+
+    /** Returns the grid cells a patch covers per side */
+    int32 GetPatchCoarseSize() const { return GetPatchGridSize() / GetRefinementRatio(); }
+};
+
+/** Timings of the last simulation step */
+USTRUCT(BlueprintType)
+struct FFluidSimulationSolverStats
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Time spent adding input, in milliseconds */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float AddInputMs;
+
+    /** Time spent solving, in milliseconds */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float UpdateFluidMs;
+
+    /** Time spent in the pressure projection, in milliseconds */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float ProjectMs;
+
+    /** Multigrid V-cycles run by the pressure projection */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumPressureCycles;
+
+    /** Largest pressure residual left after the projection */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float PressureResidual;
+
+    /** Time spent for the whole step, in milliseconds */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float StepMs;
+
+    /** Active cells solved per second over the whole step */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float CellsPerSecond;
+
+    /** Tiles processed by the step */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumTiles;
+
+    /** Threads available to the step */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumThreads;
+
+    /** Activity tiles solved by the step, every tile when activity tracking is off */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumActiveTiles;
+
+    /** Cells covered by the active tiles */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumActiveCells;
+
+    /** Constructor */
+    FFluidSimulationSolverStats()
+        : AddInputMs(0.0f)
+        , UpdateFluidMs(0.0f)
+        , ProjectMs(0.0f)
+        , NumPressureCycles(0)
+        , PressureResidual(0.0f)
+        , StepMs(0.0f)
+        , CellsPerSecond(0.0f)
+        , NumTiles(0)
+        , NumThreads(0)
+        , NumActiveTiles(0)
+        , NumActiveCells(0)
+    {}
+};
+
+/** Level of detail policy of the fluid simulation manager */
+USTRUCT(BlueprintType)
+struct FFluidSimulationLODSettings
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Lowers the update rate of small, distant and hidden surfaces, every batch updates every frame otherwise */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation")
+    bool bEnabled;
+
+    /** Game thread time the batch updates may take per frame, in milliseconds, batches past it wait for the next frame. 0 is unlimited */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float FrameBudgetMs;
+
+    /** Below this screen size, bounds diameter over view distance, a surface updates every 2nd frame */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float HalfRateScreenSize;
+
+    /** Below this screen size a surface updates every 4th frame */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float QuarterRateScreenSize;
+
+    /** Beyond this distance from every view a surface goes dormant */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float DormantDistance;
+
+    /** A surface not rendered for this long goes dormant, in seconds */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0"))
+    float DormantDelay;
+
+    /** Fraction the thresholds move against the current level so surfaces on the edge do not flicker */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "FluidSimulation", meta = (ClampMin = "0.0", ClampMax = "0.5"))
+    float Hysteresis;
+
+    /** Constructor */
+    FFluidSimulationLODSettings()
+        : bEnabled(true)
+        , FrameBudgetMs(2.0f)
+        , HalfRateScreenSize(0.5f)
+        , QuarterRateScreenSize(0.1f)
+        , DormantDistance(50000.0f)
+        , DormantDelay(1.0f)
+        , Hysteresis(0.1f)
+    {}
+};
+
+/** Stats of a surface owned by the fluid simulation manager */
+USTRUCT(BlueprintType)
+struct FFluidSimulationSurfaceStats
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Batch solving the surface, INDEX_NONE when the surface is not managed */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 BatchIndex;
+
+    /** Slice of the batch the surface lives in */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 Slice;
+
+    /** Surfaces sharing the batch */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumBatchSurfaces;
+
+    /** Brushes the surface received for the last step */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumBrushes;
+
+    /** Frames between two updates of the batch, 0 while dormant */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 UpdateInterval;
+
+    /** Game thread time of the batch tick split evenly across its surfaces, in milliseconds */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float AmortizedTickMs;
+
+    /** Solver stats of the whole batch */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    FFluidSimulationSolverStats BatchStats;
+
+    /** Constructor */
+    FFluidSimulationSurfaceStats()
+        : BatchIndex(INDEX_NONE)
+        , Slice(INDEX_NONE)
+        , NumBatchSurfaces(0)
+        , NumBrushes(0)
+        , UpdateInterval(0)
+        , AmortizedTickMs(0.0f)
+    {}
+};
+
+/** Aggregate stats of the fluid simulation manager */
+USTRUCT(BlueprintType)
+struct FFluidSimulationManagerStats
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Registered surfaces */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumSurfaces;
+
+    /** Batches the surfaces are packed into, one simulation each */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumBatches;
+
+    /** Batches updated by the last tick */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumUpdatedBatches;
+
+    /** Batches dormant during the last tick */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumDormantBatches;
+
+    /** Game thread time of the last update of every batch, in milliseconds */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float TickMs;
+
+    /** Solver step time of every batch, in milliseconds, only the CPU backend is timed for now */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float StepMs;
+
+    /** Activity tiles across every batch */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumTiles;
+
+    /** Activity tiles solved across every batch */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    int32 NumActiveTiles;
+
+    /** Constructor */
+    FFluidSimulationManagerStats()
+        : NumSurfaces(0)
+        , NumBatches(0)
+        , NumUpdatedBatches(0)
+        , NumDormantBatches(0)
+        , TickMs(0.0f)
+        , StepMs(0.0f)
+        , NumTiles(0)
+        , NumActiveTiles(0)
+    {}
+};
+
+/** Filter used to draw the simulation into render targets larger than the grid */
+UENUM(BlueprintType)
+enum class EFluidSimulationUpsampleFilter : uint8
+{
+    /** Hardware bilinear, a single fetch per field */
+    Bilinear,
+
+    /** Catmull-Rom over 4x4 cells, sharper at high upscale ratios */
+    Bicubic,
+};
+
+/** Storage precision of the GPU simulation fields */
+UENUM(BlueprintType)
+enum class EFluidSimulationFieldPrecision : uint8
+{
+    /** RG32F velocity and R32F density */
+    Full,
+
+    /** RG16F velocity and R16F density, half the bandwidth */
+    Half,
+
+    /** RG16F velocity and R8 density, 40 bits per cell, density is stored as [0, 1] coverage */
+    Packed,
+};
+
+/** Fluid state at a sampled point */
+USTRUCT(BlueprintType)
+struct FFluidSimulationSample
+{
+    GENERATED_BODY()
+
+public:
+
+    /** Velocity in grid cells, the shallow water solver returns the height in X and its vertical speed in Y */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    FVector Velocity;
+
+    /** Density */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "FluidSimulation")
+    float Density;
+
+    /** Constructor */
+    FFluidSimulationSample()
+        : Velocity(FVector::ZeroVector)
+        , Density(0.0f)
+    {}
+};
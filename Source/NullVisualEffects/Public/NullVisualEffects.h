@@ -5,6 +5,8 @@
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
 
+NULLVISUALEFFECTS_API DECLARE_LOG_CATEGORY_EXTERN(LogNullVisualEffects, Log, All);
+
 class FNullVisualEffectsModule : public IModuleInterface
 {
 public: